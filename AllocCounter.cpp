@@ -0,0 +1,122 @@
+#include "AllocCounter.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+// Every block starts with a header holding its size and tag, so a free comes off
+// the tag the block was made under. 16 bytes keeps the block at malloc's alignment.
+const size_t HEADER_BYTES = 16;
+
+struct alignas(64) TagCounters {
+    std::atomic<int64_t> live;
+    std::atomic<int64_t> peak;
+    std::atomic<uint64_t> allocs;
+};
+
+// Zero-initialized before any constructor runs, so allocations made during static
+// initialization are counted too.
+static TagCounters tagCounters[MEM_TAG_COUNT];
+static TagCounters totalCounters;
+
+thread_local MemTag memCurrentTag = MEM_OTHER;
+
+static void add_live(TagCounters& c, int64_t bytes) {
+    int64_t live = c.live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    if (bytes <= 0) return;
+    int64_t peak = c.peak.load(std::memory_order_relaxed);
+    while (live > peak && !c.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+}
+
+static void account(MemTag tag, int64_t bytes) {
+    add_live(tagCounters[tag], bytes);
+    add_live(totalCounters, bytes);
+}
+
+static MemTagStats load(const TagCounters& c) {
+    return { c.live.load(std::memory_order_relaxed), c.peak.load(std::memory_order_relaxed), c.allocs.load(std::memory_order_relaxed) };
+}
+
+uint64_t alloc_count() {
+    return totalCounters.allocs.load(std::memory_order_relaxed);
+}
+
+MemTagStats mem_tag_stats(MemTag tag) {
+    return load(tagCounters[tag]);
+}
+
+MemTagStats mem_total_stats() {
+    return load(totalCounters);
+}
+
+void mem_reset_peaks() {
+    for (TagCounters& c : tagCounters) c.peak.store(c.live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    totalCounters.peak.store(totalCounters.live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void mem_note(MemTag tag, int64_t bytes) {
+    account(tag, bytes);
+}
+
+int64_t process_resident_bytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+    return (int64_t)pmc.WorkingSetSize;
+#elif defined(__linux__)
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    long long pages = 0, resident = 0;
+    int fields = fscanf(f, "%lld %lld", &pages, &resident);
+    fclose(f);
+    return fields == 2 ? (int64_t)resident * sysconf(_SC_PAGESIZE) : 0;
+#else
+    return 0;
+#endif
+}
+
+// The array and nothrow forms default to these. Over-aligned types keep the
+// library's aligned forms and are not counted; nothing here allocates them.
+void* operator new(std::size_t size) {
+    MemTag tag = memCurrentTag;
+    totalCounters.allocs.fetch_add(1, std::memory_order_relaxed);
+    tagCounters[tag].allocs.fetch_add(1, std::memory_order_relaxed);
+    while (true) {
+        if (unsigned char* block = static_cast<unsigned char*>(std::malloc(size + HEADER_BYTES))) {
+            *reinterpret_cast<uint64_t*>(block) = size;
+            block[sizeof(uint64_t)] = tag;
+            account(tag, (int64_t)size);
+            return block + HEADER_BYTES;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+static void release(void* p) {
+    if (!p) return;
+    unsigned char* block = static_cast<unsigned char*>(p) - HEADER_BYTES;
+    account((MemTag)block[sizeof(uint64_t)], -(int64_t)*reinterpret_cast<uint64_t*>(block));
+    std::free(block);
+}
+
+void operator delete(void* p) noexcept {
+    release(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    release(p);
+}
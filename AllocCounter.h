@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+
+// Counts every allocation made through the global operator new, on any thread.
+// Each allocation costs two relaxed adds to the tag's and the total allocation
+// counts. It also costs a live-bytes add plus a compare-exchange loop on the peak,
+// for both the tag and the total, and the frees add to live bytes again. Those
+// counters are shared by every thread, so allocating threads contend on their
+// cache lines. The benchmarks read the count around each stage to catch
+// per-frame allocations creeping into hot paths. malloc() calls (miniaudio, SDL)
+// are not seen.
+uint64_t alloc_count();
+
+// Subsystems memory is accounted to. An allocation goes to the tag of the
+// innermost MemScope on its thread, and its bytes stay on that tag until freed,
+// whichever thread frees them.
+enum MemTag : uint8_t {
+    MEM_OTHER,
+    MEM_SIMULATION,     // particles, grids, brushes, fragments, spawn queues
+    MEM_FORCES,         // the force pool's per-thread buffers and job lists
+    MEM_RENDER,         // vertex batches, sky, HUD
+    MEM_TEXTURES,       // GPU textures, estimated at 4 bytes a texel
+    MEM_AUDIO,          // synthesized sounds, music analysis
+    MEM_ASSETS,         // the mapped asset pack; file pages, shared between instances
+    MEM_PROFILER,       // per-thread zone rings
+    MEM_TAG_COUNT
+};
+
+const char* const MEM_TAG_NAMES[MEM_TAG_COUNT] = { "other", "simulation", "forces", "render", "textures", "audio", "assets", "profiler" };
+
+struct MemTagStats {
+    int64_t liveBytes;
+    int64_t peakBytes;
+    uint64_t allocs;        // since startup
+};
+
+MemTagStats mem_tag_stats(MemTag tag);
+// Live and peak bytes over every tag.
+MemTagStats mem_total_stats();
+// Starts every peak again from the current live bytes.
+void mem_reset_peaks();
+// Accounts memory that never passes through operator new (GPU textures, mapped
+// files); negative to release it.
+void mem_note(MemTag tag, int64_t bytes);
+// Resident set of the whole process, malloc() and driver memory included; 0 if
+// the platform does not say.
+int64_t process_resident_bytes();
+
+extern thread_local MemTag memCurrentTag;
+
+// Accounts the allocations of its scope to a tag, then restores the outer one.
+class MemScope {
+public:
+    explicit MemScope(MemTag tag) : outer(memCurrentTag) { memCurrentTag = tag; }
+    ~MemScope() { memCurrentTag = outer; }
+    MemScope(const MemScope&) = delete;
+    MemScope& operator=(const MemScope&) = delete;
+private:
+    MemTag outer;
+};
@@ -0,0 +1,289 @@
+#include "AssetPack.h"
+#include "AudioSystem.h"
+#include "AllocCounter.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char PACK_MAGIC[8] = { 'P', 'A', 'R', 'T', 'P', 'A', 'C', 'K' };
+
+static const unsigned char* packBase = nullptr;
+static size_t packSize = 0;
+#ifdef _WIN32
+static HANDLE packFile = INVALID_HANDLE_VALUE;
+static HANDLE packMapping = NULL;
+#endif
+
+static uint64_t fnv1a(uint64_t h, const void* data, size_t n) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < n; ++i) {
+        h ^= p[i];
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+template <typename T>
+static uint64_t fnv1a(uint64_t h, T value) {
+    return fnv1a(h, &value, sizeof(value));
+}
+
+uint64_t asset_params_hash() {
+    uint64_t h = 0xCBF29CE484222325ull;
+    h = fnv1a(h, ASSET_PACK_VERSION);
+    h = fnv1a(h, ASSET_RECIPE_REVISION);
+    h = fnv1a(h, (uint32_t)0x01020304);   // byte order the pack was written in
+    h = fnv1a(h, RAINBOW_LUT_SIZE);
+    h = fnv1a(h, SYNTH_SAMPLE_RATE);
+    for (int i = 0; i < SPRITE_COUNT; ++i) h = fnv1a(h, sprite_size((SpriteId)i));
+    return h;
+}
+
+static void unmap_pack() {
+    if (!packBase) return;
+#ifdef _WIN32
+    UnmapViewOfFile(packBase);
+    if (packMapping) CloseHandle(packMapping);
+    if (packFile != INVALID_HANDLE_VALUE) CloseHandle(packFile);
+    packMapping = NULL;
+    packFile = INVALID_HANDLE_VALUE;
+#else
+    munmap((void*)packBase, packSize);
+#endif
+    mem_note(MEM_ASSETS, -(int64_t)packSize);
+    packBase = nullptr;
+    packSize = 0;
+}
+
+static bool map_pack(const char* path) {
+#ifdef _WIN32
+    packFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (packFile == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(packFile, &size) || size.QuadPart < (LONGLONG)sizeof(AssetPackHeader)) {
+        CloseHandle(packFile);
+        packFile = INVALID_HANDLE_VALUE;
+        return false;
+    }
+    packMapping = CreateFileMappingA(packFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    void* view = packMapping ? MapViewOfFile(packMapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!view) {
+        if (packMapping) CloseHandle(packMapping);
+        CloseHandle(packFile);
+        packMapping = NULL;
+        packFile = INVALID_HANDLE_VALUE;
+        return false;
+    }
+    packBase = static_cast<const unsigned char*>(view);
+    packSize = (size_t)size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(AssetPackHeader)) {
+        close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) return false;
+    packBase = static_cast<const unsigned char*>(view);
+    packSize = (size_t)st.st_size;
+#endif
+    mem_note(MEM_ASSETS, (int64_t)packSize);
+    return true;
+}
+
+static const AssetPackHeader* pack_header() {
+    return reinterpret_cast<const AssetPackHeader*>(packBase);
+}
+
+static const AssetPackEntry* pack_entries() {
+    return reinterpret_cast<const AssetPackEntry*>(packBase + sizeof(AssetPackHeader));
+}
+
+static bool pack_valid() {
+    const AssetPackHeader* hdr = pack_header();
+    if (memcmp(hdr->magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0) return false;
+    if (hdr->version != ASSET_PACK_VERSION || hdr->paramHash != asset_params_hash()) return false;
+    if (hdr->fileSize != packSize) return false;
+
+    size_t tableEnd = sizeof(AssetPackHeader) + (size_t)hdr->count * sizeof(AssetPackEntry);
+    if (tableEnd > packSize) return false;
+    const AssetPackEntry* e = pack_entries();
+    for (uint32_t i = 0; i < hdr->count; ++i) {
+        if (e[i].offset < tableEnd || e[i].offset % ASSET_PACK_ALIGN != 0) return false;
+        if (e[i].size > packSize - e[i].offset) return false;
+    }
+    return true;
+}
+
+bool asset_pack_open(const char* path) {
+    asset_pack_close();
+    if (!map_pack(path)) return false;
+    if (!pack_valid()) {
+        unmap_pack();
+        return false;
+    }
+    return true;
+}
+
+void asset_pack_close() {
+    unmap_pack();
+}
+
+bool asset_pack_is_open() {
+    return packBase != nullptr;
+}
+
+const void* asset_pack_find(uint32_t id, size_t* size) {
+    if (!packBase) return nullptr;
+    const AssetPackHeader* hdr = pack_header();
+    const AssetPackEntry* e = pack_entries();
+    for (uint32_t i = 0; i < hdr->count; ++i) {
+        if (e[i].id != id) continue;
+        if (size) *size = (size_t)e[i].size;
+        return packBase + e[i].offset;
+    }
+    return nullptr;
+}
+
+const Uint32* asset_pack_sprite(SpriteId id) {
+    size_t size = 0;
+    const void* data = asset_pack_find(ASSET_SPRITE_FIRST + id, &size);
+    size_t want = (size_t)sprite_size(id) * sprite_size(id) * sizeof(Uint32);
+    if (!data || size != want) return nullptr;
+    return static_cast<const Uint32*>(data);
+}
+
+struct BakeItem {
+    uint32_t id;
+    const void* data;
+    size_t size;
+};
+
+static bool write_pack(const char* path, const std::vector<BakeItem>& items) {
+    std::vector<AssetPackEntry> table(items.size());
+    size_t offset = sizeof(AssetPackHeader) + items.size() * sizeof(AssetPackEntry);
+    for (size_t i = 0; i < items.size(); ++i) {
+        offset = (offset + ASSET_PACK_ALIGN - 1) & ~(ASSET_PACK_ALIGN - 1);
+        table[i].id = items[i].id;
+        table[i].reserved = 0;
+        table[i].offset = offset;
+        table[i].size = items[i].size;
+        offset += items[i].size;
+    }
+
+    AssetPackHeader hdr;
+    memcpy(hdr.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+    hdr.version = ASSET_PACK_VERSION;
+    hdr.count = (uint32_t)items.size();
+    hdr.paramHash = asset_params_hash();
+    hdr.fileSize = offset;
+
+    // Per-process temporary name: several instances may bake at the same time.
+#ifdef _WIN32
+    std::string tmp = std::string(path) + "." + std::to_string(GetCurrentProcessId()) + ".tmp";
+#else
+    std::string tmp = std::string(path) + "." + std::to_string(getpid()) + ".tmp";
+#endif
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    if (ok && !table.empty()) ok = fwrite(table.data(), sizeof(AssetPackEntry), table.size(), f) == table.size();
+    static const unsigned char zeros[ASSET_PACK_ALIGN] = {};
+    size_t written = sizeof(AssetPackHeader) + table.size() * sizeof(AssetPackEntry);
+    for (size_t i = 0; ok && i < items.size(); ++i) {
+        size_t pad = (size_t)table[i].offset - written;
+        if (pad) ok = fwrite(zeros, 1, pad, f) == pad;
+        if (ok && items[i].size) ok = fwrite(items[i].data, 1, items[i].size, f) == items[i].size;
+        written = (size_t)table[i].offset + items[i].size;
+    }
+    if (fclose(f) != 0) ok = false;
+    if (!ok) {
+        remove(tmp.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    ok = MoveFileExA(tmp.c_str(), path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    ok = rename(tmp.c_str(), path) == 0;
+#endif
+    if (!ok) remove(tmp.c_str());
+    return ok;
+}
+
+bool asset_pack_bake(const char* path) {
+    generateRainbowLUT();
+    synthesize_all_sounds();
+
+    std::vector<std::vector<Uint32>> sprites(SPRITE_COUNT);
+    for (int i = 0; i < SPRITE_COUNT; ++i) sprites[i] = generate_sprite_pixels((SpriteId)i);
+
+    std::vector<BakeItem> items;
+    for (int i = 0; i < SPRITE_COUNT; ++i) {
+        items.push_back({ ASSET_SPRITE_FIRST + (uint32_t)i, sprites[i].data(), sprites[i].size() * sizeof(Uint32) });
+    }
+    items.push_back({ ASSET_SOUND_BLUE, blueSound.samples.data(), blueSound.samples.size() * sizeof(float) });
+    items.push_back({ ASSET_SOUND_RAINBOW, rainbowSound.samples.data(), rainbowSound.samples.size() * sizeof(float) });
+    items.push_back({ ASSET_SOUND_EXPLOSION, explosionSound.samples.data(), explosionSound.samples.size() * sizeof(float) });
+    items.push_back({ ASSET_RAINBOW_LUT, rainbowColorLUT.data(), rainbowColorLUT.size() * sizeof(SDL_Color) });
+
+    return write_pack(path, items);
+}
+
+static bool bind_sound(SynthSound& snd, uint32_t id) {
+    size_t size = 0;
+    const void* data = asset_pack_find(id, &size);
+    if (!data || size == 0 || size % sizeof(float) != 0) return false;
+    snd.samples.clear();
+    snd.samples.shrink_to_fit();
+    snd.data = static_cast<const float*>(data);
+    snd.length = (int)(size / sizeof(float));
+    return true;
+}
+
+static bool bind_pack() {
+    size_t size = 0;
+    const void* lut = asset_pack_find(ASSET_RAINBOW_LUT, &size);
+    if (!lut || size != rainbowColorLUT.size() * sizeof(SDL_Color)) return false;
+    for (int i = 0; i < SPRITE_COUNT; ++i) {
+        if (!asset_pack_sprite((SpriteId)i)) return false;
+    }
+    if (!asset_pack_find(ASSET_SOUND_BLUE) || !asset_pack_find(ASSET_SOUND_RAINBOW) || !asset_pack_find(ASSET_SOUND_EXPLOSION)) return false;
+
+    memcpy(rainbowColorLUT.data(), lut, size);
+    return bind_sound(blueSound, ASSET_SOUND_BLUE)
+        && bind_sound(rainbowSound, ASSET_SOUND_RAINBOW)
+        && bind_sound(explosionSound, ASSET_SOUND_EXPLOSION);
+}
+
+bool load_startup_assets(const char* path) {
+    if (asset_pack_open(path) && bind_pack()) return true;
+
+    // Missing or stale: bake, then use the fresh pack like any other start.
+    asset_pack_close();
+    printf("Baking asset pack %s.\n", path);
+    if (asset_pack_bake(path) && asset_pack_open(path) && bind_pack()) return true;
+
+    printf("Asset pack unavailable; generating assets in memory.\n");
+    asset_pack_close();
+    generateRainbowLUT();
+    synthesize_all_sounds();
+    return false;
+}
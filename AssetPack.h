@@ -0,0 +1,61 @@
+#pragma once
+#include "GameConfig.h"
+#include "Render.h"
+#include <cstdint>
+#include <cstddef>
+
+// Everything the game otherwise generates at startup (synthesized sounds, sprite
+// pixels, the rainbow LUT) baked into one versioned binary file. The file is
+// memory-mapped and used in place: the mixer plays straight from the mapping and
+// sprites are uploaded to SDL from it. A pack whose parameter hash does not match
+// this build is rebaked.
+//
+// Layout: AssetPackHeader, then `count` AssetPackEntry records, then the payloads,
+// each aligned to ASSET_PACK_ALIGN bytes.
+const uint32_t ASSET_PACK_VERSION = 1;
+// Bump whenever a sound, sprite or LUT generator changes its output.
+const uint32_t ASSET_RECIPE_REVISION = 2;
+const size_t ASSET_PACK_ALIGN = 64;
+
+enum AssetId : uint32_t {
+    ASSET_SPRITE_FIRST = 0,   // + SpriteId
+    ASSET_SOUND_BLUE = 100,
+    ASSET_SOUND_RAINBOW = 101,
+    ASSET_SOUND_EXPLOSION = 102,
+    ASSET_RAINBOW_LUT = 200
+};
+
+struct AssetPackHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t paramHash;
+    uint64_t fileSize;
+};
+
+struct AssetPackEntry {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Hash of everything that shapes the baked data.
+uint64_t asset_params_hash();
+
+// Maps the pack; false if it is missing, truncated or baked with other parameters.
+bool asset_pack_open(const char* path);
+void asset_pack_close();
+bool asset_pack_is_open();
+// Payload of an entry in the open pack, or nullptr.
+const void* asset_pack_find(uint32_t id, size_t* size = nullptr);
+const Uint32* asset_pack_sprite(SpriteId id);
+
+// Generates every asset and writes the pack (through a temporary file, so a
+// concurrent reader never sees a partial one).
+bool asset_pack_bake(const char* path);
+
+// Startup entry point: maps the pack, rebaking it first if it is stale, then binds
+// the sounds and the LUT to it. Falls back to generating in memory if the pack can
+// neither be read nor written. Returns true when the assets came from the pack.
+bool load_startup_assets(const char* path);
@@ -1,5 +1,12 @@
 #include "GameConfig.h"
+#include "AudioSystem.h"
+#include "Profiler.h"
+#include "AllocCounter.h"
 #include <random>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
 #undef min
 #undef max
 
@@ -7,6 +14,60 @@ float saturate_soft(float x) {
     return tanhf(x);
 }
 
+const int OSC_BLOCK = 8;
+
+// Sine oscillator kept as a rotating unit phasor: one complex multiply per sample
+// instead of a sinf. Each of the OSC_BLOCK lanes holds a consecutive sample and all
+// lanes rotate by OSC_BLOCK steps at once, so advance() has no loop-carried
+// dependency and vectorizes.
+struct Oscillator {
+    float re[OSC_BLOCK], im[OSC_BLOCK];
+    float stepRe, stepIm;
+
+    Oscillator(double freq, double phase, int rate) {
+        double w = 6.283185307179586 * freq / rate;
+        for (int j = 0; j < OSC_BLOCK; ++j) {
+            re[j] = (float)std::cos(phase + w * j);
+            im[j] = (float)std::sin(phase + w * j);
+        }
+        stepRe = (float)std::cos(w * OSC_BLOCK);
+        stepIm = (float)std::sin(w * OSC_BLOCK);
+    }
+
+    // Retunes from the current block on without a phase jump: lane 0 keeps its
+    // phase and the other lanes are spread out from it at the new step.
+    void set_frequency(double freq, int rate) {
+        double w = 6.283185307179586 * freq / rate;
+        float dRe = (float)std::cos(w), dIm = (float)std::sin(w);
+        for (int j = 1; j < OSC_BLOCK; ++j) {
+            re[j] = re[j - 1] * dRe - im[j - 1] * dIm;
+            im[j] = re[j - 1] * dIm + im[j - 1] * dRe;
+        }
+        stepRe = (float)std::cos(w * OSC_BLOCK);
+        stepIm = (float)std::sin(w * OSC_BLOCK);
+    }
+
+    void advance() {
+        for (int j = 0; j < OSC_BLOCK; ++j) {
+            float r = re[j] * stepRe - im[j] * stepIm;
+            float i = re[j] * stepIm + im[j] * stepRe;
+            // First-order renormalisation keeps |z| at 1 against rounding drift.
+            float g = 1.5f - 0.5f * (r * r + i * i);
+            re[j] = r * g;
+            im[j] = i * g;
+        }
+    }
+};
+
+// sin and cos of a phase offset |x| <= 1.5 from their Taylor series, within 3e-6 of
+// the library; used to phase-modulate an Oscillator: sin(theta + x) is
+// im * cos(x) + re * sin(x).
+static void sin_cos_small(float x, float& s, float& c) {
+    float x2 = x * x;
+    s = x * (1.0f - x2 / 6.0f * (1.0f - x2 / 20.0f * (1.0f - x2 / 42.0f * (1.0f - x2 / 72.0f * (1.0f - x2 / 110.0f)))));
+    c = 1.0f - x2 / 2.0f * (1.0f - x2 / 12.0f * (1.0f - x2 / 30.0f * (1.0f - x2 / 56.0f * (1.0f - x2 / 90.0f))));
+}
+
 void normalizeSamples(std::vector<float>& samples, float targetPeak) {
     float max_amp = 0.0f;
     for (float s : samples) max_amp = std::max(max_amp, std::fabs(s));
@@ -16,85 +77,282 @@ void normalizeSamples(std::vector<float>& samples, float targetPeak) {
     for (auto& s : samples) s *= g;
 }
 
-void mixSynthSound(SynthSound& snd, float& v) {
-    if (!snd.playing) return;
+// Bounded multi-producer / single-consumer ring of play requests. Any game thread
+// may push; only the audio callback pops. Each slot's sequence number says whose
+// turn it is, so neither side ever takes a lock. A full ring drops the request.
+class TriggerQueue {
+public:
+    TriggerQueue() {
+        for (unsigned i = 0; i < TRIGGER_QUEUE_SIZE; ++i) slots[i].seq.store(i, std::memory_order_relaxed);
+    }
 
-    for (int& pos : snd.playheads) {
-        if (pos < static_cast<int>(snd.samples.size())) {
-            v += snd.samples[pos++];
+    bool push(SynthSound* snd, int64_t stamp) {
+        unsigned pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[pos & (TRIGGER_QUEUE_SIZE - 1)];
+            int diff = (int)(slot.seq.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.snd = snd;
+                    slot.stamp = stamp;
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = head.load(std::memory_order_relaxed);
+            }
         }
     }
 
-    snd.playheads.erase(
-        std::remove_if(snd.playheads.begin(), snd.playheads.end(),
-                       [&](int pos) { return pos >= static_cast<int>(snd.samples.size()); }),
-        snd.playheads.end()
-    );
+    bool pop(SynthSound*& snd, int64_t& stamp) {
+        Slot& slot = slots[tail & (TRIGGER_QUEUE_SIZE - 1)];
+        if ((int)(slot.seq.load(std::memory_order_acquire) - (tail + 1)) < 0) return false;
+        snd = slot.snd;
+        stamp = slot.stamp;
+        slot.seq.store(tail + TRIGGER_QUEUE_SIZE, std::memory_order_release);
+        tail++;
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::atomic<unsigned> seq;
+        SynthSound* snd = nullptr;
+        int64_t stamp = 0;
+    };
 
-    if (snd.playheads.empty()) {
-        snd.playing = false;
+    Slot slots[TRIGGER_QUEUE_SIZE];
+    std::atomic<unsigned> head{ 0 };
+    unsigned tail = 0;
+};
+
+struct Voice {
+    const SynthSound* snd = nullptr;
+    int pos = 0;
+};
+
+static TriggerQueue triggers;
+// Owned by the audio thread. Fixed size so starting a voice never allocates.
+static Voice voices[MAX_VOICES];
+
+// With every voice busy the one furthest through its sound is cut, since it is
+// the quietest of the decaying one-shots.
+static void start_voice(const SynthSound* snd) {
+    Voice* slot = &voices[0];
+    for (Voice& v : voices) {
+        if (!v.snd) { slot = &v; break; }
+        if (v.pos > slot->pos) slot = &v;
     }
+    slot->snd = snd;
+    slot->pos = 0;
 }
-void request_play(SynthSound& snd) {
-    std::lock_guard<std::mutex> lock(sounds_to_play_mutex); 
-    if (sounds_to_play.size() > 100) return;
-    sounds_to_play.push_back(&snd);
+
+// Adds every playing voice into out[0..n) a block at a time; finished voices are
+// retired once per block rather than once per sample.
+static void mix_voices(float* out, int n) {
+    for (Voice& v : voices) {
+        if (!v.snd) continue;
+        const int len = v.snd->length;
+        int count = std::min(n, len - v.pos);
+        const float* in = v.snd->data + v.pos;
+        for (int i = 0; i < count; ++i) out[i] += in[i];
+        v.pos += count;
+        if (v.pos >= len) v.snd = nullptr;
+    }
 }
 
-void audio_callback(void* userdata, Uint8* stream, int len) {
-    float* fstream = reinterpret_cast<float*>(stream);
-    int samples = len / sizeof(float);
+// Trigger-to-mix latency: from request_play to the callback that mixes the sound's
+// first sample. Written only by the audio thread, read after the device is closed.
+const int LATENCY_BUCKETS = 100;
+const double LATENCY_BUCKET_MS = 0.5;
+static int latencyHistogram[LATENCY_BUCKETS + 1];
+static int latencyCount = 0;
+static double latencySumMs = 0.0, latencyMaxMs = 0.0;
+static double deviceBufferMs = 0.0;
+
+static int64_t audio_clock_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-    {
-        std::lock_guard<std::mutex> lock(sounds_to_play_mutex);
-        for (auto* sound : sounds_to_play) {
-            sound->playheads.push_back(0);
-            sound->playing = true;
+static void record_latency(double ms) {
+    int bucket = (int)(ms / LATENCY_BUCKET_MS);
+    if (bucket > LATENCY_BUCKETS) bucket = LATENCY_BUCKETS;
+    if (bucket < 0) bucket = 0;
+    latencyHistogram[bucket]++;
+    latencyCount++;
+    latencySumMs += ms;
+    if (ms > latencyMaxMs) latencyMaxMs = ms;
+}
+
+void set_audio_buffer_frames(int frames, int rate) {
+    deviceBufferMs = rate > 0 ? 1000.0 * frames / rate : 0.0;
+}
+
+static double latency_percentile(double p) {
+    int target = (int)std::ceil(p * latencyCount);
+    int seen = 0;
+    for (int b = 0; b <= LATENCY_BUCKETS; ++b) {
+        seen += latencyHistogram[b];
+        if (seen >= target) return (b + 1) * LATENCY_BUCKET_MS;
+    }
+    return LATENCY_BUCKETS * LATENCY_BUCKET_MS;
+}
+
+// The block mixed in a callback starts playing once the device has drained the
+// buffer ahead of it, so output latency is estimated as mix latency plus one buffer.
+void report_audio_latency(FILE* out) {
+    if (latencyCount == 0) {
+        fprintf(out, "audio latency: no sounds triggered\n");
+        return;
+    }
+
+    double mean = latencySumMs / latencyCount;
+    fprintf(out, "audio latency over %d triggers (device buffer %.1f ms)\n", latencyCount, deviceBufferMs);
+    fprintf(out, "  trigger->mix     mean %.2f  p50 <%.1f  p95 <%.1f  p99 <%.1f  max %.2f ms\n",
+        mean, latency_percentile(0.5), latency_percentile(0.95), latency_percentile(0.99), latencyMaxMs);
+    fprintf(out, "  trigger->output  mean %.2f  p99 <%.1f ms (estimated)\n", mean + deviceBufferMs, latency_percentile(0.99) + deviceBufferMs);
+
+    int peak = 1;
+    for (int b = 0; b <= LATENCY_BUCKETS; ++b) peak = std::max(peak, latencyHistogram[b]);
+    for (int b = 0; b <= LATENCY_BUCKETS; ++b) {
+        if (latencyHistogram[b] == 0) continue;
+        int bar = latencyHistogram[b] * 50 / peak;
+        if (b == LATENCY_BUCKETS) fprintf(out, "  >=%5.1f ms %6d ", b * LATENCY_BUCKET_MS, latencyHistogram[b]);
+        else fprintf(out, "  %5.1f-%-4.1f %6d ", b * LATENCY_BUCKET_MS, (b + 1) * LATENCY_BUCKET_MS, latencyHistogram[b]);
+        for (int i = 0; i < bar; ++i) fputc('#', out);
+        fputc('\n', out);
+    }
+}
+
+void request_play(SynthSound& snd) {
+    triggers.push(&snd, audio_clock_ns());
+}
+
+struct AudioEvents : SimEvents {
+    void on_sound(SimSound sound) override {
+        switch (sound) {
+        case SIM_SOUND_BLUE: request_play(blueSound); break;
+        case SIM_SOUND_RAINBOW: request_play(rainbowSound); break;
+        case SIM_SOUND_EXPLOSION: request_play(explosionSound); break;
         }
-        sounds_to_play.clear();
     }
+};
+
+SimEvents* audio_events() {
+    static AudioEvents events;
+    return &events;
+}
+
+// Made on the main thread by prepare_audio_profiling(); the audio thread records
+// into it without locking or allocating, and drops its zones while it is null.
+static std::atomic<ThreadRing*> audioProfileRing{ nullptr };
+
+void prepare_audio_profiling() {
+#if PROFILER_ENABLED
+    if (!audioProfileRing.load(std::memory_order_relaxed)) audioProfileRing.store(profiler_make_ring("audio"), std::memory_order_release);
+#endif
+}
+
+// Starts newly triggered voices and renders `samples` mono samples of the effect
+// mix into out. Called from whichever audio thread owns the effects.
+static void render_effects(float* out, int samples) {
+    PROFILE_RING(audioProfileRing.load(std::memory_order_acquire));
+    PROFILE_ZONE("audio_callback");
+    SynthSound* triggered;
+    int64_t stamp;
+    int64_t now = audio_clock_ns();
+    while (triggers.pop(triggered, stamp)) {
+        start_voice(triggered);
+        record_latency((now - stamp) * 1e-6);
+    }
+
+    std::fill(out, out + samples, 0.0f);
+    mix_voices(out, samples);
+
     float localEnergySum = 0.0f;
     for (int i = 0; i < samples; ++i) {
-        float v = 0.0f;
-        mixSynthSound(blueSound, v);
-        mixSynthSound(rainbowSound, v);
-        mixSynthSound(explosionSound, v);
+        float v = out[i];
         localEnergySum += std::abs(v);
         v = std::max(-1.0f, std::min(1.0f, v));
-        fstream[i] = v * SYNTH_MASTER_GAIN;
+        out[i] = v * SYNTH_MASTER_GAIN;
     }
     float avg = localEnergySum / samples;
     currentMusicEnergy = currentMusicEnergy * 0.9f + avg * 5.0f * 0.1f;
 }
 
+void audio_callback(void* userdata, Uint8* stream, int len) {
+    render_effects(reinterpret_cast<float*>(stream), len / sizeof(float));
+}
+
+// The effect mix as a source node in miniaudio's graph, so the engine that plays
+// the music also mixes the effects on its one audio thread.
+struct EffectsNode {
+    ma_node_base base;
+};
+
+static EffectsNode effectsNode;
+static bool effectsNodeReady = false;
+const int EFFECTS_CHUNK = 512;
+
+static void effects_node_process(ma_node* node, const float** framesIn, ma_uint32* frameCountIn, float** framesOut, ma_uint32* frameCountOut) {
+    float mono[EFFECTS_CHUNK];
+    ma_uint32 channels = ma_node_get_output_channels(node, 0);
+    ma_uint32 total = *frameCountOut;
+    float* out = framesOut[0];
+
+    for (ma_uint32 done = 0; done < total; ) {
+        int n = (int)std::min<ma_uint32>(EFFECTS_CHUNK, total - done);
+        render_effects(mono, n);
+        for (int i = 0; i < n; ++i) {
+            for (ma_uint32 c = 0; c < channels; ++c) *out++ = mono[i];
+        }
+        done += n;
+    }
+}
+
+static ma_node_vtable effects_node_vtable = {
+    effects_node_process,
+    NULL,   // onGetRequiredInputFrameCount
+    0,      // no input buses
+    1,      // one output bus
+    0
+};
+
+bool attach_effects_to_engine(ma_engine* engine) {
+    if (effectsNodeReady) return true;
+    ma_uint32 channels = ma_engine_get_channels(engine);
+    ma_node_config config = ma_node_config_init();
+    config.vtable = &effects_node_vtable;
+    config.pOutputChannels = &channels;
+    if (ma_node_init(ma_engine_get_node_graph(engine), &config, NULL, &effectsNode) != MA_SUCCESS) return false;
+    if (ma_node_attach_output_bus(&effectsNode, 0, ma_engine_get_endpoint(engine), 0) != MA_SUCCESS) {
+        ma_node_uninit(&effectsNode, NULL);
+        return false;
+    }
+    effectsNodeReady = true;
+    return true;
+}
+
+void detach_effects_from_engine() {
+    if (!effectsNodeReady) return;
+    ma_node_uninit(&effectsNode, NULL);
+    effectsNodeReady = false;
+}
+
 void make_rainbow_sound(SynthSound& snd) {
     snd.samples.clear();
-    snd.playheads.clear();
-    snd.playing = false;
 
-    const int rate = 44100;
+    const int rate = SYNTH_SAMPLE_RATE;
     const float duration = 1.25f;
     const int N = int(rate * duration);
     snd.samples.assign(N, 0.0f);
 
-    const float PI = 3.14159265358979323846f;
     const float TAU = 6.28318530717958647692f;
 
-    auto ar_env = [&](float t, float a, float r)->float {
-        if (t < a) {
-            float k = t / a;
-            return 0.5f - 0.5f * cosf(PI * k);
-        } else {
-            float u = (t - a);
-            return expf(-u / r);
-        }
-    };
-
-    auto gauss01 = [&](float x, float mu, float sigma)->float {
-        float d = (x - mu) / (sigma + 1e-12f);
-        return expf(-0.5f * d * d);
-    };
-
     {
         std::minstd_rand rng(42);
         std::uniform_real_distribution<float> uni(0.0f, 1.0f);
@@ -111,18 +369,49 @@ void make_rainbow_sound(SynthSound& snd) {
             lfoPhase[i] = uni(rng) * TAU;
         }
 
-        for (int i = 0; i < N; ++i) {
-            float t = float(i) / rate;
-            float env = ar_env(t, 0.16f, 0.9f);
-            float s = 0.0f;
+        std::vector<Oscillator> carrier, lfo, pmod;
+        for (int k = 0; k < 6; ++k) {
+            carrier.emplace_back(base * ratios[k], 0.0, rate);
+            lfo.emplace_back(0.05f + 0.007f * k, lfoPhase[k], rate);
+            pmod.emplace_back(0.21f + 0.013f * k, phases[k], rate);
+        }
+
+        // Raised-cosine attack read off a half-turn phasor, then an exponential
+        // release kept as a running product.
+        const float attack = 0.16f, release = 0.9f;
+        const int attackEnd = (int)std::ceil(attack * rate);
+        Oscillator attackOsc(0.5 / attack, 0.0, rate);
+        float releaseEnv = expf(-(attackEnd / (float)rate - attack) / release);
+        const float releaseStep = (float)std::exp(-1.0 / (release * rate));
+
+        for (int i0 = 0; i0 < N; i0 += OSC_BLOCK) {
+            float acc[OSC_BLOCK] = {};
 
             for (int k = 0; k < 6; ++k) {
-                float f = base * ratios[k];
-                float lfo = 0.75f + 0.25f * sinf(TAU * (0.05f + 0.007f * k) * t + lfoPhase[k]);
-                float pm = 0.0023f * sinf(TAU * (0.21f + 0.013f * k) * t + phases[k]);
-                s += sinf(TAU * f * t + pm) * amps[k] * lfo;
+                // sin(theta + pm) expanded around the carrier phasor; pm stays below
+                // 0.0023 rad so cos(pm) ~ 1 - pm^2/2 and sin(pm) ~ pm are exact in float.
+                for (int j = 0; j < OSC_BLOCK; ++j) {
+                    float l = 0.75f + 0.25f * lfo[k].im[j];
+                    float pm = 0.0023f * pmod[k].im[j];
+                    float s = carrier[k].im[j] * (1.0f - 0.5f * pm * pm) + carrier[k].re[j] * pm;
+                    acc[j] += s * amps[k] * l;
+                }
+                carrier[k].advance();
+                lfo[k].advance();
+                pmod[k].advance();
             }
-            snd.samples[i] += s * env * 0.45f;
+
+            for (int j = 0; j < OSC_BLOCK && i0 + j < N; ++j) {
+                float env;
+                if (i0 + j < attackEnd) {
+                    env = 0.5f - 0.5f * attackOsc.re[j];
+                } else {
+                    env = releaseEnv;
+                    releaseEnv *= releaseStep;
+                }
+                snd.samples[i0 + j] += acc[j] * env * 0.45f;
+            }
+            attackOsc.advance();
         }
     }
 
@@ -166,14 +455,33 @@ void make_rainbow_sound(SynthSound& snd) {
         }
 
         for (const auto& ch : chirps) {
-            float phi = 0.0f;
-            for (int j = 0; j < ch.len && (ch.start + j) < N; ++j) {
-                float u = float(j) / (float)ch.len;
-                float f = ch.f0 * powf(ch.f1 / ch.f0, u);
-                phi += TAU * f / rate;
-
-                float w = gauss01(u, 0.5f, 0.22f);
-                snd.samples[ch.start + j] += sinf(phi) * w * ch.amp * 0.6f;
+            int len = std::min(ch.len, N - ch.start);
+            // Exponential sweep: the frequency grows by a fixed ratio per sample and
+            // sample j sits f_1 + ... + f_j past the start. The phasor is retuned once
+            // a block to the mean step into the next block's first sample.
+            double sweep = std::pow((double)ch.f1 / ch.f0, 1.0 / ch.len);
+            double blockSweep = std::pow(sweep, OSC_BLOCK);
+            double f = ch.f0 * std::pow(sweep, 0.5 * (OSC_BLOCK + 1));
+            Oscillator osc(f, TAU * ch.f0 / rate, rate);
+
+            // Gaussian window exp(-d^2 / 2) with d linear in j, as a running product:
+            // the ratio between neighbouring samples itself shrinks by exp(-a^2).
+            // Kept in double; the product runs over thousands of samples.
+            const double sigma = 0.22;
+            double a = 1.0 / (ch.len * sigma), b = -0.5 / sigma;
+            double g = std::exp(-0.5 * b * b);
+            double r = std::exp(-a * b - 0.5 * a * a);
+            const double q = std::exp(-a * a);
+
+            for (int j0 = 0; j0 < len; j0 += OSC_BLOCK) {
+                if (j0 > 0) osc.set_frequency(f, rate);
+                for (int j = 0; j < OSC_BLOCK && j0 + j < len; ++j) {
+                    snd.samples[ch.start + j0 + j] += osc.im[j] * (float)g * ch.amp * 0.6f;
+                    g *= r;
+                    r *= q;
+                }
+                osc.advance();
+                f *= blockSweep;
             }
         }
     }
@@ -238,85 +546,121 @@ void make_rainbow_sound(SynthSound& snd) {
     }
 
 	normalizeSamples(snd.samples, 0.55f);
+    snd.bind_samples();
 }
 
 void make_stellar_explosion_sound(SynthSound& snd) {
     snd.samples.clear();
-    snd.playheads.clear();
-    snd.playing = false;
 
-    const int rate = 44100;
+    const int rate = SYNTH_SAMPLE_RATE;
     const float duration = 1.8f;
     const int N = int(rate * duration);
     snd.samples.assign(N, 0.0f);
 
     const float TAU = 6.2831853f;
+    std::minstd_rand rng(1234);
+    std::uniform_real_distribution<float> uni(-1.0f, 1.0f);
+
+    // The boom's phase is 180 t e^(-6t) cycles, so its phasor is retuned each block
+    // to the derivative, 180 e^(-6t) (1 - 6t), halfway to the next block. The rumble is a
+    // 50 Hz phasor phase-modulated by sin(10 t). Every amplitude envelope is an
+    // exponential decay kept as a running product.
+    Oscillator boomOsc(0.0, 0.0, rate), rumbleOsc(50.0, 0.0, rate), wobble(10.0 / TAU, 0.0, rate);
+    const double mid = 0.5 * OSC_BLOCK / rate;
+    double pitchEnv = std::exp(-6.0 * mid);
+    const double pitchStep = std::exp(-6.0 * OSC_BLOCK / rate);
 
-    for (int i = 0; i < N; ++i) {
-        float t = float(i) / rate;
+    float boomEnv = 1.0f, noiseEnv = 1.0f, rumbleEnv = 0.3f;
+    const float boomDecay = (float)std::exp(-2.5 / rate);
+    const float noiseDecay = (float)std::exp(-15.0 / rate);
+    const float rumbleDecay = (float)std::exp(-1.0 / rate);
 
-        float freqEnv = expf(-t * 6.0f); 
-        float f = 180.0f * freqEnv; 
-        float phase = TAU * f * t; 
-        float boom = sinf(phase) * expf(-t * 2.5f);
+    for (int i0 = 0; i0 < N; i0 += OSC_BLOCK) {
+        double tm = (double)i0 / rate + mid;
+        boomOsc.set_frequency(180.0 * pitchEnv * (1.0 - 6.0 * tm), rate);
+        pitchEnv *= pitchStep;
 
-        float noise = ((float)rand() / RAND_MAX - 0.5f) * 2.0f;
-        float noiseEnv = expf(-t * 15.0f);
-        float crackle = noise * noiseEnv;
+        for (int j = 0; j < OSC_BLOCK && i0 + j < N; ++j) {
+            float boom = boomOsc.im[j] * boomEnv;
 
-        float rumble = sinf(t * 50.0f * TAU + sinf(t * 10.0f)) * 0.3f * expf(-t * 1.0f);
+            float noise = uni(rng);
+            float crackle = noise * noiseEnv;
 
-        float signal = (boom * 2.0f + crackle * 0.8f + rumble * 0.5f);
+            float s, c;
+            sin_cos_small(wobble.im[j], s, c);
+            float rumble = (rumbleOsc.im[j] * c + rumbleOsc.re[j] * s) * rumbleEnv;
 
-        signal = tanhf(signal * 1.5f); 
+            float signal = (boom * 2.0f + crackle * 0.8f + rumble * 0.5f);
 
-        snd.samples[i] = signal;
+            snd.samples[i0 + j] = tanhf(signal * 1.5f);
+
+            boomEnv *= boomDecay;
+            noiseEnv *= noiseDecay;
+            rumbleEnv *= rumbleDecay;
+        }
+        boomOsc.advance();
+        rumbleOsc.advance();
+        wobble.advance();
     }
 
     normalizeSamples(snd.samples, 0.85f);
+    snd.bind_samples();
 }
 
 void make_blue_sound(SynthSound& snd) {
     snd.samples.clear();
-    snd.playheads.clear();
-    snd.playing = false;
 
-    const int rate = 44100;
+    const int rate = SYNTH_SAMPLE_RATE;
 
     const float duration = 0.85f;
     const int N = int(rate * duration);
     snd.samples.assign(N, 0.0f);
 
-    const float PI = 3.14159265358979323846f;
     const float TAU = 6.28318530717958647692f;
 
-    float baseFreq = 320.0f; 
+    float baseFreq = 320.0f;
+    std::minstd_rand rng(4321);
+    std::uniform_real_distribution<float> uni(-0.5f, 0.5f);
 
-    float phase = 0.0f;
-    float fmPhase = 0.0f;
+    // Carrier and modulator are phasors retuned each block to the mean pitch of the
+    // steps into the next block. The pitch drop, the FM depth and both amplitude envelopes are
+    // exponential decays kept as running products.
+    const double mid = 0.5 * (OSC_BLOCK + 1) / rate;
+    double pitchEnv = 0.8 * std::exp(-18.0 * mid);
+    const double pitchStep = std::exp(-18.0 * OSC_BLOCK / rate);
+    const double startFreq = baseFreq * 1.8;
+    Oscillator carrier(0.0, TAU * startFreq / rate, rate);
+    Oscillator modulator(0.0, TAU * startFreq * 1.618 / rate, rate);
 
-    for (int i = 0; i < N; ++i) {
-        float t = float(i) / rate;
-        
-        float pitchMod = 1.0f + 0.8f * expf(-t * 18.0f);
-        
-        float currentFreq = baseFreq * pitchMod;
-        
-        phase += (TAU * currentFreq) / rate;
+    float decay = 1.0f, sparkleEnv = 0.1f;
+    const float decayStep = (float)std::exp(-8.0 / rate);
+    const float sparkleStep = (float)std::exp(-30.0 / rate);
 
-        float fmFreq = currentFreq * 1.618f; 
-        fmPhase += (TAU * fmFreq) / rate;
+    for (int i0 = 0; i0 < N; i0 += OSC_BLOCK) {
+        double currentFreq = baseFreq * (1.0 + pitchEnv);
+        carrier.set_frequency(currentFreq, rate);
+        modulator.set_frequency(currentFreq * 1.618, rate);
+        pitchEnv *= pitchStep;
 
-        float fmIndex = 1.5f * expf(-t * 8.0f);
-        float modulator = sinf(fmPhase);
-        
-        float sample = sinf(phase + modulator * fmIndex);
+        for (int j = 0; j < OSC_BLOCK && i0 + j < N; ++j) {
+            float t = float(i0 + j) / rate;
 
-        float ampEnv = (t * 15.0f) * expf(-t * 8.0f); 
-        
-        float sparkle = ((float)rand() / RAND_MAX - 0.5f) * 0.1f * expf(-t * 30.0f);
+            float fmIndex = 1.5f * decay;
+            float s, c;
+            sin_cos_small(modulator.im[j] * fmIndex, s, c);
+            float sample = carrier.im[j] * c + carrier.re[j] * s;
 
-        snd.samples[i] = (sample + sparkle) * ampEnv;
+            float ampEnv = (t * 15.0f) * decay;
+
+            float sparkle = uni(rng) * sparkleEnv;
+
+            snd.samples[i0 + j] = (sample + sparkle) * ampEnv;
+
+            decay *= decayStep;
+            sparkleEnv *= sparkleStep;
+        }
+        carrier.advance();
+        modulator.advance();
     }
 
     int delaySamples = int(rate * 0.12f);
@@ -327,5 +671,47 @@ void make_blue_sound(SynthSound& snd) {
     }
 
     normalizeSamples(snd.samples, 0.65f);
+    snd.bind_samples();
+}
+
+// The three generators share nothing, so each gets its own thread; the rainbow
+// sound is the longest and sets the wall time.
+void synthesize_all_sounds() {
+    MemScope mem(MEM_AUDIO);
+    std::thread rainbow([] { MemScope mem(MEM_AUDIO); make_rainbow_sound(rainbowSound); });
+    std::thread explosion([] { MemScope mem(MEM_AUDIO); make_stellar_explosion_sound(explosionSound); });
+    make_blue_sound(blueSound);
+    rainbow.join();
+    explosion.join();
 }
 
+void benchmark_sound_synthesis(FILE* out) {
+    using clock = std::chrono::steady_clock;
+    const int RUNS = 5;
+    double best[4] = { 1e30, 1e30, 1e30, 1e30 };
+    const char* names[4] = { "rainbow", "explosion", "blue", "all, concurrent" };
+
+    for (int r = 0; r < RUNS; ++r) {
+        auto t0 = clock::now();
+        make_rainbow_sound(rainbowSound);
+        auto t1 = clock::now();
+        make_stellar_explosion_sound(explosionSound);
+        auto t2 = clock::now();
+        make_blue_sound(blueSound);
+        auto t3 = clock::now();
+        synthesize_all_sounds();
+        auto t4 = clock::now();
+
+        double ms[4] = {
+            std::chrono::duration<double, std::milli>(t1 - t0).count(),
+            std::chrono::duration<double, std::milli>(t2 - t1).count(),
+            std::chrono::duration<double, std::milli>(t3 - t2).count(),
+            std::chrono::duration<double, std::milli>(t4 - t3).count()
+        };
+        for (int k = 0; k < 4; ++k) best[k] = std::min(best[k], ms[k]);
+    }
+
+    fprintf(out, "sound synthesis, best of %d runs\n", RUNS);
+    for (int k = 0; k < 4; ++k) fprintf(out, "  %-16s %8.2f ms\n", names[k], best[k]);
+    fprintf(out, "  %-16s %8.2f ms\n", "serial total", best[0] + best[1] + best[2]);
+}
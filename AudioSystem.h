@@ -1,8 +1,22 @@
 #pragma once
 #include "GameConfig.h"
+#include "World.h"
 
 void make_rainbow_sound(SynthSound& snd);
 void make_stellar_explosion_sound(SynthSound& snd);
 void make_blue_sound(SynthSound& snd);
 void request_play(SynthSound& snd);
+// Plays the simulation's sound events through request_play.
+SimEvents* audio_events();
 void audio_callback(void* userdata, Uint8* stream, int len);
+void synthesize_all_sounds();
+void benchmark_sound_synthesis(FILE* out);
+void set_audio_buffer_frames(int frames, int rate);
+// Sets up the audio thread's profiler ring, which it may not make itself. Call
+// before the device or engine starts mixing effects.
+void prepare_audio_profiling();
+void report_audio_latency(FILE* out);
+// Plays the effects through a node on the music engine instead of the SDL device.
+// The engine should run at SYNTH_SAMPLE_RATE.
+bool attach_effects_to_engine(ma_engine* engine);
+void detach_effects_from_engine();
@@ -0,0 +1,1104 @@
+#include "Benchmark.h"
+#include "Simulation.h"
+#include "GameLogic.h"
+#include "PhysicsSystem.h"
+#if BENCH_FRONTEND
+#include "Render.h"
+#include "AudioSystem.h"
+#endif
+#include "Profiler.h"
+#include "AllocCounter.h"
+#include "PerfCounters.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#undef min
+#undef max
+
+enum BenchScenario { SCENARIO_IDLE, SCENARIO_SWEEP, SCENARIO_METEORS, SCENARIO_BRUSH, SCENARIO_EXPLOSIONS, SCENARIO_MIX, SCENARIO_COUNT };
+
+static const char* const SCENARIO_NAMES[SCENARIO_COUNT] = { "idle", "sweep", "meteors", "brush", "explosions", "mix" };
+
+// Rows of the report: the simulation stages, then the render batch build (frontend
+// builds only) and the whole frame.
+#if BENCH_FRONTEND
+const int BENCH_RENDER_BATCH = SIM_STAGE_COUNT;
+const int BENCH_TOTAL = SIM_STAGE_COUNT + 1;
+#else
+const int BENCH_TOTAL = SIM_STAGE_COUNT;
+#endif
+const int BENCH_ROWS = BENCH_TOTAL + 1;
+
+// The view the scenarios script, the game's default window.
+const int BENCH_VIEW_WIDTH = 1280, BENCH_VIEW_HEIGHT = 720;
+
+struct BenchConfig {
+    int particles = 2000;
+    int players = 300;
+    int threads = 0;
+    unsigned seed = 1;
+    int frames = 600;
+    int warmup = 60;
+    int worldWidth = 1280, worldHeight = 720;
+    bool sparseGrid = false;
+    BenchScenario scenario = SCENARIO_MIX;
+    const char* jsonPath = nullptr;
+    const char* profilePath = nullptr;
+    bool hwCounters = false;
+    const char* hwCsvPath = nullptr;
+};
+
+struct StageStats {
+    double meanNs, p50Ns, p99Ns, nsPerParticle, allocsPerFrame;
+    // p50 over the frames the stage ran in. Stages that skip most frames (the sim
+    // while painting) have a p50 of 0, which this still sees.
+    double activeP50Ns;
+};
+
+// Memory per tag at the end of a scenario. Peaks cover the whole scenario, setup
+// included; allocations per frame cover the measured frames.
+struct MemoryStats {
+    int64_t liveBytes[MEM_TAG_COUNT + 1];       // the last entry is the total
+    int64_t peakBytes[MEM_TAG_COUNT + 1];
+    double allocsPerFrame[MEM_TAG_COUNT + 1];
+    int64_t residentBytes;
+};
+
+// Hardware counts per row summed over the measured frames, and per pool worker.
+struct HwStats {
+    HwCounts rows[BENCH_ROWS];
+    std::vector<HwCounts> workers;
+};
+
+static HwCounts hw_diff(const HwCounts& later, const HwCounts& earlier) {
+    HwCounts d;
+    for (int i = 0; i < HW_COUNTER_COUNT; ++i) d.v[i] = later.v[i] - earlier.v[i];
+    return d;
+}
+
+static const char* mem_row_name(int tag) {
+    return tag < MEM_TAG_COUNT ? MEM_TAG_NAMES[tag] : "total";
+}
+
+static MemTagStats mem_row_stats(int tag) {
+    return tag < MEM_TAG_COUNT ? mem_tag_stats((MemTag)tag) : mem_total_stats();
+}
+
+static bool parse_config(int argc, char* argv[], BenchConfig& cfg) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc) cfg.particles = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--players") == 0 && i + 1 < argc) cfg.players = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) cfg.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) cfg.seed = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) cfg.frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) cfg.warmup = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--sparse-grid") == 0) cfg.sparseGrid = true;
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) cfg.jsonPath = argv[++i];
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) cfg.profilePath = argv[++i];
+        else if (strcmp(argv[i], "--hw-counters") == 0) cfg.hwCounters = true;
+        else if (strcmp(argv[i], "--hw-csv") == 0 && i + 1 < argc) {
+            cfg.hwCounters = true;
+            cfg.hwCsvPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--world") == 0 && i + 2 < argc) {
+            cfg.worldWidth = atoi(argv[++i]);
+            cfg.worldHeight = atoi(argv[++i]);
+            cfg.sparseGrid = true;
+        }
+        else if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            int s = 0;
+            while (s < SCENARIO_COUNT && strcmp(SCENARIO_NAMES[s], name) != 0) ++s;
+            if (s == SCENARIO_COUNT) {
+                fprintf(stderr, "Unknown scenario %s.\n", name);
+                return false;
+            }
+            cfg.scenario = (BenchScenario)s;
+        }
+    }
+    if (cfg.threads <= 0) cfg.threads = (int)std::thread::hardware_concurrency();
+    if (cfg.threads <= 0) cfg.threads = 4;
+    if (cfg.particles < 1) cfg.particles = 1;
+    if (cfg.players < 0) cfg.players = 0;
+    if (cfg.players > cfg.particles) cfg.players = cfg.particles;
+    if (cfg.frames < 1) cfg.frames = 1;
+    if (cfg.warmup < 0) cfg.warmup = 0;
+    if (cfg.worldWidth < 64) cfg.worldWidth = 64;
+    if (cfg.worldHeight < 64) cfg.worldHeight = 64;
+    return true;
+}
+
+// Scripted input for frame f. Everything random goes through world.rng, seeded
+// once, so a run is repeatable for a given seed and thread count.
+static void script_frame(BenchScenario scenario, int f, World& world, SimInput& in) {
+    const float w = (float)world.width, h = (float)world.height;
+    if (scenario == SCENARIO_MIX) scenario = (BenchScenario)(SCENARIO_SWEEP + (f / 150) % 4);
+
+    in.mouseDown = false;
+    in.brushMode = false;
+    in.painting = false;
+    in.silent = true;
+
+    switch (scenario) {
+    case SCENARIO_SWEEP: {
+        // Figure-of-eight through the water with the swarm in tow.
+        float t = f * 0.02f;
+        in.mouseDown = true;
+        in.mouseX = (int)(w * (0.5f + 0.4f * std::sin(t)));
+        in.mouseY = (int)(h * (0.5f + 0.35f * std::sin(2.0f * t)));
+        break;
+    }
+    case SCENARIO_METEORS:
+        in.silent = false;
+        if (f % 20 == 0) spawnMeteorDrop(world, in.viewX + 100.0f + world.random() % std::max(1, (int)in.viewW - 200), in.viewY - 50.0f);
+        break;
+    case SCENARIO_BRUSH: {
+        // Paint for 180 frames, cycling the brush type, then let the swarm loose on
+        // the strokes for 60.
+        int phase = f % 240;
+        float t = f * 0.03f;
+        in.mouseX = (int)(w * (0.5f + 0.35f * std::cos(t)));
+        in.mouseY = (int)(h * (0.45f + 0.2f * std::sin(1.7f * t)));
+        in.brushEffectMode = 1 + (f / 240) % 3;
+        if (phase < 180) { in.brushMode = true; in.painting = true; }
+        else in.mouseDown = true;
+        break;
+    }
+    case SCENARIO_EXPLOSIONS:
+        if (f % 15 == 0) spawnExplosionFragments(world, (float)(world.random() % world.width), (float)(world.random() % world.height));
+        if (f % 45 == 0) spawnRainbowFragments(world, (float)(world.random() % world.width), (float)(world.random() % world.height), f * 0.016f, 1.0f);
+        break;
+    default:
+        break;
+    }
+}
+
+static StageStats summarize(std::vector<int64_t>& samples, double meanParticles) {
+    StageStats s = {};
+    if (samples.empty()) return s;
+    double sum = 0.0;
+    for (int64_t v : samples) sum += (double)v;
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    s.meanNs = sum / n;
+    s.p50Ns = (double)samples[(n - 1) / 2];
+    s.p99Ns = (double)samples[std::min(n - 1, (size_t)(n * 0.99))];
+    auto firstActive = std::upper_bound(samples.begin(), samples.end(), (int64_t)0);
+    size_t active = samples.end() - firstActive;
+    s.activeP50Ns = active > 0 ? (double)firstActive[(active - 1) / 2] : 0.0;
+    s.nsPerParticle = meanParticles > 0.0 ? s.meanNs / meanParticles : 0.0;
+    return s;
+}
+
+static const char* row_name(int row) {
+#if BENCH_FRONTEND
+    if (row == BENCH_RENDER_BATCH) return "render_batch";
+#endif
+    if (row == BENCH_TOTAL) return "total";
+    return SIM_STAGE_NAMES[row];
+}
+
+static bool hw_has(HwCounter k) {
+    return (hw_counters_available() >> k) & 1;
+}
+
+// Instructions per cycle, or -1 without both counters.
+static double hw_ipc(const HwCounts& c) {
+    if (!hw_has(HW_CYCLES) || !hw_has(HW_INSTRUCTIONS) || c.v[HW_CYCLES] == 0) return -1.0;
+    return (double)c.v[HW_INSTRUCTIONS] / c.v[HW_CYCLES];
+}
+
+// Misses per thousand instructions, or -1 without both counters.
+static double hw_mpki(const HwCounts& c, HwCounter k) {
+    if (!hw_has(k) || !hw_has(HW_INSTRUCTIONS) || c.v[HW_INSTRUCTIONS] == 0) return -1.0;
+    return c.v[k] * 1000.0 / c.v[HW_INSTRUCTIONS];
+}
+
+static void print_hw_value(FILE* out, double v, int width, int decimals) {
+    if (v < 0.0) fprintf(out, " %*s", width, "-");
+    else fprintf(out, " %*.*f", width, decimals, v);
+}
+
+static void print_hw_row(FILE* out, const char* name, const HwCounts& c, int frames) {
+    fprintf(out, "  %-14s", name);
+    print_hw_value(out, hw_has(HW_CYCLES) ? (double)c.v[HW_CYCLES] / frames : -1.0, 12, 0);
+    print_hw_value(out, hw_has(HW_INSTRUCTIONS) ? (double)c.v[HW_INSTRUCTIONS] / frames : -1.0, 12, 0);
+    print_hw_value(out, hw_ipc(c), 6, 2);
+    print_hw_value(out, hw_mpki(c, HW_L1D_MISSES), 9, 2);
+    print_hw_value(out, hw_mpki(c, HW_LLC_MISSES), 9, 2);
+    print_hw_value(out, hw_mpki(c, HW_BRANCH_MISSES), 9, 2);
+    fputc('\n', out);
+}
+
+static void write_json_number(FILE* out, double v, int decimals) {
+    if (v < 0.0) fprintf(out, "null");
+    else fprintf(out, "%.*f", decimals, v);
+}
+
+// Mean counts per frame and the ratios derived from them; null where a counter
+// could not be opened.
+static void write_hw_counts(FILE* out, const HwCounts& c, int frames) {
+    fprintf(out, "{ ");
+    for (int k = 0; k < HW_COUNTER_COUNT; ++k) {
+        fprintf(out, "\"%s\": ", HW_COUNTER_NAMES[k]);
+        write_json_number(out, hw_has((HwCounter)k) ? (double)c.v[k] / frames : -1.0, 1);
+        fprintf(out, ", ");
+    }
+    fprintf(out, "\"ipc\": "); write_json_number(out, hw_ipc(c), 3);
+    fprintf(out, ", \"l1d_mpki\": "); write_json_number(out, hw_mpki(c, HW_L1D_MISSES), 3);
+    fprintf(out, ", \"llc_mpki\": "); write_json_number(out, hw_mpki(c, HW_LLC_MISSES), 3);
+    fprintf(out, ", \"branch_mpki\": "); write_json_number(out, hw_mpki(c, HW_BRANCH_MISSES), 3);
+    fprintf(out, " }");
+}
+
+static void write_json(FILE* out, const BenchConfig& cfg, const StageStats* stats, double meanParticles, const MemoryStats& mem, const HwStats* hw) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"simulation\",\n");
+    fprintf(out, "  \"config\": {\n");
+    fprintf(out, "    \"scenario\": \"%s\",\n", SCENARIO_NAMES[cfg.scenario]);
+    fprintf(out, "    \"particles\": %d,\n", cfg.particles);
+    fprintf(out, "    \"players\": %d,\n", cfg.players);
+    fprintf(out, "    \"threads\": %d,\n", cfg.threads);
+    fprintf(out, "    \"seed\": %u,\n", cfg.seed);
+    fprintf(out, "    \"frames\": %d,\n", cfg.frames);
+    fprintf(out, "    \"warmup\": %d,\n", cfg.warmup);
+    fprintf(out, "    \"world\": [%d, %d],\n", cfg.worldWidth, cfg.worldHeight);
+    fprintf(out, "    \"sparse_grid\": %s\n", cfg.sparseGrid ? "true" : "false");
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"mean_particles\": %.1f,\n", meanParticles);
+    fprintf(out, "  \"stages\": {\n");
+    for (int r = 0; r < BENCH_ROWS; ++r) {
+        fprintf(out, "    \"%s\": { \"mean_us\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, \"ns_per_particle\": %.3f, \"allocs_per_frame\": %.2f }%s\n",
+            row_name(r), stats[r].meanNs * 1e-3, stats[r].p50Ns * 1e-3, stats[r].p99Ns * 1e-3, stats[r].nsPerParticle,
+            stats[r].allocsPerFrame, r + 1 < BENCH_ROWS ? "," : "");
+    }
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"memory\": {\n");
+    fprintf(out, "    \"resident_bytes\": %lld,\n", (long long)mem.residentBytes);
+    for (int t = 0; t <= MEM_TAG_COUNT; ++t) {
+        fprintf(out, "    \"%s\": { \"live_bytes\": %lld, \"peak_bytes\": %lld, \"allocs_per_frame\": %.2f }%s\n",
+            mem_row_name(t), (long long)mem.liveBytes[t], (long long)mem.peakBytes[t], mem.allocsPerFrame[t], t < MEM_TAG_COUNT ? "," : "");
+    }
+    fprintf(out, "  }%s\n", hw ? "," : "");
+    if (hw) {
+        fprintf(out, "  \"hw_counters\": {\n");
+        fprintf(out, "    \"available\": [");
+        bool first = true;
+        for (int k = 0; k < HW_COUNTER_COUNT; ++k) {
+            if (!hw_has((HwCounter)k)) continue;
+            fprintf(out, "%s\"%s\"", first ? "" : ", ", HW_COUNTER_NAMES[k]);
+            first = false;
+        }
+        fprintf(out, "],\n");
+        fprintf(out, "    \"per_frame\": {\n");
+        for (int r = 0; r < BENCH_ROWS; ++r) {
+            fprintf(out, "      \"%s\": ", row_name(r));
+            write_hw_counts(out, hw->rows[r], cfg.frames);
+            fprintf(out, "%s\n", r + 1 < BENCH_ROWS ? "," : "");
+        }
+        fprintf(out, "    },\n");
+        fprintf(out, "    \"workers\": [\n");
+        for (size_t w = 0; w < hw->workers.size(); ++w) {
+            fprintf(out, "      ");
+            write_hw_counts(out, hw->workers[w], cfg.frames);
+            fprintf(out, "%s\n", w + 1 < hw->workers.size() ? "," : "");
+        }
+        fprintf(out, "    ]\n");
+        fprintf(out, "  }\n");
+    }
+    fprintf(out, "}\n");
+}
+
+// Steps one scenario and summarises every row of the report, and its memory and
+// hardware counts if asked for.
+static void run_scenario(const BenchConfig& cfg, StageStats* stats, double& meanParticles, MemoryStats* mem = nullptr, HwStats* hw = nullptr) {
+    using clock = std::chrono::steady_clock;
+    if (cfg.hwCounters && !hw_counters_start()) fprintf(stderr, "Hardware counters need Linux perf_event_open.\n");
+    mem_reset_peaks();
+    World world(cfg.worldWidth, cfg.worldHeight, cfg.sparseGrid);
+    world.rng.seed(cfg.seed);
+    populate_world(world, cfg.particles, cfg.players, true);
+    ThreadPool pool(cfg.threads);
+
+    SimInput in;
+    in.viewX = 0.0f; in.viewY = 0.0f;
+    in.viewW = (float)std::min(cfg.worldWidth, BENCH_VIEW_WIDTH);
+    in.viewH = (float)std::min(cfg.worldHeight, BENCH_VIEW_HEIGHT);
+
+#if BENCH_FRONTEND
+    std::vector<SDL_Vertex> metaballBatch, plasmaBatch;
+#endif
+    std::vector<int64_t> samples[BENCH_ROWS];
+    for (auto& v : samples) v.reserve(cfg.frames);
+    uint64_t allocs[BENCH_ROWS] = {};
+    uint64_t tagAllocsAtStart[MEM_TAG_COUNT + 1] = {};
+    double particleSum = 0.0;
+    // Per-frame hardware counts, frame-major, for the CSV.
+    std::vector<HwCounts> frameHw;
+    if (cfg.hwCsvPath) frameHw.reserve((size_t)cfg.frames * BENCH_ROWS);
+    HwCounts hwRows[BENCH_ROWS];
+    std::vector<HwCounts> workerHwAtStart;
+
+    PROFILE_THREAD("main");
+    if (cfg.profilePath) profiler_start();
+    world.timeStages = true;
+    for (int f = 0; f < cfg.warmup + cfg.frames; ++f) {
+        if (f == cfg.warmup) {
+            for (int t = 0; t <= MEM_TAG_COUNT; ++t) tagAllocsAtStart[t] = mem_row_stats(t).allocs;
+            workerHwAtStart = world.workerHw;
+        }
+        script_frame(cfg.scenario, f, world, in);
+
+        int64_t before[SIM_STAGE_COUNT];
+        uint64_t allocsBefore[SIM_STAGE_COUNT];
+        memcpy(before, world.stageNs, sizeof(before));
+        memcpy(allocsBefore, world.stageAllocs, sizeof(allocsBefore));
+        HwCounts hwBefore[SIM_STAGE_COUNT];
+        std::copy(world.stageHw, world.stageHw + SIM_STAGE_COUNT, hwBefore);
+        uint64_t allocsAtStart = alloc_count();
+        auto t0 = clock::now();
+        step_world(world, in, pool);
+#if BENCH_FRONTEND
+        auto t1 = clock::now();
+        uint64_t allocsAtBatch = alloc_count();
+        HwCounts batchHw;
+        {
+            HwCounterScope counters(batchHw);
+            build_water_batches(world.particles, in.viewX, in.viewY, (float)(world.timeMs * 0.001), metaballBatch, plasmaBatch);
+        }
+#endif
+        auto t2 = clock::now();
+        uint64_t allocsAtEnd = alloc_count();
+
+        if (f < cfg.warmup) continue;
+        for (int s = 0; s < SIM_STAGE_COUNT; ++s) {
+            samples[s].push_back(world.stageNs[s] - before[s]);
+            allocs[s] += world.stageAllocs[s] - allocsBefore[s];
+        }
+#if BENCH_FRONTEND
+        samples[BENCH_RENDER_BATCH].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count());
+        allocs[BENCH_RENDER_BATCH] += allocsAtEnd - allocsAtBatch;
+#endif
+        samples[BENCH_TOTAL].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t0).count());
+        allocs[BENCH_TOTAL] += allocsAtEnd - allocsAtStart;
+        particleSum += (double)world.particles.size();
+
+        if (!cfg.hwCounters) continue;
+        HwCounts frameRows[BENCH_ROWS];
+        for (int s = 0; s < SIM_STAGE_COUNT; ++s) frameRows[s] = hw_diff(world.stageHw[s], hwBefore[s]);
+#if BENCH_FRONTEND
+        frameRows[BENCH_RENDER_BATCH] = batchHw;
+#endif
+        for (int r = 0; r < BENCH_TOTAL; ++r) frameRows[BENCH_TOTAL].add(frameRows[r]);
+        for (int r = 0; r < BENCH_ROWS; ++r) hwRows[r].add(frameRows[r]);
+        if (cfg.hwCsvPath) frameHw.insert(frameHw.end(), frameRows, frameRows + BENCH_ROWS);
+    }
+    hw_counters_stop();
+
+    if (cfg.profilePath) {
+        int zones = profiler_export_chrome_trace(cfg.profilePath);
+        if (zones < 0) fprintf(stderr, "Could not write %s.\n", cfg.profilePath);
+        else fprintf(stderr, "Wrote %d zones to %s\n", zones, cfg.profilePath);
+    }
+
+    meanParticles = particleSum / cfg.frames;
+    for (int r = 0; r < BENCH_ROWS; ++r) {
+        stats[r] = summarize(samples[r], meanParticles);
+        stats[r].allocsPerFrame = (double)allocs[r] / cfg.frames;
+    }
+    if (mem) {
+        for (int t = 0; t <= MEM_TAG_COUNT; ++t) {
+            MemTagStats s = mem_row_stats(t);
+            mem->liveBytes[t] = s.liveBytes;
+            mem->peakBytes[t] = s.peakBytes;
+            mem->allocsPerFrame[t] = (double)(s.allocs - tagAllocsAtStart[t]) / cfg.frames;
+        }
+        mem->residentBytes = process_resident_bytes();
+    }
+    if (hw) {
+        std::copy(hwRows, hwRows + BENCH_ROWS, hw->rows);
+        hw->workers.assign(world.workerHw.size(), HwCounts());
+        for (size_t w = 0; w < world.workerHw.size(); ++w) {
+            hw->workers[w] = w < workerHwAtStart.size() ? hw_diff(world.workerHw[w], workerHwAtStart[w]) : world.workerHw[w];
+        }
+    }
+    if (cfg.hwCsvPath) {
+        FILE* csv = fopen(cfg.hwCsvPath, "w");
+        if (!csv) {
+            fprintf(stderr, "Could not write %s.\n", cfg.hwCsvPath);
+            return;
+        }
+        fprintf(csv, "frame,stage");
+        for (int k = 0; k < HW_COUNTER_COUNT; ++k) fprintf(csv, ",%s", HW_COUNTER_NAMES[k]);
+        fputc('\n', csv);
+        for (size_t i = 0; i < frameHw.size(); ++i) {
+            fprintf(csv, "%d,%s", (int)(i / BENCH_ROWS), row_name((int)(i % BENCH_ROWS)));
+            for (int k = 0; k < HW_COUNTER_COUNT; ++k) fprintf(csv, ",%llu", (unsigned long long)frameHw[i].v[k]);
+            fputc('\n', csv);
+        }
+        fclose(csv);
+    }
+}
+
+int run_sim_benchmark(int argc, char* argv[]) {
+    BenchConfig cfg;
+    if (!parse_config(argc, argv, cfg)) return 1;
+
+    StageStats stats[BENCH_ROWS];
+    double meanParticles = 0.0;
+    MemoryStats mem;
+    HwStats hw;
+    run_scenario(cfg, stats, meanParticles, &mem, &hw);
+
+    fprintf(stderr, "simulation benchmark: %s, %.0f particles, %d threads, %d frames\n",
+        SCENARIO_NAMES[cfg.scenario], meanParticles, cfg.threads, cfg.frames);
+    fprintf(stderr, "  %-14s %10s %10s %10s %12s %13s\n", "stage", "mean us", "p50 us", "p99 us", "ns/particle", "allocs/frame");
+    for (int r = 0; r < BENCH_ROWS; ++r) {
+        fprintf(stderr, "  %-14s %10.1f %10.1f %10.1f %12.2f %13.2f\n", row_name(r),
+            stats[r].meanNs * 1e-3, stats[r].p50Ns * 1e-3, stats[r].p99Ns * 1e-3, stats[r].nsPerParticle, stats[r].allocsPerFrame);
+    }
+    fprintf(stderr, "  %-14s %10s %10s %13s\n", "memory", "live KB", "peak KB", "allocs/frame");
+    for (int t = 0; t <= MEM_TAG_COUNT; ++t) {
+        if (mem.peakBytes[t] == 0) continue;
+        fprintf(stderr, "  %-14s %10.1f %10.1f %13.2f\n", mem_row_name(t), mem.liveBytes[t] / 1024.0, mem.peakBytes[t] / 1024.0, mem.allocsPerFrame[t]);
+    }
+    if (mem.residentBytes > 0) fprintf(stderr, "  %-14s %10.1f\n", "resident", mem.residentBytes / 1024.0);
+    if (cfg.hwCounters && hw_counters_available() == 0) {
+        fprintf(stderr, "  hardware counters unavailable (no PMU, or perf_event_paranoid too high)\n");
+    }
+    else if (cfg.hwCounters) {
+        fprintf(stderr, "  %-14s %12s %12s %6s %9s %9s %9s\n", "per frame", "cycles", "instructions", "IPC", "L1D MPKI", "LLC MPKI", "br MPKI");
+        for (int r = 0; r < BENCH_ROWS; ++r) print_hw_row(stderr, row_name(r), hw.rows[r], cfg.frames);
+        for (size_t w = 0; w < hw.workers.size(); ++w) {
+            char name[32];
+            snprintf(name, sizeof(name), "pool %d", (int)w);
+            print_hw_row(stderr, name, hw.workers[w], cfg.frames);
+        }
+    }
+
+    FILE* out = stdout;
+    if (cfg.jsonPath) {
+        out = fopen(cfg.jsonPath, "w");
+        if (!out) {
+            fprintf(stderr, "Could not write %s.\n", cfg.jsonPath);
+            return 1;
+        }
+    }
+    write_json(out, cfg, stats, meanParticles, mem, cfg.hwCounters ? &hw : nullptr);
+    if (out != stdout) fclose(out);
+    return 0;
+}
+
+enum BenchDistribution { DIST_UNIFORM, DIST_POOLED, DIST_CLUSTER, DIST_COUNT };
+
+static const char* const DIST_NAMES[DIST_COUNT] = { "uniform", "pooled", "cluster" };
+
+#if BENCH_FRONTEND
+static const char* const SPRITE_NAMES[SPRITE_COUNT] = {
+    "normal_particle", "player_particle", "player_glow", "brush",
+    "rainbow_brush", "dot", "metaball", "plasma"
+};
+
+const int AUDIO_BENCH_FRAMES = 1024;
+#endif
+
+struct KernelConfig {
+    int particles = 4000;
+    int players = 300;
+    int threads = 0;
+    unsigned seed = 1;
+    int repeats = 50;
+    const char* kernel = nullptr;
+    const char* dist = nullptr;
+    const char* jsonPath = nullptr;
+};
+
+struct KernelResult {
+    std::string kernel;
+    const char* dist;
+    size_t items;
+    double minNs, medianNs;
+};
+
+// A filter matches its exact name, or a family of kernels by the part before ':'.
+static bool kernel_selected(const KernelConfig& cfg, const std::string& name) {
+    if (!cfg.kernel) return true;
+    size_t n = strlen(cfg.kernel);
+    return name == cfg.kernel || (name.compare(0, n, cfg.kernel) == 0 && name.size() > n && name[n] == ':');
+}
+
+// Times `run` cfg.repeats times after two untimed warm-up calls; `reset` puts the
+// inputs back before every call and is not timed.
+static void time_kernel(const KernelConfig& cfg, std::vector<KernelResult>& results, const std::string& name, const char* dist,
+    size_t items, const std::function<void()>& reset, const std::function<void()>& run) {
+    if (!kernel_selected(cfg, name)) return;
+    using clock = std::chrono::steady_clock;
+    std::vector<double> ns;
+    ns.reserve(cfg.repeats);
+    for (int r = 0; r < cfg.repeats + 2; ++r) {
+        reset();
+        auto t0 = clock::now();
+        run();
+        auto t1 = clock::now();
+        if (r >= 2) ns.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+    }
+    std::sort(ns.begin(), ns.end());
+    results.push_back({ name, dist, items, ns.front(), ns[(ns.size() - 1) / 2] });
+}
+
+static void populate_distribution(World& world, BenchDistribution dist, const KernelConfig& cfg) {
+    const float w = (float)world.width, h = (float)world.height;
+    for (int i = 0; i < cfg.players; ++i) {
+        float angle = (float)i / cfg.players * 2.0f * 3.14159f;
+        float r = (float)(world.random() % 40);
+        spawnParticle(world, w * 0.5f + std::cos(angle) * r, h * 0.3f + std::sin(angle) * r, true);
+    }
+    const float clusterR = std::sqrt((float)cfg.particles) * 3.0f;
+    for (int i = 0; i < cfg.particles - cfg.players; ++i) {
+        float u = (world.random() % 10000) / 10000.0f, v = (world.random() % 10000) / 10000.0f;
+        float x, y;
+        if (dist == DIST_POOLED) {
+            x = RADIUS + u * (w - 2 * RADIUS);
+            y = h * 0.75f + v * (h * 0.25f - RADIUS);
+        }
+        else if (dist == DIST_CLUSTER) {
+            float r = clusterR * std::sqrt(u), a = v * 6.2831853f;
+            x = w * 0.5f + std::cos(a) * r;
+            y = h * 0.6f + std::sin(a) * r;
+        }
+        else {
+            x = u * w;
+            y = v * h;
+        }
+        spawnParticle(world, x, y, false);
+    }
+    apply_particle_spawns(world);
+
+    // Heat sources over the water for apply_heat_from_fragments.
+    for (int i = 0; i < 8; ++i) spawnExplosionFragments(world, (float)(world.random() % world.width), h * 0.5f + (float)(world.random() % (world.height / 2)));
+}
+
+static void bench_distribution(const KernelConfig& cfg, BenchDistribution dist, ThreadPool& pool, std::vector<KernelResult>& results) {
+    const char* dname = DIST_NAMES[dist];
+    // Every layout starts from the same seed, so each kernel sees the same input
+    // whichever others are selected.
+    World world(1280, 720);
+    world.rng.seed(cfg.seed);
+    populate_distribution(world, dist, cfg);
+    const size_t n = world.particles.size();
+
+    // One step leaves the particles integrated but not yet re-sorted, which is what
+    // the sort sees at the top of every frame.
+    step_world(world, SimInput(), pool);
+    const std::vector<Particle> unsorted = world.particles;
+    time_kernel(cfg, results, "update_and_sort", dname, n,
+        [&] { world.particles = unsorted; },
+        [&] { world.grid.update_and_sort(world.particles, world.particle_buffer); });
+    world.particles = unsorted;
+    world.grid.update_and_sort(world.particles, world.particle_buffer);
+    world.forces.assign(n, Vector2D());
+    update_density_buffer(world);
+    update_sleeping_cells(world);
+    const std::vector<Particle> sorted = world.particles;
+
+    std::vector<int> keys;
+    time_kernel(cfg, results, "get_active_keys", dname, world.grid.cellCount.size(),
+        [] {},
+        [&] { keys = world.grid.get_active_keys(); });
+    keys = world.grid.get_active_keys();
+
+    std::vector<Vector2D> local(n);
+    time_kernel(cfg, results, "calculate_forces_for_keys", dname, n,
+        [&] { std::fill(local.begin(), local.end(), Vector2D()); },
+        [&] { calculate_forces_for_keys(world, keys, local); });
+    std::fill(local.begin(), local.end(), Vector2D());
+    calculate_forces_for_keys(world, keys, local);
+
+    pool.dispatch_repulsion_calc(keys, world);
+    pool.wait();
+    time_kernel(cfg, results, "reduce_forces", dname, n,
+        [&] { std::fill(world.forces.begin(), world.forces.end(), Vector2D()); },
+        [&] { pool.reduce_forces(world.forces); });
+
+    time_kernel(cfg, results, "apply_heat_from_fragments", dname, n,
+        [&] { world.particles = sorted; },
+        [&] { apply_heat_from_fragments(world); });
+
+    time_kernel(cfg, results, "apply_forces_to_particles", dname, n,
+        [&] { world.particles = sorted; world.forces = local; },
+        [&] { apply_forces_to_particles(world); });
+    world.particles = sorted;
+
+    while (world.rainbowFragments.size() + 600 < MAX_RAINBOW_FRAGMENTS / 2) {
+        spawnRainbowFragments(world, (float)(world.random() % world.width), (float)(world.random() % world.height), 0.0f, 10.0f);
+    }
+    const FragmentWheel fragments = world.rainbowFragments;
+    time_kernel(cfg, results, "update_rainbow_fragments", dname, fragments.size(),
+        [&] { world.rainbowFragments = fragments; },
+        [&] { update_rainbow_fragments(world); });
+}
+
+// Kernels that do not depend on the particle layout; all of them are frontend code.
+#if BENCH_FRONTEND
+static void bench_fixed(const KernelConfig& cfg, std::vector<KernelResult>& results) {
+    bool wantAudio = kernel_selected(cfg, "audio_callback");
+    if (wantAudio) {
+        synthesize_all_sounds();
+        SynthSound* sounds[3] = { &blueSound, &rainbowSound, &explosionSound };
+        std::vector<float> buffer(AUDIO_BENCH_FRAMES);
+        // Every voice is retriggered before each call, so the callback starts and
+        // mixes MAX_VOICES sounds: the mixer at full load.
+        time_kernel(cfg, results, "audio_callback", "-", AUDIO_BENCH_FRAMES,
+            [&] { for (int v = 0; v < MAX_VOICES; ++v) request_play(*sounds[v % 3]); },
+            [&] { audio_callback(nullptr, reinterpret_cast<Uint8*>(buffer.data()), (int)(buffer.size() * sizeof(float))); });
+    }
+
+    // The pixel work of each create_*_texture; the upload needs a renderer.
+    for (int i = 0; i < SPRITE_COUNT; ++i) {
+        SpriteId id = (SpriteId)i;
+        std::vector<Uint32> pixels;
+        time_kernel(cfg, results, std::string("sprite:") + SPRITE_NAMES[i], "-", (size_t)sprite_size(id) * sprite_size(id),
+            [] {},
+            [&] { pixels = generate_sprite_pixels(id); });
+    }
+}
+#endif
+
+int run_kernel_benchmark(int argc, char* argv[]) {
+    KernelConfig cfg;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc) cfg.particles = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--players") == 0 && i + 1 < argc) cfg.players = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) cfg.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) cfg.seed = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc) cfg.repeats = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) cfg.kernel = argv[++i];
+        else if (strcmp(argv[i], "--dist") == 0 && i + 1 < argc) cfg.dist = argv[++i];
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) cfg.jsonPath = argv[++i];
+    }
+    if (cfg.threads <= 0) cfg.threads = (int)std::thread::hardware_concurrency();
+    if (cfg.threads <= 0) cfg.threads = 4;
+    if (cfg.particles < 1) cfg.particles = 1;
+    if (cfg.players < 0) cfg.players = 0;
+    if (cfg.players > cfg.particles) cfg.players = cfg.particles;
+    if (cfg.repeats < 1) cfg.repeats = 1;
+
+    ThreadPool pool(cfg.threads);
+    std::vector<KernelResult> results;
+    for (int d = 0; d < DIST_COUNT; ++d) {
+        if (cfg.dist && strcmp(cfg.dist, DIST_NAMES[d]) != 0) continue;
+        bench_distribution(cfg, (BenchDistribution)d, pool, results);
+    }
+#if BENCH_FRONTEND
+    bench_fixed(cfg, results);
+#endif
+
+    if (results.empty()) {
+        fprintf(stderr, "No kernel matches the filter.\n");
+        return 1;
+    }
+
+    fprintf(stderr, "kernel benchmark: %d particles, %d repeats\n", cfg.particles, cfg.repeats);
+    fprintf(stderr, "  %-30s %-8s %8s %10s %10s %10s\n", "kernel", "layout", "items", "min us", "median us", "ns/item");
+    for (const auto& r : results) {
+        fprintf(stderr, "  %-30s %-8s %8zu %10.2f %10.2f %10.3f\n", r.kernel.c_str(), r.dist, r.items,
+            r.minNs * 1e-3, r.medianNs * 1e-3, r.items ? r.medianNs / r.items : 0.0);
+    }
+
+    FILE* out = stdout;
+    if (cfg.jsonPath) {
+        out = fopen(cfg.jsonPath, "w");
+        if (!out) {
+            fprintf(stderr, "Could not write %s.\n", cfg.jsonPath);
+            return 1;
+        }
+    }
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"kernels\",\n");
+    fprintf(out, "  \"config\": { \"particles\": %d, \"players\": %d, \"threads\": %d, \"seed\": %u, \"repeats\": %d },\n",
+        cfg.particles, cfg.players, cfg.threads, cfg.seed, cfg.repeats);
+    fprintf(out, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const KernelResult& r = results[i];
+        fprintf(out, "    { \"kernel\": \"%s\", \"layout\": \"%s\", \"items\": %zu, \"min_us\": %.3f, \"median_us\": %.3f, \"ns_per_item\": %.3f }%s\n",
+            r.kernel.c_str(), r.dist, r.items, r.minNs * 1e-3, r.medianNs * 1e-3, r.items ? r.medianNs / r.items : 0.0,
+            i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+    if (out != stdout) fclose(out);
+    return 0;
+}
+
+// Scenarios the regression runner always covers, at the default size.
+static const BenchScenario REGRESSION_SUITE[] = {
+    SCENARIO_IDLE, SCENARIO_SWEEP, SCENARIO_METEORS, SCENARIO_BRUSH, SCENARIO_EXPLOSIONS
+};
+const int REGRESSION_SUITE_SIZE = (int)(sizeof(REGRESSION_SUITE) / sizeof(REGRESSION_SUITE[0]));
+
+struct RegressConfig {
+    const char* baselinePath = "perf-baseline.json";
+    bool writeBaseline = false;
+    double thresholdPct = 10.0;
+    double minUs = 25.0;        // rows under this in both runs are left to noise
+    int repeats = 3;
+    int threads = 0;            // 0: the baseline's pool size
+    int frames = 300;
+};
+
+struct MachineInfo {
+    std::string cpu, os, compiler, build;
+    int hardwareThreads;
+};
+
+static MachineInfo machine_info() {
+    MachineInfo m;
+    m.hardwareThreads = (int)std::thread::hardware_concurrency();
+#if defined(_WIN32)
+    m.os = "windows";
+    const char* id = getenv("PROCESSOR_IDENTIFIER");
+    m.cpu = id ? id : "unknown";
+#else
+    m.os = "linux";
+#if defined(__APPLE__)
+    m.os = "macos";
+#endif
+    m.cpu = "unknown";
+    if (FILE* f = fopen("/proc/cpuinfo", "r")) {
+        char line[512];
+        while (fgets(line, sizeof(line), f)) {
+            const char* colon = strchr(line, ':');
+            if (strncmp(line, "model name", 10) != 0 || !colon) continue;
+            m.cpu = colon + 2;
+            while (!m.cpu.empty() && (m.cpu.back() == '\n' || m.cpu.back() == '\r')) m.cpu.pop_back();
+            break;
+        }
+        fclose(f);
+    }
+#endif
+    char buf[64];
+#if defined(_MSC_VER)
+    snprintf(buf, sizeof(buf), "msvc %d", _MSC_VER);
+#elif defined(__clang__)
+    snprintf(buf, sizeof(buf), "clang %d.%d", __clang_major__, __clang_minor__);
+#elif defined(__GNUC__)
+    snprintf(buf, sizeof(buf), "gcc %d.%d", __GNUC__, __GNUC_MINOR__);
+#else
+    snprintf(buf, sizeof(buf), "unknown");
+#endif
+    m.compiler = buf;
+#ifdef NDEBUG
+    m.build = "release";
+#else
+    m.build = "debug";
+#endif
+#if !BENCH_FRONTEND
+    m.build += ", headless";
+#endif
+    return m;
+}
+
+// Just enough JSON to read a baseline back.
+struct JsonValue {
+    enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+    Type type = JSON_NULL;
+    double number = 0.0;
+    std::string str;
+    std::vector<std::string> keys;      // objects only, parallel to items
+    std::vector<JsonValue> items;
+
+    const JsonValue* get(const char* key) const {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (keys[i] == key) return &items[i];
+        }
+        return nullptr;
+    }
+    double num(const char* key, double fallback) const {
+        const JsonValue* v = get(key);
+        return v && v->type == JSON_NUMBER ? v->number : fallback;
+    }
+    std::string text(const char* key) const {
+        const JsonValue* v = get(key);
+        return v && v->type == JSON_STRING ? v->str : std::string();
+    }
+};
+
+static void skip_space(const char*& p) {
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') ++p;
+}
+
+static bool parse_json_string(const char*& p, std::string& out) {
+    if (*p != '"') return false;
+    ++p;
+    out.clear();
+    while (*p && *p != '"') {
+        if (*p == '\\') {
+            ++p;
+            if (!*p) return false;
+            out += *p == 'n' ? '\n' : *p == 't' ? '\t' : *p;
+        }
+        else out += *p;
+        ++p;
+    }
+    if (*p != '"') return false;
+    ++p;
+    return true;
+}
+
+static bool parse_json(const char*& p, JsonValue& v) {
+    skip_space(p);
+    if (*p == '{' || *p == '[') {
+        bool object = *p == '{';
+        char close = object ? '}' : ']';
+        v.type = object ? JsonValue::JSON_OBJECT : JsonValue::JSON_ARRAY;
+        ++p;
+        skip_space(p);
+        if (*p == close) { ++p; return true; }
+        while (true) {
+            skip_space(p);
+            if (object) {
+                std::string key;
+                if (!parse_json_string(p, key)) return false;
+                skip_space(p);
+                if (*p++ != ':') return false;
+                v.keys.push_back(key);
+            }
+            v.items.emplace_back();
+            if (!parse_json(p, v.items.back())) return false;
+            skip_space(p);
+            if (*p == ',') { ++p; continue; }
+            if (*p == close) { ++p; return true; }
+            return false;
+        }
+    }
+    if (*p == '"') {
+        v.type = JsonValue::JSON_STRING;
+        return parse_json_string(p, v.str);
+    }
+    if (strncmp(p, "true", 4) == 0 || strncmp(p, "false", 5) == 0) {
+        v.type = JsonValue::JSON_BOOL;
+        v.number = *p == 't' ? 1.0 : 0.0;
+        p += *p == 't' ? 4 : 5;
+        return true;
+    }
+    if (strncmp(p, "null", 4) == 0) {
+        p += 4;
+        return true;
+    }
+    char* end = nullptr;
+    v.type = JsonValue::JSON_NUMBER;
+    v.number = strtod(p, &end);
+    if (end == p) return false;
+    p = end;
+    return true;
+}
+
+static bool load_json(const char* path, JsonValue& root) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    std::string text;
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) text.append(chunk, n);
+    fclose(f);
+    const char* p = text.c_str();
+    return parse_json(p, root) && root.type == JsonValue::JSON_OBJECT;
+}
+
+static void write_json_text(FILE* out, const std::string& s) {
+    fputc('"', out);
+    for (char c : s) {
+        if (c == '"' || c == '\\') fputc('\\', out);
+        fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static BenchConfig regression_bench_config(const RegressConfig& rc, BenchScenario scenario) {
+    BenchConfig cfg;
+    cfg.threads = rc.threads;
+    cfg.frames = rc.frames;
+    cfg.scenario = scenario;
+    return cfg;
+}
+
+// The fastest of several runs of each row, which is what is compared: timings
+// only get slower from noise, never faster. The p50 over active frames takes its
+// own fastest run. Allocations come from the last run.
+static void run_suite(const RegressConfig& rc, StageStats stats[][BENCH_ROWS]) {
+    for (int s = 0; s < REGRESSION_SUITE_SIZE; ++s) {
+        BenchConfig cfg = regression_bench_config(rc, REGRESSION_SUITE[s]);
+        fprintf(stderr, "  %s", SCENARIO_NAMES[cfg.scenario]);
+        for (int rep = 0; rep < rc.repeats; ++rep) {
+            StageStats run[BENCH_ROWS];
+            double meanParticles = 0.0;
+            run_scenario(cfg, run, meanParticles);
+            for (int r = 0; r < BENCH_ROWS; ++r) {
+                double activeP50 = rep == 0 ? run[r].activeP50Ns : std::min(stats[s][r].activeP50Ns, run[r].activeP50Ns);
+                if (rep == 0 || run[r].p50Ns < stats[s][r].p50Ns) stats[s][r] = run[r];
+                stats[s][r].activeP50Ns = activeP50;
+                stats[s][r].allocsPerFrame = run[r].allocsPerFrame;
+            }
+            fputc('.', stderr);
+        }
+        fputc('\n', stderr);
+    }
+}
+
+static bool write_baseline(const RegressConfig& rc, const MachineInfo& m, StageStats stats[][BENCH_ROWS]) {
+    FILE* out = fopen(rc.baselinePath, "w");
+    if (!out) return false;
+    BenchConfig defaults = regression_bench_config(rc, SCENARIO_IDLE);
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"regression\",\n");
+    fprintf(out, "  \"machine\": {\n");
+    fprintf(out, "    \"cpu\": "); write_json_text(out, m.cpu); fprintf(out, ",\n");
+    fprintf(out, "    \"os\": "); write_json_text(out, m.os); fprintf(out, ",\n");
+    fprintf(out, "    \"compiler\": "); write_json_text(out, m.compiler); fprintf(out, ",\n");
+    fprintf(out, "    \"build\": "); write_json_text(out, m.build); fprintf(out, ",\n");
+    fprintf(out, "    \"hardware_threads\": %d\n", m.hardwareThreads);
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"config\": { \"particles\": %d, \"players\": %d, \"threads\": %d, \"frames\": %d, \"warmup\": %d, \"seed\": %u, \"repeats\": %d },\n",
+        defaults.particles, defaults.players, rc.threads, rc.frames, defaults.warmup, defaults.seed, rc.repeats);
+    fprintf(out, "  \"scenarios\": {\n");
+    for (int s = 0; s < REGRESSION_SUITE_SIZE; ++s) {
+        fprintf(out, "    \"%s\": {\n", SCENARIO_NAMES[REGRESSION_SUITE[s]]);
+        for (int r = 0; r < BENCH_ROWS; ++r) {
+            fprintf(out, "      \"%s\": { \"p50_us\": %.3f, \"active_p50_us\": %.3f, \"mean_us\": %.3f, \"allocs_per_frame\": %.2f }%s\n",
+                row_name(r), stats[s][r].p50Ns * 1e-3, stats[s][r].activeP50Ns * 1e-3, stats[s][r].meanNs * 1e-3, stats[s][r].allocsPerFrame,
+                r + 1 < BENCH_ROWS ? "," : "");
+        }
+        fprintf(out, "    }%s\n", s + 1 < REGRESSION_SUITE_SIZE ? "," : "");
+    }
+    fprintf(out, "  }\n");
+    fprintf(out, "}\n");
+    fclose(out);
+    return true;
+}
+
+int run_regression(int argc, char* argv[]) {
+    RegressConfig rc;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) rc.baselinePath = argv[++i];
+        else if (strcmp(argv[i], "--write-baseline") == 0) rc.writeBaseline = true;
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) rc.thresholdPct = atof(argv[++i]);
+        else if (strcmp(argv[i], "--min-us") == 0 && i + 1 < argc) rc.minUs = atof(argv[++i]);
+        else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc) rc.repeats = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) rc.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) rc.frames = atoi(argv[++i]);
+    }
+    MachineInfo machine = machine_info();
+    JsonValue baseline;
+    bool haveBaseline = !rc.writeBaseline && load_json(rc.baselinePath, baseline);
+    if (!rc.writeBaseline && !haveBaseline) {
+        fprintf(stderr, "Could not read baseline %s; run with --write-baseline to record one.\n", rc.baselinePath);
+        return 2;
+    }
+
+    // Compare like with like: unless told otherwise, run the pool size, frame count
+    // and number of repeats the baseline was recorded with.
+    const JsonValue* baseConfig = haveBaseline ? baseline.get("config") : nullptr;
+    if (baseConfig) {
+        auto given = [&](const char* flag) { return std::any_of(argv, argv + argc, [&](const char* a) { return strcmp(a, flag) == 0; }); };
+        if (rc.threads <= 0) rc.threads = (int)baseConfig->num("threads", 0);
+        if (!given("--frames")) rc.frames = (int)baseConfig->num("frames", rc.frames);
+        if (!given("--repeats")) rc.repeats = (int)baseConfig->num("repeats", rc.repeats);
+    }
+    if (rc.repeats < 1) rc.repeats = 1;
+    if (rc.frames < 1) rc.frames = 1;
+    if (rc.threads <= 0) rc.threads = machine.hardwareThreads > 0 ? machine.hardwareThreads : 4;
+
+    fprintf(stderr, "regression suite: %d threads, %d frames, best of %d\n", rc.threads, rc.frames, rc.repeats);
+    StageStats stats[REGRESSION_SUITE_SIZE][BENCH_ROWS];
+    run_suite(rc, stats);
+
+    if (rc.writeBaseline) {
+        if (!write_baseline(rc, machine, stats)) {
+            fprintf(stderr, "Could not write %s.\n", rc.baselinePath);
+            return 1;
+        }
+        printf("Wrote baseline %s (%s, %d threads).\n", rc.baselinePath, machine.cpu.c_str(), rc.threads);
+        return 0;
+    }
+
+    const JsonValue* baseMachine = baseline.get("machine");
+    std::string baseCpu = baseMachine ? baseMachine->text("cpu") : std::string();
+    std::string baseBuild = baseMachine ? baseMachine->text("build") : std::string();
+    printf("Comparing against %s, recorded on %s (%s build).\n", rc.baselinePath, baseCpu.c_str(), baseBuild.c_str());
+    if (baseCpu != machine.cpu || baseBuild != machine.build) {
+        printf("warning: this is %s (%s build); timings may not be comparable.\n", machine.cpu.c_str(), machine.build.c_str());
+    }
+    if (baseConfig && (int)baseConfig->num("threads", 0) != rc.threads) {
+        printf("warning: baseline ran %d threads, this run %d.\n", (int)baseConfig->num("threads", 0), rc.threads);
+    }
+
+    const JsonValue* scenarios = baseline.get("scenarios");
+    std::vector<std::string> regressions;
+    bool anyActiveRows = false;
+    printf("\n  %-11s %-13s %12s %12s %9s %16s\n", "scenario", "stage", "base p50 us", "p50 us", "change", "allocs/frame");
+    for (int s = 0; s < REGRESSION_SUITE_SIZE; ++s) {
+        const char* name = SCENARIO_NAMES[REGRESSION_SUITE[s]];
+        const JsonValue* base = scenarios ? scenarios->get(name) : nullptr;
+        for (int r = 0; r < BENCH_ROWS; ++r) {
+            const JsonValue* row = base ? base->get(row_name(r)) : nullptr;
+            double cur = stats[s][r].p50Ns * 1e-3;
+            double curAllocs = stats[s][r].allocsPerFrame;
+            if (!row) {
+                printf("  %-11s %-13s %12s %12.1f %9s %16.2f  new\n", name, row_name(r), "-", cur, "", curAllocs);
+                continue;
+            }
+            double prev = row->num("p50_us", 0.0);
+            // A stage idle on most frames compares the frames it ran in; a baseline
+            // from before active_p50_us was recorded falls back to the mean.
+            bool activeRow = prev <= 0.0;
+            if (activeRow) {
+                prev = row->num("active_p50_us", row->num("mean_us", 0.0));
+                cur = stats[s][r].activeP50Ns * 1e-3;
+                anyActiveRows = true;
+            }
+            double prevAllocs = row->num("allocs_per_frame", 0.0);
+            double change = prev > 0.0 ? (cur - prev) / prev * 100.0 : 0.0;
+            // A stage that cost nothing before is slower once it costs minUs at all.
+            bool slower = prev > 0.0 ? change > rc.thresholdPct && std::max(cur, prev) >= rc.minUs : cur >= rc.minUs;
+            bool allocating = curAllocs > prevAllocs * (1.0 + rc.thresholdPct / 100.0) + 0.5;
+
+            char allocText[32], changeText[16], stageText[32];
+            snprintf(allocText, sizeof(allocText), "%.2f -> %.2f", prevAllocs, curAllocs);
+            if (prev > 0.0) snprintf(changeText, sizeof(changeText), "%+8.1f%%", change);
+            else snprintf(changeText, sizeof(changeText), "%9s", cur > 0.0 ? "was 0" : "");
+            snprintf(stageText, sizeof(stageText), "%s%s", row_name(r), activeRow ? "*" : "");
+            const char* mark = slower || allocating ? "  REGRESSED" : (change < -rc.thresholdPct && prev >= rc.minUs ? "  faster" : "");
+            printf("  %-11s %-13s %12.1f %12.1f %s %16s%s\n", name, stageText, prev, cur, changeText, allocText, mark);
+
+            char what[160];
+            if (slower && prev <= 0.0) {
+                snprintf(what, sizeof(what), "%s/%s: 0 us -> %.1f us", name, stageText, cur);
+                regressions.push_back(what);
+            }
+            else if (slower) {
+                snprintf(what, sizeof(what), "%s/%s: %.1f us -> %.1f us (%+.1f%%)", name, stageText, prev, cur, change);
+                regressions.push_back(what);
+            }
+            if (allocating) {
+                snprintf(what, sizeof(what), "%s/%s: %.2f -> %.2f allocations per frame", name, row_name(r), prevAllocs, curAllocs);
+                regressions.push_back(what);
+            }
+        }
+    }
+
+    if (anyActiveRows) printf("  * p50 over the frames the stage ran in; its p50 over all frames is 0.\n");
+
+    if (regressions.empty()) {
+        printf("\nNo stage regressed past %.0f%%.\n", rc.thresholdPct);
+        return 0;
+    }
+    printf("\n%zu regression%s past %.0f%%:\n", regressions.size(), regressions.size() == 1 ? "" : "s", rc.thresholdPct);
+    for (const std::string& r : regressions) printf("  %s\n", r.c_str());
+    return 1;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+// 0 in the SimBench console target (SimBench.vcxproj), which links only SimCore:
+// the render batch row and the audio and sprite kernels need the SDL frontend and
+// are left out. The game binary builds every benchmark.
+#ifndef BENCH_FRONTEND
+#define BENCH_FRONTEND 1
+#endif
+
+// Headless simulation benchmark, run with --bench-sim. Steps a World through a
+// scripted scenario without a window or audio and reports per-stage frame times
+// (mean, p50, p99 and ns per particle) as JSON on stdout, with a summary table on
+// stderr.
+//
+//   --particles N --players N --threads N --seed S --frames F --warmup F
+//   --world W H --sparse-grid
+//   --scenario idle|sweep|meteors|brush|explosions|mix
+//   --json PATH        write the JSON to a file instead of stdout
+//   --profile PATH     record profiler zones for the run and write a Chrome trace
+//   --hw-counters      read cycles, instructions, L1D/LLC and branch misses per
+//                      stage and per pool worker (Linux perf_event_open)
+//   --hw-csv PATH      also write those counts for every frame and stage as CSV
+//
+// Returns the process exit code.
+int run_sim_benchmark(int argc, char* argv[]);
+
+// Kernel microbenchmarks, run with --bench-kernels. Each hot function is timed on
+// its own against a prepared World, restored from a snapshot before every call,
+// over synthetic particle layouts: uniform, pooled at the bottom, and one dense
+// cluster. Reports min and median per call and ns per item.
+//
+//   --particles N --players N --threads N --seed S --repeats R
+//   --kernel NAME --dist uniform|pooled|cluster --json PATH
+int run_kernel_benchmark(int argc, char* argv[]);
+
+// Regression runner, run with --bench-regress. Runs a fixed set of scenarios, best
+// of several runs each, and compares every stage's median time and allocations per
+// frame with a baseline JSON (perf-baseline.json) that also records the machine it
+// came from. Stages that skip most frames compare their median over the frames
+// they ran in. Exits 1 with the offending stages listed when any of them regressed
+// past the threshold, 2 when there is no baseline.
+//
+//   --baseline PATH --threshold PCT --min-us US --repeats R --threads N --frames F
+//   --write-baseline   record a new baseline instead of comparing
+int run_regression(int argc, char* argv[]);
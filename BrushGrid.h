@@ -0,0 +1,77 @@
+#pragma once
+#include "SimTypes.h"
+#include "CellTable.h"
+#include "AllocCounter.h"
+#include <vector>
+
+const float BRUSH_GRID_CELL_SIZE = 100.0f;
+
+// Unabsorbed brushes bucketed by BRUSH_GRID_CELL_SIZE cell. Brushes are stored as
+// indices into the brush list, in list order within a cell, and only occupied
+// cells get a bucket, so a rebuild costs the brush count, not the world area.
+class BrushGrid {
+public:
+    int cols = 0, rows = 0;
+    // Brush indices, cell by cell; a cell's run is items[cellStart[c] .. + cellCount[c]).
+    std::vector<int> cellStart;
+    std::vector<int> cellCount;
+    std::vector<int> items;
+
+    explicit BrushGrid(bool sparseCells = false) : sparse(sparseCells) {}
+
+    void resize(int worldWidth, int worldHeight) {
+        MemScope mem(MEM_SIMULATION);
+        cols = worldWidth / (int)BRUSH_GRID_CELL_SIZE + 1;
+        rows = worldHeight / (int)BRUSH_GRID_CELL_SIZE + 1;
+        if (sparse) table.set_sparse();
+        else table.set_dense(cols, rows);
+        cellStart.clear();
+        cellCount.clear();
+        items.clear();
+    }
+
+    static int cell_of(float v) { return (int)(v / BRUSH_GRID_CELL_SIZE); }
+
+    void rebuild(const std::vector<BrushParticle>& brushes) {
+        table.clear(brushes.size());
+        cellCount.clear();
+        brushSlot.resize(brushes.size());
+        for (size_t k = 0; k < brushes.size(); ++k) {
+            brushSlot[k] = -1;
+            if (brushes[k].absorbed) continue;
+            int cx = cell_of(brushes[k].x), cy = cell_of(brushes[k].y);
+            if (cx < 0 || cx >= cols || cy < 0 || cy >= rows) continue;
+            int slot = table.insert(cx, cy);
+            if (slot == (int)cellCount.size()) cellCount.push_back(0);
+            cellCount[slot]++;
+            brushSlot[k] = slot;
+        }
+
+        int cellNum = (int)cellCount.size();
+        cellStart.resize(cellNum);
+        int offset = 0;
+        for (int c = 0; c < cellNum; ++c) {
+            cellStart[c] = offset;
+            offset += cellCount[c];
+        }
+
+        items.resize(offset);
+        fillOffsets.assign(cellStart.begin(), cellStart.end());
+        for (size_t k = 0; k < brushes.size(); ++k) {
+            if (brushSlot[k] >= 0) items[fillOffsets[brushSlot[k]]++] = (int)k;
+        }
+    }
+
+    // Index into cellStart/cellCount, or -1 when the cell is outside the grid or
+    // holds no brush.
+    int find_cell(int cx, int cy) const {
+        if (cx < 0 || cx >= cols || cy < 0 || cy >= rows) return -1;
+        return table.find(cx, cy);
+    }
+
+private:
+    bool sparse;
+    CellTable table;
+    std::vector<int> brushSlot;
+    std::vector<int> fillOffsets;
+};
@@ -0,0 +1,102 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Numbers the cells touched in a frame 0, 1, 2... in first-touch order, so per-cell
+// data can live in arrays sized by the occupied count. Dense keeps a slot per cell
+// of a cols x rows area and clear() resets only the cells it numbered; sparse
+// hashes the cell coordinates, so nothing scales with the area at all.
+class CellTable {
+public:
+    // Dense over cols x rows; callers keep their cells inside it.
+    void set_dense(int cols, int rows) {
+        denseCols = cols;
+        slotOf.assign((size_t)cols * rows, -1);
+        keys.clear();
+        slotCx.clear();
+        slotCy.clear();
+        slotCx.reserve((size_t)cols * rows);
+        slotCy.reserve((size_t)cols * rows);
+    }
+
+    void set_sparse() {
+        denseCols = 0;
+        slotOf.clear();
+        keys.clear();
+        slotCx.clear();
+        slotCy.clear();
+    }
+
+    // Forgets every cell. A sparse table is sized for at most maxCells inserts.
+    void clear(size_t maxCells) {
+        if (denseCols > 0) {
+            for (size_t s = 0; s < slotCx.size(); ++s) slotOf[slotCx[s] + (size_t)slotCy[s] * denseCols] = -1;
+        }
+        else {
+            size_t capacity = 16;
+            while (capacity < maxCells * 2) capacity <<= 1;
+            keys.assign(capacity, EMPTY_KEY);
+            slots.resize(capacity);
+        }
+        slotCx.clear();
+        slotCy.clear();
+    }
+
+    // The cell's slot; a cell not seen since clear() gets the next one, size() - 1.
+    int insert(int cx, int cy) {
+        if (denseCols > 0) {
+            int& slot = slotOf[cx + (size_t)cy * denseCols];
+            if (slot < 0) slot = add_slot(cx, cy);
+            return slot;
+        }
+        uint64_t key = pack_key(cx, cy);
+        size_t mask = keys.size() - 1;
+        size_t h = hash_key(key, mask);
+        while (keys[h] != key && keys[h] != EMPTY_KEY) h = (h + 1) & mask;
+        if (keys[h] == EMPTY_KEY) {
+            keys[h] = key;
+            slots[h] = add_slot(cx, cy);
+        }
+        return slots[h];
+    }
+
+    // The cell's slot, or -1 if nothing touched it since clear().
+    int find(int cx, int cy) const {
+        if (denseCols > 0) return slotOf[cx + (size_t)cy * denseCols];
+        if (keys.empty()) return -1;
+        uint64_t key = pack_key(cx, cy);
+        size_t mask = keys.size() - 1;
+        for (size_t h = hash_key(key, mask); ; h = (h + 1) & mask) {
+            if (keys[h] == key) return slots[h];
+            if (keys[h] == EMPTY_KEY) return -1;
+        }
+    }
+
+    int size() const { return (int)slotCx.size(); }
+    int cell_x(int slot) const { return slotCx[slot]; }
+    int cell_y(int slot) const { return slotCy[slot]; }
+
+private:
+    static constexpr uint64_t EMPTY_KEY = ~0ull;
+
+    int denseCols = 0;
+    std::vector<int> slotOf;
+    std::vector<uint64_t> keys;
+    std::vector<int> slots;
+    std::vector<int> slotCx, slotCy;
+
+    int add_slot(int cx, int cy) {
+        slotCx.push_back(cx);
+        slotCy.push_back(cy);
+        return (int)slotCx.size() - 1;
+    }
+
+    static uint64_t pack_key(int cx, int cy) {
+        return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+    }
+
+    static size_t hash_key(uint64_t key, size_t mask) {
+        return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 17) & mask;
+    }
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include "SimTypes.h"
+#include "CellTable.h"
+#include "AllocCounter.h"
+#include <vector>
+
+// Particle counts per DENSITY_BUFFER_SCALE cell, for the water's pressure
+// gradient and the drop test. Only cells holding a particle get a count, so a
+// rebuild costs the particle count, not the world area: dense mode resets just
+// the cells the last frame touched, sparse mode hashes them like the sparse grid.
+class DensityGrid {
+public:
+    int width = 0, height = 0;  // in cells
+
+    explicit DensityGrid(bool sparseCells = false) : sparse(sparseCells) {}
+
+    void resize(int worldWidth, int worldHeight) {
+        MemScope mem(MEM_SIMULATION);
+        width = worldWidth / DENSITY_BUFFER_SCALE;
+        height = worldHeight / DENSITY_BUFFER_SCALE;
+        if (sparse) table.set_sparse();
+        else table.set_dense(width, height);
+        counts.clear();
+        if (!sparse) counts.reserve((size_t)width * height);
+    }
+
+    void rebuild(const std::vector<Particle>& particles) {
+        table.clear(particles.size());
+        counts.clear();
+        for (const auto& p : particles) {
+            int bx = (int)(p.x / DENSITY_BUFFER_SCALE), by = (int)(p.y / DENSITY_BUFFER_SCALE);
+            if (bx < 0 || bx >= width || by < 0 || by >= height) continue;
+            int slot = table.insert(bx, by);
+            if (slot == (int)counts.size()) counts.push_back(0.0f);
+            counts[slot] += 1.0f;
+        }
+    }
+
+    // 0 outside the grid and in cells no particle is in.
+    float at(int bx, int by) const {
+        if (bx < 0 || bx >= width || by < 0 || by >= height) return 0.0f;
+        int slot = table.find(bx, by);
+        return slot < 0 ? 0.0f : counts[slot];
+    }
+
+private:
+    bool sparse;
+    CellTable table;
+    std::vector<float> counts;
+};
@@ -0,0 +1 @@
+#include "FrameGraph.h"
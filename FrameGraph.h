@@ -0,0 +1,226 @@
+#pragma once
+#include "Profiler.h"
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+// Shared state a frame stage may touch.
+enum FrameResource : uint32_t {
+    RES_PARTICLES = 1u << 0,
+    RES_DENSITY = 1u << 1,
+    RES_BRUSHES = 1u << 2,
+    RES_FRAGMENTS = 1u << 3,
+    RES_PLAYER = 1u << 4,     // swarm centre and average velocity
+    RES_MODES = 1u << 5,      // sun / rainbow flags and their timers
+    RES_CAMERA = 1u << 6,
+    RES_METEORS = 1u << 7,
+    RES_RENDERER = 1u << 8,
+    RES_RANDOM = 1u << 9,     // world.rng
+    RES_ALL = ~0u
+};
+
+// The main loop as a graph of stages. Stages are added once in program order with
+// the resources they read and write; a stage waits for every earlier stage it
+// conflicts with (read-after-write, write-after-read, write-after-write) and
+// otherwise runs alongside them. Stages that need the SDL thread are flagged
+// mainThread and only ever run on the caller of run().
+class FrameGraph {
+public:
+    FrameGraph(size_t num_threads) {
+        busy_ms.assign(num_threads + 1, 0.0);
+        for (size_t i = 0; i < num_threads; ++i) {
+            lanes.emplace_back(&FrameGraph::lane_loop, this, i + 1);
+        }
+    }
+
+    ~FrameGraph() {
+        {
+            std::unique_lock<std::mutex> lock(graph_mutex);
+            stop_flag = true;
+        }
+        cv_ready.notify_all();
+        for (std::thread& lane : lanes) {
+            if (lane.joinable()) lane.join();
+        }
+    }
+
+    // Returns the stage's index, for stage_ms().
+    int add_stage(const char* name, uint32_t reads, uint32_t writes, std::function<void()> fn, bool mainThread = false) {
+        Stage s;
+        s.name = name;
+        s.reads = reads;
+        s.writes = writes;
+        s.fn = std::move(fn);
+        s.mainThread = mainThread;
+
+        int idx = (int)stages.size();
+        for (int j = 0; j < idx; ++j) {
+            const Stage& e = stages[j];
+            if ((e.writes & (reads | writes)) || (e.reads & writes)) {
+                s.deps.push_back(j);
+                stages[j].dependents.push_back(idx);
+            }
+        }
+        stages.push_back(std::move(s));
+        return idx;
+    }
+
+    void run() {
+        frame_start = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(graph_mutex);
+            finished = 0;
+            std::fill(busy_ms.begin(), busy_ms.end(), 0.0);
+            for (size_t i = 0; i < stages.size(); ++i) {
+                stages[i].pending = (int)stages[i].deps.size();
+                if (stages[i].pending == 0) enqueue((int)i);
+            }
+        }
+        cv_ready.notify_all();
+
+        // The caller works too: it owns the main-thread stages and helps with the rest.
+        std::unique_lock<std::mutex> lock(graph_mutex);
+        while (finished < stages.size()) {
+            int idx = -1;
+            if (!main_ready.empty()) { idx = main_ready.front(); main_ready.pop_front(); }
+            else if (!ready.empty()) { idx = ready.front(); ready.pop_front(); }
+
+            if (idx < 0) {
+                cv_main.wait(lock);
+                continue;
+            }
+
+            lock.unlock();
+            execute(idx, 0);
+            lock.lock();
+        }
+        frame_end = std::chrono::steady_clock::now();
+    }
+
+    // Timings of the last frame. Lane 0 is the thread that calls run().
+    double stage_ms(int idx) const { return stages[idx].duration_ms; }
+    size_t lane_count() const { return lanes.size() + 1; }
+    double lane_busy_ms(size_t lane) const { return busy_ms[lane]; }
+    double frame_ms() const { return std::chrono::duration<double, std::milli>(frame_end - frame_start).count(); }
+
+    // Longest chain of dependent stages in the last frame, the part no amount of
+    // extra threads can shorten, then the slack of every stage off that chain.
+    void dump_critical_path(FILE* out) const {
+        size_t n = stages.size();
+        if (n == 0) return;
+
+        std::vector<double> finish(n, 0.0);
+        std::vector<int> via(n, -1);
+        for (size_t i = 0; i < n; ++i) {
+            double start = 0.0;
+            for (int d : stages[i].deps) {
+                if (finish[d] > start) { start = finish[d]; via[i] = d; }
+            }
+            finish[i] = start + stages[i].duration_ms;
+        }
+
+        size_t last = 0;
+        for (size_t i = 1; i < n; ++i) if (finish[i] > finish[last]) last = i;
+
+        // Slack: how much longer a stage could run before it would stretch the path.
+        std::vector<double> latest(n, finish[last]);
+        for (size_t i = n; i-- > 0;) {
+            for (int d : stages[i].dependents) {
+                double need = latest[d] - stages[d].duration_ms;
+                if (need < latest[i]) latest[i] = need;
+            }
+        }
+
+        std::vector<char> onPath(n, 0);
+        std::vector<int> path;
+        for (int i = (int)last; i >= 0; i = via[i]) { path.push_back(i); onPath[i] = 1; }
+
+        double frame_ms = std::chrono::duration<double, std::milli>(frame_end - frame_start).count();
+        fprintf(out, "frame graph: %.2f ms frame, %.2f ms critical path\n", frame_ms, finish[last]);
+        for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            const Stage& s = stages[*it];
+            fprintf(out, "  * %-18s %7.3f ms  (started %.3f)\n", s.name, s.duration_ms, s.start_ms);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if (onPath[i]) continue;
+            const Stage& s = stages[i];
+            fprintf(out, "    %-18s %7.3f ms  (started %.3f, slack %.3f)\n", s.name, s.duration_ms, s.start_ms, latest[i] - finish[i]);
+        }
+    }
+
+private:
+    struct Stage {
+        const char* name = "";
+        uint32_t reads = 0, writes = 0;
+        std::function<void()> fn;
+        bool mainThread = false;
+        std::vector<int> deps;
+        std::vector<int> dependents;
+        int pending = 0;
+        double start_ms = 0.0, duration_ms = 0.0;
+    };
+
+    // Caller holds graph_mutex.
+    void enqueue(int idx) {
+        if (stages[idx].mainThread) main_ready.push_back(idx);
+        else ready.push_back(idx);
+    }
+
+    void execute(int idx, size_t lane) {
+        Stage& s = stages[idx];
+        auto t0 = std::chrono::steady_clock::now();
+        {
+            PROFILE_ZONE(s.name);
+            s.fn();
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        s.start_ms = std::chrono::duration<double, std::milli>(t0 - frame_start).count();
+        s.duration_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        busy_ms[lane] += s.duration_ms;
+
+        {
+            std::unique_lock<std::mutex> lock(graph_mutex);
+            for (int d : s.dependents) {
+                if (--stages[d].pending == 0) enqueue(d);
+            }
+            finished++;
+        }
+        cv_ready.notify_all();
+        cv_main.notify_one();
+    }
+
+    void lane_loop(size_t lane) {
+        PROFILE_THREAD("frame lane");
+        while (true) {
+            int idx;
+            {
+                std::unique_lock<std::mutex> lock(graph_mutex);
+                cv_ready.wait(lock, [this] { return stop_flag || !ready.empty(); });
+                if (stop_flag) return;
+                idx = ready.front();
+                ready.pop_front();
+            }
+            execute(idx, lane);
+        }
+    }
+
+    std::vector<Stage> stages;
+    std::vector<std::thread> lanes;
+    std::deque<int> ready;
+    std::deque<int> main_ready;
+    size_t finished = 0;
+    std::chrono::steady_clock::time_point frame_start, frame_end;
+    std::vector<double> busy_ms;   // per lane, written only by that lane
+
+    std::mutex graph_mutex;
+    std::condition_variable cv_ready;
+    std::condition_variable cv_main;
+    bool stop_flag = false;
+};
@@ -1,26 +1,32 @@
 ﻿#include "GameLogic.h"
-#include "AudioSystem.h"
-void spawnExplosionFragments(float x, float y) {
-    if (rainbowFragments.size() > MAX_RAINBOW_FRAGMENTS) return;
+
+void push_rainbow_fragment(World& world, RainbowFragment rf) {
+    if (rf.size < 1.5f || rf.life <= 0.0f) return;
+    rf.invLife = 1.0f / rf.life;
+    world.rainbowFragments.insert(rf, (int)(rf.life / FRAGMENT_DT) + 1);
+}
+
+void spawnExplosionFragments(World& world, float x, float y) {
+    if (world.rainbowFragments.size() > MAX_RAINBOW_FRAGMENTS) return;
 
     int count = 60;
 
     for (int i = 0; i < count; ++i) {
-        if (rainbowFragments.size() >= MAX_RAINBOW_FRAGMENTS) break;
+        if (world.rainbowFragments.size() >= MAX_RAINBOW_FRAGMENTS) break;
 
         RainbowFragment rf;
-        float angle = (float)(rand() % 628) / 100.0f;
+        float angle = (float)(world.random() % 628) / 100.0f;
 
-        float speed = 3.0f + (float)(rand() % 600) / 100.0f;
+        float speed = 3.0f + (float)(world.random() % 600) / 100.0f;
 
         rf.x = x;
         rf.y = y;
         rf.vx = cos(angle) * speed;
         rf.vy = sin(angle) * speed;
         rf.t = 0.0f;
-        rf.life = 0.8f + (rand() % 100) / 100.0f;
+        rf.life = 0.8f + (world.random() % 100) / 100.0f;
 
-        rf.size = 15.0f + (rand() % 40);
+        rf.size = 15.0f + (world.random() % 40);
         rf.alpha0 = 1.0f;
         rf.h = 0.0f;
 
@@ -31,27 +37,12 @@ void spawnExplosionFragments(float x, float y) {
             rf.type = 4;
         }
 
-        rainbowFragments.push_back(rf);
-    }
-}
-
-void HSVtoRGB(float h, float s, float v, Uint8& r, Uint8& g, Uint8& b) {
-    int i = int(h * 6);
-    float f = h * 6 - i;
-    float p = v * (1 - s);
-    float q = v * (1 - f * s);
-    float t = v * (1 - (1 - f) * s);
-    switch (i % 6) {
-    case 0: r = v * 255; g = t * 255; b = p * 255; break;
-    case 1: r = q * 255; g = v * 255; b = p * 255; break;
-    case 2: r = p * 255; g = v * 255; b = t * 255; break;
-    case 3: r = p * 255; g = q * 255; b = v * 255; break;
-    case 4: r = t * 255; g = p * 255; b = v * 255; break;
-    case 5: r = v * 255; g = p * 255; b = q * 255; break;
+        push_rainbow_fragment(world, rf);
     }
 }
 
-void spawnRainbowFragments(float x, float y, float t, float intensity) {
+void spawnRainbowFragments(World& world, float x, float y, float t, float intensity) {
+    FragmentWheel& rainbowFragments = world.rainbowFragments;
     int spawnCount = static_cast<int>(60 * intensity);
     if (spawnCount < 10) spawnCount = 10;
 
@@ -59,8 +50,7 @@ void spawnRainbowFragments(float x, float y, float t, float intensity) {
     if (current_size + spawnCount > MAX_RAINBOW_FRAGMENTS) {
         int to_remove = current_size + spawnCount - MAX_RAINBOW_FRAGMENTS;
         if (to_remove > 0 && to_remove < (int)rainbowFragments.size()) {
-            rainbowFragments.erase(rainbowFragments.begin(),
-                                   rainbowFragments.begin() + to_remove);
+            rainbowFragments.retire_soonest(to_remove);
         }
     }
 
@@ -69,8 +59,8 @@ void spawnRainbowFragments(float x, float y, float t, float intensity) {
     for (int i = 0; i < spawnCount; ++i) {
 
         float angle = ((float)i / spawnCount) * 2.0f * 3.14159f * PHI;
-        float dist_from_center = 1.0f + (rand() % 100 / 100.0f) * 20.0f;
-        float initial_speed    = 1.5f + (rand() % 100 / 100.0f) * 2.5f;
+        float dist_from_center = 1.0f + (world.random() % 100 / 100.0f) * 20.0f;
+        float initial_speed    = 1.5f + (world.random() % 100 / 100.0f) * 2.5f;
 
         float radial_vx     = std::cos(angle) * initial_speed;
         float radial_vy     = std::sin(angle) * initial_speed;
@@ -81,9 +71,9 @@ void spawnRainbowFragments(float x, float y, float t, float intensity) {
         float vy = radial_vy + tangential_vy;
 
         float h      = std::fmod(angle / (2.0f * 3.14159f) + t * 0.1f, 1.0f);
-        float life   = 1.0f + (rand() % 100 / 100.0f) * 1.5f;
-        float size   = 5.0f + (rand() % 100 / 100.0f) * 15.0f;
-        float alpha0 = 0.6f + (rand() % 100 / 100.0f) * 0.4f;
+        float life   = 1.0f + (world.random() % 100 / 100.0f) * 1.5f;
+        float size   = 5.0f + (world.random() % 100 / 100.0f) * 15.0f;
+        float alpha0 = 0.6f + (world.random() % 100 / 100.0f) * 0.4f;
 
         RainbowFragment rf;
         rf.x = x + radial_vx * dist_from_center * 0.1f;
@@ -99,19 +89,19 @@ void spawnRainbowFragments(float x, float y, float t, float intensity) {
         rf.alpha0 = alpha0;
         rf.type   = 0;
 
-        rainbowFragments.push_back(rf);
+        push_rainbow_fragment(world, rf);
     }
 }
 
-void spawnBrushParticle(float x, float y, int brushEffectMode) {
+void spawnBrushParticle(World& world, float x, float y, int brushEffectMode) {
     BrushParticle bp;
     bp.x = bp.baseX = x;
     bp.y = bp.baseY = y;
 
-    bp.baseSize = 60.0f + rand() % 30;
+    bp.baseSize = 60.0f + world.random() % 30;
 
     bp.t = 0.0f;
-    bp.phase = (float)(rand() % 628) / 100.0f;
+    bp.phase = (float)(world.random() % 628) / 100.0f;
     bp.impact = 0.0f;
     bp.highImpactFrames = 0;
     bp.dissolveFrame = 0;
@@ -126,18 +116,19 @@ void spawnBrushParticle(float x, float y, int brushEffectMode) {
     } else {
         bp.type = BRUSH_BLUE;
     }
-    brushParticles.push_back(bp);
+    world.brushParticles.push_back(bp);
 }
 
-void spawnMeteorDrop(float x, float y) {
+void spawnMeteorDrop(World& world, float x, float y) {
+    std::vector<BrushParticle>& brushParticles = world.brushParticles;
     int count = 100;
-    float randnum = rand() % 10 * 1.0f;
+    float randnum = world.random() % 10 * 1.0f;
     for (int i = 0; i < count; ++i) {
         if (brushParticles.size() >= MAX_BRUSH_PARTICLES) break;
         BrushParticle bp;
 
-        float r1 = (float)rand() / RAND_MAX;
-        float r2 = (float)rand() / RAND_MAX;
+        float r1 = world.random_unit();
+        float r2 = world.random_unit();
         float radius_distribution = sqrt(-2.0f * log(r1));
 
         float spread = 60.0f;
@@ -163,20 +154,85 @@ void spawnMeteorDrop(float x, float y) {
     }
 }
 
-void generateRainbowLUT() {
-    for (int i = 0; i < RAINBOW_LUT_SIZE; ++i) {
-        float h = (float)i / RAINBOW_LUT_SIZE;
-        float s = 0.7f + 0.3f * sin(h * 2.0f * 3.14159f * 2.0f);
-        float v = 0.8f + 0.2f * cos(h * 2.0f * 3.14159f * 3.0f);
+// Spawns and despawns are queued and applied together by apply_particle_spawns()
+// at the top of the physics step, so particles/forces never change size mid-frame.
+int spawnParticle(World& world, float x, float y, bool isPlayer) {
+    int id;
+    if (!world.freeParticleIds.empty()) { id = world.freeParticleIds.back(); world.freeParticleIds.pop_back(); }
+    else id = world.nextParticleId++;
+    if ((int)world.liveParticleIds.size() <= id) world.liveParticleIds.resize(id + 1, 0);
+    world.liveParticleIds[id] = 1;
+
+    world.pendingSpawns.emplace_back(x, y, isPlayer);
+    world.pendingSpawns.back().id = id;
+    return id;
+}
 
-        Uint8 r, g, b;
-        HSVtoRGB(h, s, v, r, g, b);
-        rainbowColorLUT[i] = { r, g, b, 255 };
+void despawnParticle(World& world, int id) {
+    if (id < 0 || id >= world.nextParticleId || !world.liveParticleIds[id]) return;
+    if ((int)world.pendingDespawn.size() < world.nextParticleId) world.pendingDespawn.resize(world.nextParticleId, 0);
+    world.pendingDespawn[id] = 1;
+    world.hasPendingDespawn = true;
+}
+
+int reserveParticleIds(World& world, int count) {
+    int first = world.nextParticleId;
+    world.nextParticleId += count;
+    world.liveParticleIds.resize(world.nextParticleId, 0);
+    return first;
+}
+
+void apply_particle_spawns(World& world) {
+    std::vector<Particle>& particles = world.particles;
+    std::vector<Particle>& pendingSpawns = world.pendingSpawns;
+    std::vector<char>& pendingDespawn = world.pendingDespawn;
+    std::vector<int>& freeParticleIds = world.freeParticleIds;
+    std::vector<char>& liveParticleIds = world.liveParticleIds;
+    if (world.hasPendingDespawn) {
+        size_t count = particles.size();
+        for (size_t i = 0; i < count; ) {
+            int id = particles[i].id;
+            if (id < (int)pendingDespawn.size() && pendingDespawn[id]) {
+                pendingDespawn[id] = 0;
+                liveParticleIds[id] = 0;
+                freeParticleIds.push_back(id);
+                particles[i] = particles[count - 1];
+                count--;
+            }
+            else {
+                i++;
+            }
+        }
+        particles.resize(count);
+
+        for (auto& p : pendingSpawns) {
+            if (p.id < (int)pendingDespawn.size() && pendingDespawn[p.id]) {
+                pendingDespawn[p.id] = 0;
+                liveParticleIds[p.id] = 0;
+                freeParticleIds.push_back(p.id);
+                p.id = -1;
+            }
+        }
+        world.hasPendingDespawn = false;
+    }
+
+    for (const auto& p : pendingSpawns) {
+        if (p.id >= 0) particles.push_back(p);
     }
+    pendingSpawns.clear();
+
+    if (world.forces.size() != particles.size()) world.forces.resize(particles.size());
 }
 
-void update_brush_painting(bool painting, int brushEffectMode, float centerX, float centerY, float& lastBrushX, float& lastBrushY, float& lastVelX, float& lastVelY) {
-    if (painting) {
+void update_brush_painting(World& world, const SimInput& in) {
+    MemScope mem(MEM_SIMULATION);
+    const int brushEffectMode = in.brushEffectMode;
+    const float centerX = world.centerX, centerY = world.centerY;
+    float& lastBrushX = world.lastBrushX;
+    float& lastBrushY = world.lastBrushY;
+    float& lastVelX = world.lastVelX;
+    float& lastVelY = world.lastVelY;
+    if (in.brushMode && in.painting) {
         float dist = sqrt((centerX - lastBrushX) * (centerX - lastBrushX) + (centerY - lastBrushY) * (centerY - lastBrushY));
         if (dist > 1.0f) {
             float currentVelX = centerX - lastBrushX; float currentVelY = centerY - lastBrushY;
@@ -190,7 +246,7 @@ void update_brush_painting(bool painting, int brushEffectMode, float centerX, fl
                 float h10 = t3 - 2 * t2 + t; float h11 = t3 - t2;
                 float ix = h00 * lastBrushX + h01 * centerX + h10 * lastVelX + h11 * currentVelX;
                 float iy = h00 * lastBrushY + h01 * centerY + h10 * lastVelY + h11 * currentVelY;
-                spawnBrushParticle(ix, iy, brushEffectMode);
+                spawnBrushParticle(world, ix, iy, brushEffectMode);
             }
             lastBrushX = centerX; lastBrushY = centerY;
             lastVelX = currentVelX; lastVelY = currentVelY;
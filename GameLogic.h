@@ -1,10 +1,16 @@
 #pragma once
-#include "GameConfig.h"
+#include "World.h"
 
-void HSVtoRGB(float h, float s, float v, Uint8& r, Uint8& g, Uint8& b);
-void generateRainbowLUT();
-void spawnExplosionFragments(float x, float y);
-void spawnRainbowFragments(float x, float y, float t, float intensity = 1.0f);
-void spawnBrushParticle(float x, float y, int brushEffectMode);
-void spawnMeteorDrop(float x, float y);
-void update_brush_painting(bool painting, int brushEffectMode, float centerX, float centerY, float& lastBrushX, float& lastBrushY, float& lastVelX, float& lastVelY);
\ No newline at end of file
+void push_rainbow_fragment(World& world, RainbowFragment rf);
+void spawnExplosionFragments(World& world, float x, float y);
+void spawnRainbowFragments(World& world, float x, float y, float t, float intensity = 1.0f);
+void spawnBrushParticle(World& world, float x, float y, int brushEffectMode);
+void spawnMeteorDrop(World& world, float x, float y);
+int spawnParticle(World& world, float x, float y, bool isPlayer);
+void despawnParticle(World& world, int id);
+// Takes `count` consecutive ids, starting at the returned one, for particles that
+// live outside this world (slab water). They are never live here, so
+// despawnParticle() ignores them, and they never reach the free list.
+int reserveParticleIds(World& world, int count);
+void apply_particle_spawns(World& world);
+void update_brush_painting(World& world, const SimInput& in);
\ No newline at end of file
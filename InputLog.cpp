@@ -0,0 +1,166 @@
+#include "InputLog.h"
+#include <cstring>
+
+static const char LOG_MAGIC[8] = { 'I', 'N', 'P', 'U', 'T', 'L', 'O', 'G' };
+
+void input_log_init_header(InputLogHeader& header) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC));
+    header.version = INPUT_LOG_VERSION;
+}
+
+bool input_event_affects_simulation(const SDL_Event& e) {
+    switch (e.type) {
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+        return e.button.button == SDL_BUTTON_LEFT || e.button.button == SDL_BUTTON_RIGHT;
+    case SDL_WINDOWEVENT:
+        return e.window.event == SDL_WINDOWEVENT_RESIZED;
+    case SDL_KEYDOWN: {
+        SDL_Keycode k = e.key.keysym.sym;
+        return k == SDLK_1 || k == SDLK_2 || k == SDLK_3 || k == SDLK_F4;
+    }
+    default:
+        return false;
+    }
+}
+
+static void write_varint(FILE* f, uint32_t v) {
+    while (v >= 0x80) {
+        fputc((int)(v & 0x7f) | 0x80, f);
+        v >>= 7;
+    }
+    fputc((int)v, f);
+}
+
+static uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+static int32_t unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+bool InputRecorder::open(const char* path, const InputLogHeader& header) {
+    file = fopen(path, "wb");
+    if (!file) return false;
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    lastFrame = 0;
+    lastX = lastY = -1;
+    return true;
+}
+
+void InputRecorder::write(uint32_t frame, InputRecordType type, int32_t a, int32_t b) {
+    fputc(type, file);
+    write_varint(file, frame - lastFrame);
+    write_varint(file, zigzag(a));
+    write_varint(file, zigzag(b));
+    lastFrame = frame;
+}
+
+void InputRecorder::event(uint32_t frame, const SDL_Event& e) {
+    if (!file || !input_event_affects_simulation(e)) return;
+    switch (e.type) {
+    case SDL_MOUSEBUTTONDOWN: write(frame, INPUT_MOUSE_DOWN, e.button.button, 0); break;
+    case SDL_MOUSEBUTTONUP: write(frame, INPUT_MOUSE_UP, e.button.button, 0); break;
+    case SDL_KEYDOWN: write(frame, INPUT_KEY_DOWN, e.key.keysym.sym, e.key.repeat); break;
+    case SDL_WINDOWEVENT: write(frame, INPUT_RESIZE, e.window.data1, e.window.data2); break;
+    default: break;
+    }
+}
+
+void InputRecorder::mouse(uint32_t frame, int x, int y) {
+    if (!file || (x == lastX && y == lastY)) return;
+    write(frame, INPUT_MOUSE_MOVE, x, y);
+    lastX = x;
+    lastY = y;
+}
+
+void InputRecorder::close(uint32_t frame) {
+    if (!file) return;
+    write(frame, INPUT_END, 0, 0);
+    fclose(file);
+    file = nullptr;
+}
+
+static bool read_varint(const std::vector<unsigned char>& data, size_t& pos, uint32_t& out) {
+    out = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (pos >= data.size()) return false;
+        unsigned char byte = data[pos++];
+        out |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool InputReplay::open(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    std::vector<unsigned char> data;
+    unsigned char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + n);
+    fclose(f);
+
+    if (data.size() < sizeof(hdr)) return false;
+    memcpy(&hdr, data.data(), sizeof(hdr));
+    if (memcmp(hdr.magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0 || hdr.version != INPUT_LOG_VERSION) return false;
+
+    records.clear();
+    next = 0;
+    size_t pos = sizeof(hdr);
+    uint32_t frame = 0;
+    while (pos < data.size()) {
+        Record r;
+        uint32_t delta, a, b;
+        r.type = (InputRecordType)data[pos++];
+        if (!read_varint(data, pos, delta) || !read_varint(data, pos, a) || !read_varint(data, pos, b)) return false;
+        frame += delta;
+        r.frame = frame;
+        r.a = unzigzag(a);
+        r.b = unzigzag(b);
+        records.push_back(r);
+        if (r.type == INPUT_END) {
+            endFrame = frame;
+            return true;
+        }
+    }
+    // A log without its end record was cut short, e.g. by a crash.
+    return false;
+}
+
+bool InputReplay::frame(uint32_t frame, std::vector<SDL_Event>& events, int& mouseX, int& mouseY) {
+    events.clear();
+    while (next < records.size() && records[next].frame <= frame) {
+        const Record& r = records[next++];
+        SDL_Event e;
+        memset(&e, 0, sizeof(e));
+        switch (r.type) {
+        case INPUT_MOUSE_MOVE:
+            mouseX = r.a;
+            mouseY = r.b;
+            continue;
+        case INPUT_MOUSE_DOWN:
+        case INPUT_MOUSE_UP:
+            e.type = r.type == INPUT_MOUSE_DOWN ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+            e.button.button = (Uint8)r.a;
+            break;
+        case INPUT_KEY_DOWN:
+            e.type = SDL_KEYDOWN;
+            e.key.keysym.sym = r.a;
+            e.key.repeat = (Uint8)r.b;
+            break;
+        case INPUT_RESIZE:
+            e.type = SDL_WINDOWEVENT;
+            e.window.event = SDL_WINDOWEVENT_RESIZED;
+            e.window.data1 = r.a;
+            e.window.data2 = r.b;
+            break;
+        case INPUT_END:
+        default:
+            return false;
+        }
+        events.push_back(e);
+    }
+    return true;
+}
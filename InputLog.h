@@ -0,0 +1,91 @@
+#pragma once
+#include "GameConfig.h"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Input recording for deterministic replay. A log holds everything a run depends
+// on besides its input (the world's random seed, the pool size, particle counts and world
+// and window sizes), then one record per input change, stamped with the frame it
+// arrived on. The simulation steps a fixed time per frame, so feeding the same
+// records back on the same frames reproduces the run exactly, at any speed.
+//
+// Layout: InputLogHeader, then records of a type byte, the frame delta since the
+// previous record and the payload, both as LEB128 varints (the payload zigzagged).
+// The log ends with an INPUT_END record stamped with the number of frames run.
+const uint32_t INPUT_LOG_VERSION = 1;
+
+struct InputLogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t seed;
+    int32_t threads;
+    int32_t particles, players;
+    int32_t worldWidth, worldHeight;
+    int32_t screenWidth, screenHeight;
+    uint8_t worldFollowsScreen;
+    uint8_t sparseGrid;
+    uint8_t reserved[2];
+};
+
+enum InputRecordType : uint8_t {
+    INPUT_MOUSE_MOVE,     // window x, y
+    INPUT_MOUSE_DOWN,     // SDL button
+    INPUT_MOUSE_UP,
+    INPUT_KEY_DOWN,       // keycode, repeat
+    INPUT_RESIZE,         // width, height
+    INPUT_END
+};
+
+// Events that change what the simulation does. Everything else (quitting, the HUD,
+// the profiler) stays live during a replay and is left out of the log.
+bool input_event_affects_simulation(const SDL_Event& e);
+
+class InputRecorder {
+public:
+    ~InputRecorder() { close(lastFrame); }
+
+    bool open(const char* path, const InputLogHeader& header);
+    bool is_open() const { return file != nullptr; }
+    // Records the event if it affects the simulation.
+    void event(uint32_t frame, const SDL_Event& e);
+    // Records the mouse position when it has moved since the last call.
+    void mouse(uint32_t frame, int x, int y);
+    // Writes the end record, stamped with the number of frames run, and closes the file.
+    void close(uint32_t frame);
+
+private:
+    void write(uint32_t frame, InputRecordType type, int32_t a, int32_t b);
+
+    FILE* file = nullptr;
+    uint32_t lastFrame = 0;
+    int lastX = -1, lastY = -1;
+};
+
+class InputReplay {
+public:
+    // Reads the whole log; false if it is missing, truncated or another version.
+    bool open(const char* path);
+    const InputLogHeader& header() const { return hdr; }
+
+    // Turns the records stamped with this frame into SDL events and updates the
+    // mouse position if it moved. Returns false once the recorded run has ended
+    // and this frame should not be run.
+    bool frame(uint32_t frame, std::vector<SDL_Event>& events, int& mouseX, int& mouseY);
+    uint32_t frame_count() const { return endFrame; }
+
+private:
+    struct Record {
+        uint32_t frame;
+        InputRecordType type;
+        int32_t a, b;
+    };
+
+    InputLogHeader hdr = {};
+    std::vector<Record> records;
+    size_t next = 0;
+    uint32_t endFrame = 0;
+};
+
+// Fills in the magic and version of a header.
+void input_log_init_header(InputLogHeader& header);
@@ -3,6 +3,7 @@
 #define NOMINMAX
 
 #include <random>
+#include <cstring>
 #include "GameConfig.h"
 #include "SpatialGrid.h"
 #include "ThreadPool.h"
@@ -12,105 +13,193 @@
 #include "GameLogic.h"
 #include "keyjob.h"
 #include"Simulation.h"
+#include "SlabDomain.h"
+#include "FrameGraph.h"
+#include "AssetPack.h"
+#include "MusicAnalysis.h"
+#include "Benchmark.h"
+#include "Profiler.h"
+#include "InputLog.h"
 
 int SCREEN_WIDTH = 1280;
 int SCREEN_HEIGHT = 720;
+bool worldFollowsScreen = true;
+float cameraX = 0.0f, cameraY = 0.0f;
 float currentMusicEnergy = 0.0f;
 
 std::vector<SDL_Color> rainbowColorLUT(RAINBOW_LUT_SIZE);
-std::vector<Particle> particles;
-std::vector<Particle> particle_buffer;
-std::vector<Vector2D> forces;
-std::vector<RainbowFragment> rainbowFragments;
-std::vector<BrushParticle> brushParticles;
-std::vector<float> density_buffer;
-int density_buffer_width = 0;
-int density_buffer_height = 0;
 
 SynthSound blueSound;
 SynthSound rainbowSound;
 SynthSound explosionSound;
 
-std::vector<SynthSound*> sounds_to_play;
-std::mutex sounds_to_play_mutex;
 SDL_AudioDeviceID audioDevice = 0;
 
 thread_local std::minstd_rand rng_sampler;
 
-void calculate_player_cohesion_forces(std::vector<Vector2D>& forces);
-void calculate_mouse_interaction_forces(int mx, int my, bool leftDown, std::vector<Vector2D>& forces, bool playerSunMode);
-void apply_forces_to_particles(std::vector<Vector2D>& forces);
-void resolve_brush_collisions(bool brushMode, float avgVx, float avgVy, bool& playerRainbow, float& playerRainbowTimer, float& playerJumpTimer);
-void apply_heat_from_fragments(const SpatialGrid& grid);
+static void write_profile(const char* path) {
+    int zones = profiler_export_chrome_trace(path);
+    if (zones < 0) fprintf(stderr, "Could not write profile to %s\n", path);
+    else printf("Wrote %d zones to %s\n", zones, path);
+}
 
 int main(int argc, char* argv[]) {
-    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "best");
-    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
+    int worldWidth = SCREEN_WIDTH, worldHeight = SCREEN_HEIGHT;
+    int totalParticles = 2000;
+    int playerParticles = 300;
+    bool sparseGrid = false;
+    int slabCount = 0;
+    int audioFrames = 1024;
+    const char* assetPackPath = "assets.pack";
+    bool bakeOnly = false;
+    bool engineAudio = false;
+    const char* profilePath = "trace.json";
+    bool profileFromStart = false;
+    unsigned int seed = (unsigned int)time(0);
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    bool replayFast = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc) totalParticles = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--players") == 0 && i + 1 < argc) playerParticles = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--sparse-grid") == 0) sparseGrid = true;
+        else if (strcmp(argv[i], "--slabs") == 0 && i + 1 < argc) slabCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--low-latency") == 0) audioFrames = 256;
+        else if (strcmp(argv[i], "--audio-buffer") == 0 && i + 1 < argc) audioFrames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--bench-synth") == 0) { benchmark_sound_synthesis(stdout); return 0; }
+        else if (strcmp(argv[i], "--bench-sim") == 0) return run_sim_benchmark(argc, argv);
+        else if (strcmp(argv[i], "--bench-kernels") == 0) return run_kernel_benchmark(argc, argv);
+        else if (strcmp(argv[i], "--bench-regress") == 0) return run_regression(argc, argv);
+        else if (strcmp(argv[i], "--asset-pack") == 0 && i + 1 < argc) assetPackPath = argv[++i];
+        else if (strcmp(argv[i], "--bake-assets") == 0) bakeOnly = true;
+        else if (strcmp(argv[i], "--engine-audio") == 0) engineAudio = true;
+        else if (strcmp(argv[i], "--profile") == 0) {
+            profileFromStart = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') profilePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) recordPath = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replayPath = argv[++i];
+        else if (strcmp(argv[i], "--replay-fast") == 0) replayFast = true;
+        else if (strcmp(argv[i], "--world") == 0 && i + 2 < argc) {
+            worldWidth = atoi(argv[++i]);
+            worldHeight = atoi(argv[++i]);
+            worldFollowsScreen = false;
+            sparseGrid = true;
+        }
+    }
+    PROFILE_THREAD("main");
+    if (profileFromStart) profiler_start();
+    if (worldFollowsScreen) { worldWidth = SCREEN_WIDTH; worldHeight = SCREEN_HEIGHT; }
+    if (worldWidth < SCREEN_WIDTH) worldWidth = SCREEN_WIDTH;
+    if (worldHeight < SCREEN_HEIGHT) worldHeight = SCREEN_HEIGHT;
+    if (totalParticles < 1) totalParticles = 1;
+    if (playerParticles < 0) playerParticles = 0;
+    if (playerParticles > totalParticles) playerParticles = totalParticles;
+    if (audioFrames < 64) audioFrames = 64;
+    if (audioFrames > 4096) audioFrames = 4096;
 
+    if (bakeOnly) {
+        bool ok = asset_pack_bake(assetPackPath);
+        printf(ok ? "Baked %s.\n" : "Could not write %s.\n", assetPackPath);
+        return ok ? 0 : 1;
+    }
+
+    // A replay runs with the settings it was recorded with.
+    InputReplay replay;
+    const bool replaying = replayPath != nullptr;
     unsigned int n_threads = std::thread::hardware_concurrency();
     if (n_threads == 0) n_threads = 4;
+    if (replaying) {
+        if (!replay.open(replayPath)) {
+            fprintf(stderr, "Could not read input log %s.\n", replayPath);
+            return 1;
+        }
+        const InputLogHeader& h = replay.header();
+        seed = h.seed;
+        n_threads = (unsigned int)h.threads;
+        totalParticles = h.particles;
+        playerParticles = h.players;
+        worldWidth = h.worldWidth;
+        worldHeight = h.worldHeight;
+        SCREEN_WIDTH = h.screenWidth;
+        SCREEN_HEIGHT = h.screenHeight;
+        worldFollowsScreen = h.worldFollowsScreen != 0;
+        sparseGrid = h.sparseGrid != 0;
+        printf("Replaying %s: %u frames, seed %u.\n", replayPath, replay.frame_count(), seed);
+    }
+    // The slab processes step on their own clocks, so their runs cannot be replayed.
+    if ((recordPath || replaying) && slabCount > 1) {
+        printf("Input logs need the water in this process; ignoring --slabs.\n");
+        slabCount = 0;
+    }
+
+    World world(worldWidth, worldHeight, sparseGrid);
+    world.events = audio_events();
+    world.rng.seed(seed);
+
+    // Slab processes are forked before SDL or any thread exists. They own the water,
+    // so the world cannot follow later window resizes.
+    if (slabCount > 1) {
+        worldFollowsScreen = false;
+        if (!slab_domain_start(world, slabCount, totalParticles - playerParticles, playerParticles)) printf("Slab processes unavailable; simulating in one process.\n");
+    }
+
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "best");
+    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
+
     ThreadPool pool(n_threads);
     printf("Using %u threads.\n", n_threads);
 
-    SDL_AudioSpec want = {}, have = {};
-    want.freq = 44100; want.format = AUDIO_F32SYS; want.channels = 1; want.samples = 1024; want.callback = audio_callback;
-    audioDevice = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
-    make_blue_sound(blueSound); make_rainbow_sound(rainbowSound); make_stellar_explosion_sound(explosionSound);
-    SDL_PauseAudioDevice(audioDevice, 0);
+    Uint32 assetStart = SDL_GetTicks();
+    bool baked = load_startup_assets(assetPackPath);
+    printf("Loaded assets in %u ms (%s).\n", SDL_GetTicks() - assetStart, baked ? "asset pack" : "generated");
+
+    // With --engine-audio the effects are a node in the music engine's graph and no
+    // SDL audio device is opened; one mixer thread and one device buffer.
+    ma_engine engine;
+    ma_engine_config engineConfig = ma_engine_config_init();
+    if (engineAudio) {
+        engineConfig.sampleRate = SYNTH_SAMPLE_RATE;
+        engineConfig.periodSizeInFrames = (ma_uint32)audioFrames;
+    }
+    ma_engine_init(&engineConfig, &engine);
+
+    prepare_audio_profiling();
+    if (engineAudio && attach_effects_to_engine(&engine)) {
+        set_audio_buffer_frames(audioFrames, (int)ma_engine_get_sample_rate(&engine));
+    }
+    else {
+        if (engineAudio) printf("Could not attach effects to the audio engine; using an SDL device.\n");
+        SDL_AudioSpec want = {}, have = {};
+        want.freq = SYNTH_SAMPLE_RATE; want.format = AUDIO_F32SYS; want.channels = 1; want.samples = (Uint16)audioFrames; want.callback = audio_callback;
+        audioDevice = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+        set_audio_buffer_frames(have.samples, have.freq);
+        SDL_PauseAudioDevice(audioDevice, 0);
+    }
 
     SDL_Window* window = SDL_CreateWindow("Gift From Other planet", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
     SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
 
-    ma_result result; ma_engine engine; ma_engine_init(NULL, &engine);
     ma_sound background_music;
-    ma_sound_init_from_file(&engine, "Stellardrone - Eternity.mp3", MA_SOUND_FLAG_DECODE | MA_SOUND_FLAG_STREAM, NULL, NULL, &background_music);
+    if (ma_sound_init_from_file(&engine, "Stellardrone - Eternity.mp3", MA_SOUND_FLAG_DECODE | MA_SOUND_FLAG_STREAM, NULL, NULL, &background_music) == MA_SUCCESS) {
+        attach_music_analysis(&engine, &background_music);
+    }
     ma_sound_set_looping(&background_music, MA_TRUE);
     ma_sound_start(&background_music);
 
-    srand((unsigned int)time(0));
-    generateRainbowLUT();
+    // Only the sky still draws from rand(); the simulation has world.rng.
+    srand(seed);
 
     GameTextures textures;
     recreate_all_textures(renderer, textures, SCREEN_WIDTH, SCREEN_HEIGHT);
 
-    density_buffer_width = SCREEN_WIDTH / DENSITY_BUFFER_SCALE;
-    density_buffer_height = SCREEN_HEIGHT / DENSITY_BUFFER_SCALE;
-    density_buffer.resize(density_buffer_width * density_buffer_height);
-
-    SpatialGrid grid(SCREEN_WIDTH, SCREEN_HEIGHT, INTERACTION_RADIUS);
-
-    particles.reserve(TOTAL_PARTICLES);
-    forces.resize(TOTAL_PARTICLES);
-    int global_index = 0;
-
-    for (int i = 0; i < PLAYER_PARTICLE_COUNT; ++i) {
-        float angle = (float)i / PLAYER_PARTICLE_COUNT * 2.0f * 3.14159f;
-        float r = (rand() % 40);
-        particles.emplace_back(SCREEN_WIDTH / 2 + cos(angle) * r, SCREEN_HEIGHT / 2 + sin(angle) * r, true);
-        particles.back().id = global_index++;
-    }
-
-    for (int i = 0; i < TOTAL_PARTICLES - PLAYER_PARTICLE_COUNT; ++i) {
-        particles.emplace_back(rand() % SCREEN_WIDTH, rand() % SCREEN_HEIGHT, false);
-        particles.back().id = global_index++;
-    }
+    populate_world(world, totalParticles, playerParticles, !slab_domain_active());
 
     bool running = true;
-    bool mouseDown = false;
-    int mx = 0, my = 0;
-    bool brushMode = false;
-    bool painting = false;
-    float lastBrushX = SCREEN_WIDTH / 2, lastBrushY = SCREEN_HEIGHT / 2;
-    float lastVelX = 0.0f, lastVelY = 0.0f;
-    int brushEffectMode = 1;
-    bool playerSunMode = false;
-    float playerSunTimer = 0.0f;
-    bool playerRainbow = false;
-    float playerRainbowTimer = 0.0f;
-    float playerJumpTimer = 0.0f;
-    float meteorTimer = 0.0f;
-    float nextMeteorInterval = 2.0f + (rand() % 300) / 100.0f;
-    float centerX = 0.0f, centerY = 0.0f, avgVx = 0.0f, avgVy = 0.0f;
+    SimInput input;
+    cameraX = (world.width - SCREEN_WIDTH) * 0.5f;
+    cameraY = (world.height - SCREEN_HEIGHT) * 0.5f;
     int TARGET_FPS = 90;
     const int FRAME_DELAY = 1000 / TARGET_FPS;
     Uint32 frameStart;
@@ -119,25 +208,104 @@ int main(int argc, char* argv[]) {
     int fpsFrames = 0;
     float finalFPS = 0.0f;
     bool showFPS = false;
-    bool silent = true;
+    bool dumpFrameGraph = false;
+    bool toggleProfile = false;
+    PerfHud hud;
+
+    FrameGraph frame(2);
+    int physicsStage = frame.add_stage("physics", RES_FRAGMENTS | RES_BRUSHES | RES_MODES,
+        RES_PARTICLES | RES_DENSITY | RES_BRUSHES | RES_FRAGMENTS | RES_PLAYER | RES_MODES | RES_RANDOM, [&] {
+            update_physics_simulation(world, input, pool);
+        });
+    int meteorStage = frame.add_stage("meteors", RES_CAMERA | RES_METEORS, RES_METEORS | RES_BRUSHES | RES_RANDOM, [&] {
+        update_meteors(world, input);
+        });
+    int paintingStage = frame.add_stage("brush painting", RES_PLAYER, RES_BRUSHES | RES_RANDOM, [&] {
+        update_brush_painting(world, input);
+        });
+    int brushStage = frame.add_stage("brush particles", RES_BRUSHES | RES_PARTICLES | RES_DENSITY | RES_CAMERA | RES_MODES,
+        RES_BRUSHES | RES_FRAGMENTS | RES_MODES | RES_RANDOM, [&] {
+            update_brush_particles(world, input);
+        });
+    int fragmentStage = frame.add_stage("fragments", RES_FRAGMENTS, RES_FRAGMENTS, [&] {
+        update_rainbow_fragments(world);
+        });
+    frame.add_stage("camera", RES_PLAYER | RES_CAMERA, RES_CAMERA, [&] {
+        update_camera(world, world.centerX, world.centerY);
+        });
+    frame.add_stage("mode timers", RES_MODES, RES_MODES, [&] {
+        update_mode_timers(world);
+        });
+    int renderStage = frame.add_stage("render", RES_ALL, RES_RENDERER | RES_FRAGMENTS | RES_RANDOM, [&] {
+        render_frame(renderer, world, textures, input.brushMode, input.brushEffectMode,
+            showFPS, hud);
+        }, true);
+
+    hud.budgetMs = (float)FRAME_DELAY;
+    hud.lanes = (int)frame.lane_count() - 1;
+    hud.workers = (int)pool.size();
+    std::vector<int64_t> poolBusyNs;
+    using hud_clock = std::chrono::steady_clock;
+    auto ms_since = [](hud_clock::time_point t) {
+        return std::chrono::duration<float, std::milli>(hud_clock::now() - t).count();
+    };
+
+    InputRecorder recorder;
+    if (recordPath) {
+        InputLogHeader h;
+        input_log_init_header(h);
+        h.seed = seed;
+        h.threads = (int32_t)n_threads;
+        h.particles = totalParticles;
+        h.players = playerParticles;
+        h.worldWidth = world.width;
+        h.worldHeight = world.height;
+        h.screenWidth = SCREEN_WIDTH;
+        h.screenHeight = SCREEN_HEIGHT;
+        h.worldFollowsScreen = worldFollowsScreen ? 1 : 0;
+        h.sparseGrid = sparseGrid ? 1 : 0;
+        if (recorder.open(recordPath, h)) printf("Recording input to %s (seed %u).\n", recordPath, seed);
+        else fprintf(stderr, "Could not write input log %s.\n", recordPath);
+    }
+    uint32_t simFrame = 0;
+    std::vector<SDL_Event> replayEvents;
+    int replayMouseX = 0, replayMouseY = 0;
 
     while (running) {
         frameStart = SDL_GetTicks();
+        hud_clock::time_point frameBegin = hud_clock::now();
 
-        SDL_Event e;
-        while (SDL_PollEvent(&e)) {
-            handle_input_events(e, running, mouseDown, brushMode, painting, brushEffectMode, showFPS, silent, pool, grid, renderer, textures);
+        {
+            PROFILE_ZONE("events");
+            SDL_Event e;
+            while (SDL_PollEvent(&e)) {
+                // While replaying, the log drives the simulation and the rest stays live.
+                if (replaying && input_event_affects_simulation(e)) continue;
+                recorder.event(simFrame, e);
+                handle_input_events(e, running, input.mouseDown, input.brushMode, input.painting, input.brushEffectMode, showFPS, dumpFrameGraph, toggleProfile, input.silent);
+            }
         }
-            SDL_GetMouseState(&mx, &my);
-
-            update_physics_simulation(brushMode, mx, my, mouseDown, playerSunMode, playerRainbow,centerX, centerY, avgVx, avgVy, playerRainbowTimer,playerJumpTimer,grid, pool);
-            update_meteors(meteorTimer, nextMeteorInterval, silent, TARGET_FPS);
-            update_brush_painting(brushMode && painting, brushEffectMode, centerX, centerY, lastBrushX, lastBrushY, lastVelX, lastVelY);
-            update_brush_particles(brushMode, playerSunMode, playerSunTimer);
-            update_rainbow_fragments();
-
-            if (playerRainbow) { playerRainbowTimer -= 0.016f; playerJumpTimer -= 0.016f; if (playerRainbowTimer < 0) playerRainbow = false; }
-            if (playerSunMode) { playerSunTimer -= 0.016f; if (playerSunTimer <= 0) playerSunMode = false; }
+        if (replaying) {
+            if (!replay.frame(simFrame, replayEvents, replayMouseX, replayMouseY)) break;
+            for (SDL_Event& re : replayEvents) {
+                if (re.type == SDL_WINDOWEVENT) SDL_SetWindowSize(window, re.window.data1, re.window.data2);
+                handle_input_events(re, running, input.mouseDown, input.brushMode, input.painting, input.brushEffectMode, showFPS, dumpFrameGraph, toggleProfile, input.silent);
+            }
+        }
+            // F6 starts a capture and the next press writes it out.
+            if (toggleProfile) {
+                toggleProfile = false;
+                if (profiler_recording()) write_profile(profilePath);
+                else profiler_start();
+            }
+            apply_pending_resize(world, renderer, textures);
+            SDL_GetMouseState(&input.mouseX, &input.mouseY);
+            if (replaying) { input.mouseX = replayMouseX; input.mouseY = replayMouseY; }
+            recorder.mouse(simFrame, input.mouseX, input.mouseY);
+            input.mouseX += (int)cameraX; input.mouseY += (int)cameraY;
+            // Meteors and the drop waterline see the view from the start of the frame.
+            input.viewX = cameraX; input.viewY = cameraY;
+            input.viewW = (float)SCREEN_WIDTH; input.viewH = (float)SCREEN_HEIGHT;
 
             fpsFrames++;
             if (SDL_GetTicks() - fpsLastTime >= 1000) {
@@ -146,22 +314,61 @@ int main(int argc, char* argv[]) {
                 fpsLastTime = SDL_GetTicks();
             }
 
-            render_frame(renderer, textures, brushMode, brushEffectMode,
-                playerSunMode, playerRainbow, playerJumpTimer,
-                showFPS, finalFPS);
-            SDL_RenderPresent(renderer);
+            float beforeGraphMs = ms_since(frameBegin);
+            frame.run();
+            if (dumpFrameGraph) { frame.dump_critical_path(stdout); dumpFrameGraph = false; }
+            hud_clock::time_point presentBegin = hud_clock::now();
+            {
+                PROFILE_ZONE("present");
+                SDL_RenderPresent(renderer);
+            }
+            float presentMs = ms_since(presentBegin);
 
             frameTime = SDL_GetTicks() - frameStart;
-            if (FRAME_DELAY > frameTime) {
+            if (FRAME_DELAY > frameTime && !(replaying && replayFast)) {
+                PROFILE_ZONE("frame delay");
                 SDL_Delay(FRAME_DELAY - frameTime);
             }
+
+            // The HUD draws these on the next frame.
+            float frameMs = ms_since(frameBegin);
+            hud.push_frame(frameMs);
+            hud.fps = finalFPS;
+            hud.set_stage(HUD_STAGE_PHYSICS, (float)frame.stage_ms(physicsStage));
+            hud.set_stage(HUD_STAGE_BRUSH, (float)(frame.stage_ms(meteorStage) + frame.stage_ms(paintingStage) + frame.stage_ms(brushStage)));
+            hud.set_stage(HUD_STAGE_FRAGMENTS, (float)frame.stage_ms(fragmentStage));
+            hud.set_stage(HUD_STAGE_RENDER, (float)frame.stage_ms(renderStage));
+            hud.set_stage(HUD_STAGE_PRESENT, presentMs);
+            hud.set_busy(0, (beforeGraphMs + (float)frame.lane_busy_ms(0) + presentMs) / frameMs);
+            for (int l = 1; l <= hud.lanes; ++l) hud.set_busy(l, (float)frame.lane_busy_ms(l) / frameMs);
+            pool.take_busy_ns(poolBusyNs);
+            for (int w = 0; w < hud.workers; ++w) hud.set_busy(1 + hud.lanes + w, poolBusyNs[w] * 1e-6f / frameMs);
+            hud.particles = (int)world.particles.size();
+            hud.activeCells = world.activeCells;
+            hud.brushParticles = (int)world.brushParticles.size();
+            hud.fragments = (int)world.rainbowFragments.size();
+            hud.drawCalls = renderStats.drawCalls;
+            hud.vertices = renderStats.vertices;
+            hud.sample_memory();
+            simFrame++;
         }
+    if (recorder.is_open()) {
+        recorder.close(simFrame);
+        printf("Recorded %u frames to %s.\n", simFrame, recordPath);
+    }
+    if (recordPath || replaying) printf("World checksum after %u frames: %016llx\n", simFrame, (unsigned long long)world_checksum(world));
+    slab_domain_stop(world);
     destroy_all_textures(textures);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
-    SDL_CloseAudioDevice(audioDevice);
+    if (audioDevice) SDL_CloseAudioDevice(audioDevice);
     ma_sound_uninit(&background_music);
+    detach_music_analysis();
+    detach_effects_from_engine();
     ma_engine_uninit(&engine);
+    report_audio_latency(stdout);
+    if (profiler_recording()) write_profile(profilePath);
+    asset_pack_close();
     SDL_Quit();
     return 0;
 }
\ No newline at end of file
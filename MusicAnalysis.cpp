@@ -0,0 +1,221 @@
+#include "MusicAnalysis.h"
+#include "AllocCounter.h"
+#include <atomic>
+#include <cstring>
+#undef min
+#undef max
+
+static const float BAND_EDGES_HZ[MUSIC_BANDS + 1] = { 20.0f, 150.0f, 600.0f, 2500.0f, 10000.0f };
+const int FLUX_HISTORY = 16;
+const int MIN_ONSET_GAP = 4;          // hops, ~46 ms at 44.1 kHz
+const float ONSET_THRESHOLD = 1.4f;   // times the recent mean flux
+const float ONSET_DECAY_SECONDS = 0.1f;
+
+// FFT tables, built once before the node is attached.
+static float hannWindow[MUSIC_FFT_SIZE];
+static float twiddleRe[MUSIC_FFT_SIZE / 2], twiddleIm[MUSIC_FFT_SIZE / 2];
+static int bitReverse[MUSIC_FFT_SIZE];
+static bool tablesReady = false;
+
+// Analyser state, touched only by the audio thread.
+static float history[MUSIC_FFT_SIZE];
+static int historyFill = 0;
+static float prevLogMag[MUSIC_FFT_SIZE / 2 + 1];
+static float bandPeak[MUSIC_BANDS];
+static float fluxHistory[FLUX_HISTORY];
+static int fluxPos = 0;
+static int hopsSinceOnset = MIN_ONSET_GAP;
+static MusicFeatures current;
+
+// Double buffer: the writer fills the slot the reader is not pointed at, then
+// bumps `published`. A reader that sees `published` move while it copied retries.
+static MusicFeatures slots[2];
+static std::atomic<unsigned> published{ 0 };
+
+static void prepare_tables() {
+    if (tablesReady) return;
+    const double TAU = 6.283185307179586;
+    for (int i = 0; i < MUSIC_FFT_SIZE; ++i) {
+        hannWindow[i] = (float)(0.5 - 0.5 * std::cos(TAU * i / (MUSIC_FFT_SIZE - 1)));
+    }
+    for (int k = 0; k < MUSIC_FFT_SIZE / 2; ++k) {
+        twiddleRe[k] = (float)std::cos(TAU * k / MUSIC_FFT_SIZE);
+        twiddleIm[k] = (float)-std::sin(TAU * k / MUSIC_FFT_SIZE);
+    }
+    int bits = 0;
+    while ((1 << bits) < MUSIC_FFT_SIZE) ++bits;
+    for (int i = 0; i < MUSIC_FFT_SIZE; ++i) {
+        int r = 0;
+        for (int b = 0; b < bits; ++b) if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+        bitReverse[i] = r;
+    }
+    tablesReady = true;
+}
+
+// In-place iterative radix-2 FFT; input already in bit-reversed order.
+static void fft(float* re, float* im) {
+    for (int len = 2; len <= MUSIC_FFT_SIZE; len <<= 1) {
+        int half = len >> 1;
+        int step = MUSIC_FFT_SIZE / len;
+        for (int start = 0; start < MUSIC_FFT_SIZE; start += len) {
+            for (int j = 0; j < half; ++j) {
+                float wr = twiddleRe[j * step], wi = twiddleIm[j * step];
+                int a = start + j, b = a + half;
+                float tr = re[b] * wr - im[b] * wi;
+                float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr; im[b] = im[a] - ti;
+                re[a] += tr; im[a] += ti;
+            }
+        }
+    }
+}
+
+static void publish(const MusicFeatures& f) {
+    unsigned next = published.load(std::memory_order_relaxed) + 1;
+    slots[next & 1] = f;
+    published.store(next, std::memory_order_release);
+}
+
+MusicFeatures music_features() {
+    while (true) {
+        unsigned p = published.load(std::memory_order_acquire);
+        MusicFeatures f = slots[p & 1];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (published.load(std::memory_order_relaxed) == p) return f;
+    }
+}
+
+static void analyse(int rate) {
+    float re[MUSIC_FFT_SIZE], im[MUSIC_FFT_SIZE];
+    for (int i = 0; i < MUSIC_FFT_SIZE; ++i) {
+        int r = bitReverse[i];
+        re[r] = history[i] * hannWindow[i];
+        im[r] = 0.0f;
+    }
+    fft(re, im);
+
+    const int BINS = MUSIC_FFT_SIZE / 2;
+    const float binHz = (float)rate / MUSIC_FFT_SIZE;
+    const float magScale = 4.0f / MUSIC_FFT_SIZE;   // Hann gain 0.5, one-sided spectrum
+
+    float bandPower[MUSIC_BANDS] = {};
+    int bandBins[MUSIC_BANDS] = {};
+    float flux = 0.0f;
+    for (int k = 1; k <= BINS; ++k) {
+        float mag = std::sqrt(re[k] * re[k] + im[k] * im[k]) * magScale;
+        float logMag = std::log1p(100.0f * mag);
+        float rise = logMag - prevLogMag[k];
+        if (rise > 0.0f) flux += rise;
+        prevLogMag[k] = logMag;
+
+        float hz = k * binHz;
+        for (int b = 0; b < MUSIC_BANDS; ++b) {
+            if (hz >= BAND_EDGES_HZ[b] && hz < BAND_EDGES_HZ[b + 1]) {
+                bandPower[b] += mag * mag;
+                bandBins[b]++;
+                break;
+            }
+        }
+    }
+
+    // Each band is scaled by its own slowly decaying peak, so quiet passages still
+    // move the visuals; rises are taken at once, falls are smoothed.
+    float level = 0.0f;
+    for (int b = 0; b < MUSIC_BANDS; ++b) {
+        float rms = bandBins[b] ? std::sqrt(bandPower[b] / bandBins[b]) : 0.0f;
+        bandPeak[b] = std::max(std::max(rms, bandPeak[b] * 0.999f), 1e-4f);
+        float v = rms / bandPeak[b];
+        current.band[b] = (v > current.band[b]) ? v : current.band[b] * 0.8f + v * 0.2f;
+        level += current.band[b];
+    }
+    current.level = level / MUSIC_BANDS;
+
+    float meanFlux = 0.0f;
+    for (float f : fluxHistory) meanFlux += f;
+    meanFlux /= FLUX_HISTORY;
+    fluxHistory[fluxPos] = flux;
+    fluxPos = (fluxPos + 1) % FLUX_HISTORY;
+
+    hopsSinceOnset++;
+    float decay = std::exp(-(float)MUSIC_FFT_HOP / rate / ONSET_DECAY_SECONDS);
+    if (flux > meanFlux * ONSET_THRESHOLD && flux > 1.0f && hopsSinceOnset >= MIN_ONSET_GAP) {
+        current.onset = 1.0f;
+        current.onsetCount++;
+        hopsSinceOnset = 0;
+    }
+    else {
+        current.onset *= decay;
+    }
+
+    current.hop++;
+    publish(current);
+}
+
+void music_analysis_feed(const float* frames, int count, int channels, int rate) {
+    if (!tablesReady || channels <= 0 || rate <= 0) return;
+    float invChannels = 1.0f / channels;
+    for (int i = 0; i < count; ++i) {
+        float s = 0.0f;
+        for (int c = 0; c < channels; ++c) s += frames[i * channels + c];
+        history[historyFill++] = s * invChannels;
+
+        if (historyFill == MUSIC_FFT_SIZE) {
+            analyse(rate);
+            memmove(history, history + MUSIC_FFT_HOP, (MUSIC_FFT_SIZE - MUSIC_FFT_HOP) * sizeof(float));
+            historyFill = MUSIC_FFT_SIZE - MUSIC_FFT_HOP;
+        }
+    }
+}
+
+// Pass-through node: copies the music to the endpoint and feeds the analyser.
+struct MusicTapNode {
+    ma_node_base base;
+    int rate;
+};
+
+static MusicTapNode tapNode;
+static bool tapReady = false;
+
+static void music_tap_process(ma_node* node, const float** framesIn, ma_uint32* frameCountIn, float** framesOut, ma_uint32* frameCountOut) {
+    (void)frameCountIn;
+    ma_uint32 channels = ma_node_get_output_channels(node, 0);
+    ma_uint32 count = *frameCountOut;
+    memcpy(framesOut[0], framesIn[0], (size_t)count * channels * sizeof(float));
+    music_analysis_feed(framesOut[0], (int)count, (int)channels, static_cast<MusicTapNode*>(node)->rate);
+}
+
+static ma_node_vtable music_tap_vtable = {
+    music_tap_process,
+    NULL,   // onGetRequiredInputFrameCount
+    1,      // one input bus
+    1,      // one output bus
+    0
+};
+
+bool attach_music_analysis(ma_engine* engine, ma_sound* music) {
+    if (tapReady) return true;
+    MemScope mem(MEM_AUDIO);
+    prepare_tables();
+
+    ma_uint32 channels = ma_engine_get_channels(engine);
+    ma_node_config config = ma_node_config_init();
+    config.vtable = &music_tap_vtable;
+    config.pInputChannels = &channels;
+    config.pOutputChannels = &channels;
+    if (ma_node_init(ma_engine_get_node_graph(engine), &config, NULL, &tapNode) != MA_SUCCESS) return false;
+    tapNode.rate = (int)ma_engine_get_sample_rate(engine);
+
+    if (ma_node_attach_output_bus(&tapNode, 0, ma_engine_get_endpoint(engine), 0) != MA_SUCCESS ||
+        ma_node_attach_output_bus(music, 0, &tapNode, 0) != MA_SUCCESS) {
+        ma_node_uninit(&tapNode, NULL);
+        return false;
+    }
+    tapReady = true;
+    return true;
+}
+
+void detach_music_analysis() {
+    if (!tapReady) return;
+    ma_node_uninit(&tapNode, NULL);
+    tapReady = false;
+}
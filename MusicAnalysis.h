@@ -0,0 +1,29 @@
+#pragma once
+#include "GameConfig.h"
+
+// Spectrum analysis of the background music. A pass-through node between the
+// music sound and the engine endpoint feeds the analyser on miniaudio's audio
+// thread; every MUSIC_FFT_HOP frames a Hann-windowed FFT is reduced to a few
+// bands and a spectral-flux onset detector. Results are published through a
+// double buffer, so the renderer reads them without locking.
+const int MUSIC_FFT_SIZE = 1024;
+const int MUSIC_FFT_HOP = 512;
+const int MUSIC_BANDS = 4;
+
+struct MusicFeatures {
+    float band[MUSIC_BANDS] = {};   // bass, low mid, high mid, treble; roughly 0..1
+    float level = 0.0f;             // all bands together
+    float onset = 0.0f;             // 1 on a detected onset, decaying over ~100 ms
+    unsigned onsetCount = 0;
+    unsigned hop = 0;               // analysis frames published so far
+};
+
+enum MusicBand { MUSIC_BASS, MUSIC_LOW_MID, MUSIC_HIGH_MID, MUSIC_TREBLE };
+
+bool attach_music_analysis(ma_engine* engine, ma_sound* music);
+void detach_music_analysis();
+
+// Audio thread only: interleaved float frames at `rate`.
+void music_analysis_feed(const float* frames, int count, int channels, int rate);
+// Any thread, lock-free. The latest published features.
+MusicFeatures music_features();
@@ -0,0 +1,128 @@
+#include "PerfCounters.h"
+#include <atomic>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static std::atomic<bool> countersOn{ false };
+static std::atomic<uint32_t> countersAvailable{ 0 };
+
+void HwCounts::add_span(const HwReading& start, const HwReading& end) {
+    uint64_t enabled = end.enabledNs - start.enabledNs;
+    uint64_t running = end.runningNs - start.runningNs;
+    // Never scheduled on the PMU during the span: nothing was counted.
+    if (running == 0) return;
+    double scale = running < enabled ? (double)enabled / running : 1.0;
+    for (int i = 0; i < HW_COUNTER_COUNT; ++i) v[i] += (uint64_t)((end.raw[i] - start.raw[i]) * scale);
+}
+
+bool hw_counters_enabled() {
+    return countersOn.load(std::memory_order_relaxed);
+}
+
+uint32_t hw_counters_available() {
+    return countersAvailable.load(std::memory_order_relaxed);
+}
+
+void hw_counters_stop() {
+    countersOn.store(false, std::memory_order_relaxed);
+}
+
+#ifdef __linux__
+
+struct EventSpec { uint32_t type; uint64_t config; };
+
+static const EventSpec EVENTS[HW_COUNTER_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+// One group per thread, read with a single syscall. The first event that opens
+// leads the group; events the CPU lacks are left out.
+struct ThreadCounters {
+    int fds[HW_COUNTER_COUNT];
+    int slot[HW_COUNTER_COUNT];     // position in the group read, -1 if not opened
+    int members = 0;
+    bool tried = false;
+
+    ThreadCounters() {
+        for (int i = 0; i < HW_COUNTER_COUNT; ++i) fds[i] = slot[i] = -1;
+    }
+    ~ThreadCounters() {
+        for (int fd : fds) if (fd >= 0) close(fd);
+    }
+
+    void open_group() {
+        tried = true;
+        int leader = -1;
+        uint32_t mask = 0;
+        for (int i = 0; i < HW_COUNTER_COUNT; ++i) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = EVENTS[i].type;
+            attr.config = EVENTS[i].config;
+            attr.disabled = leader < 0 ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fd < 0) continue;
+            if (leader < 0) leader = fd;
+            fds[i] = fd;
+            slot[i] = members++;
+            mask |= 1u << i;
+        }
+        if (leader < 0) return;
+        ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        countersAvailable.fetch_or(mask, std::memory_order_relaxed);
+    }
+
+    int leader() const {
+        for (int i = 0; i < HW_COUNTER_COUNT; ++i) if (slot[i] == 0) return fds[i];
+        return -1;
+    }
+};
+
+static thread_local ThreadCounters localCounters;
+
+bool hw_counters_start() {
+    countersOn.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+bool hw_counters_read(HwReading& out) {
+    if (!hw_counters_enabled()) return false;
+    ThreadCounters& tc = localCounters;
+    if (!tc.tried) tc.open_group();
+    if (tc.members == 0) return false;
+
+    uint64_t buf[3 + HW_COUNTER_COUNT];
+    ssize_t want = (ssize_t)((3 + tc.members) * sizeof(uint64_t));
+    if (read(tc.leader(), buf, (size_t)want) != want) return false;
+    out.enabledNs = buf[1];
+    out.runningNs = buf[2];
+    for (int i = 0; i < HW_COUNTER_COUNT; ++i) out.raw[i] = tc.slot[i] >= 0 ? buf[3 + tc.slot[i]] : 0;
+    return true;
+}
+
+#else
+
+bool hw_counters_start() {
+    return false;
+}
+
+bool hw_counters_read(HwReading&) {
+    return false;
+}
+
+#endif
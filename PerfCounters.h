@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+
+// Hardware performance counters through Linux perf_event_open. Each thread that
+// reads them opens its own counter group on first use, counting only itself in
+// user space, so a stage can be measured on whichever thread runs it. Elsewhere,
+// or where the kernel refuses (perf_event_paranoid, VMs without a PMU), every
+// read fails and callers carry on without counts.
+enum HwCounter {
+    HW_CYCLES,
+    HW_INSTRUCTIONS,
+    HW_L1D_MISSES,      // L1 data read misses
+    HW_LLC_MISSES,      // last-level cache misses
+    HW_BRANCH_MISSES,
+    HW_COUNTER_COUNT
+};
+
+const char* const HW_COUNTER_NAMES[HW_COUNTER_COUNT] = { "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses" };
+
+// Raw running totals of the calling thread's group.
+struct HwReading {
+    uint64_t raw[HW_COUNTER_COUNT];
+    uint64_t enabledNs, runningNs;
+};
+
+// Counts over some span, scaled up when the kernel multiplexed the group.
+struct HwCounts {
+    uint64_t v[HW_COUNTER_COUNT] = {};
+
+    void add(const HwCounts& o) {
+        for (int i = 0; i < HW_COUNTER_COUNT; ++i) v[i] += o.v[i];
+    }
+    // Adds what was counted between two readings of the same thread.
+    void add_span(const HwReading& start, const HwReading& end);
+};
+
+// Lets threads open and read counters. False if this platform has none.
+bool hw_counters_start();
+void hw_counters_stop();
+bool hw_counters_enabled();
+// Counters some thread managed to open, one bit per HwCounter; 0 until a read has
+// succeeded. Counts for the others stay zero.
+uint32_t hw_counters_available();
+// Reads the calling thread's counters, opening them on first use. False while
+// counters are off or could not be opened on this thread.
+bool hw_counters_read(HwReading& out);
+
+// Reads the counters around its scope and adds the span to `into`, when enabled.
+class HwCounterScope {
+public:
+    explicit HwCounterScope(HwCounts& into) : into(into) { counting = hw_counters_enabled() && hw_counters_read(start); }
+    ~HwCounterScope() {
+        HwReading end;
+        if (counting && hw_counters_read(end)) into.add_span(start, end);
+    }
+    HwCounterScope(const HwCounterScope&) = delete;
+    HwCounterScope& operator=(const HwCounterScope&) = delete;
+private:
+    HwCounts& into;
+    HwReading start;
+    bool counting;
+};
@@ -0,0 +1,229 @@
+#include "PerfHud.h"
+#include <cstdio>
+#include <cctype>
+
+// 3x5 glyphs, one row per byte, bit 2 on the left.
+struct Glyph { char c; unsigned char rows[5]; };
+
+static const Glyph FONT[] = {
+    {'0', {7,5,5,5,7}}, {'1', {2,6,2,2,7}}, {'2', {7,1,7,4,7}}, {'3', {7,1,7,1,7}}, {'4', {5,5,7,1,1}},
+    {'5', {7,4,7,1,7}}, {'6', {7,4,7,5,7}}, {'7', {7,1,1,1,1}}, {'8', {7,5,7,5,7}}, {'9', {7,5,7,1,7}},
+    {'A', {2,5,7,5,5}}, {'B', {6,5,6,5,6}}, {'C', {3,4,4,4,3}}, {'D', {6,5,5,5,6}}, {'E', {7,4,6,4,7}},
+    {'F', {7,4,6,4,4}}, {'G', {3,4,5,5,3}}, {'H', {5,5,7,5,5}}, {'I', {7,2,2,2,7}}, {'J', {1,1,1,5,2}},
+    {'K', {5,5,6,5,5}}, {'L', {4,4,4,4,7}}, {'M', {5,7,7,5,5}}, {'N', {6,5,5,5,5}}, {'O', {2,5,5,5,2}},
+    {'P', {6,5,6,4,4}}, {'Q', {2,5,5,6,3}}, {'R', {6,5,6,5,5}}, {'S', {3,4,2,1,6}}, {'T', {7,2,2,2,2}},
+    {'U', {5,5,5,5,7}}, {'V', {5,5,5,5,2}}, {'W', {5,5,7,7,5}}, {'X', {5,5,2,5,5}}, {'Y', {5,5,2,2,2}},
+    {'Z', {7,1,2,4,7}}, {'.', {0,0,0,0,2}}, {'%', {5,1,2,4,5}}, {':', {0,2,0,2,0}}, {'-', {0,0,7,0,0}},
+    {'/', {1,1,2,4,4}},
+};
+
+static const unsigned char* glyph_rows(char c) {
+    c = (char)toupper((unsigned char)c);
+    for (const Glyph& g : FONT) {
+        if (g.c == c) return g.rows;
+    }
+    return nullptr;
+}
+
+const int TEXT_PX = 2;                      // size of one font pixel
+const int TEXT_ADVANCE = 4 * TEXT_PX;
+const int LINE_HEIGHT = 7 * TEXT_PX;
+
+const SDL_Color HUD_TEXT = { 220, 230, 240, 255 };
+const SDL_Color HUD_DIM = { 120, 130, 140, 255 };
+const SDL_Color HUD_GOOD = { 0, 230, 90, 255 };
+const SDL_Color HUD_WARN = { 240, 200, 40, 255 };
+const SDL_Color HUD_BAD = { 240, 60, 50, 255 };
+
+static const SDL_Color STAGE_COLORS[HUD_STAGE_COUNT] = {
+    { 70, 150, 255, 255 }, { 200, 120, 255, 255 }, { 255, 160, 60, 255 }, { 60, 220, 200, 255 }, { 200, 200, 200, 255 }
+};
+
+static void push_rect(std::vector<SDL_Vertex>& v, float x, float y, float w, float h, SDL_Color c) {
+    v.push_back({ {x, y}, c, {0, 0} });
+    v.push_back({ {x + w, y}, c, {0, 0} });
+    v.push_back({ {x + w, y + h}, c, {0, 0} });
+    v.push_back({ {x, y}, c, {0, 0} });
+    v.push_back({ {x + w, y + h}, c, {0, 0} });
+    v.push_back({ {x, y + h}, c, {0, 0} });
+}
+
+static void push_text(std::vector<SDL_Vertex>& v, int x, int y, const char* text, SDL_Color c) {
+    for (; *text; ++text, x += TEXT_ADVANCE) {
+        const unsigned char* rows = glyph_rows(*text);
+        if (!rows) continue;
+        for (int r = 0; r < 5; ++r) {
+            for (int b = 0; b < 3; ++b) {
+                if (rows[r] & (4 >> b)) push_rect(v, (float)(x + b * TEXT_PX), (float)(y + r * TEXT_PX), (float)TEXT_PX, (float)TEXT_PX, c);
+            }
+        }
+    }
+}
+
+// The seven-segment digits the FPS counter has always used, as quads.
+static void push_segment_digit(std::vector<SDL_Vertex>& v, int x, int y, int digit, float scale, SDL_Color c) {
+    int w = (int)(10 * scale);
+    int h = (int)(10 * scale);
+    int h2 = h * 2;
+    float t = scale;
+
+    struct Seg { int x1, y1, x2, y2; };
+    Seg segs[7] = {
+        {0,0, w,0}, {0,0, 0,h}, {w,0, w,h}, {0,h, w,h}, {0,h, 0,h2}, {w,h, w,h2}, {0,h2, w,h2}
+    };
+    static const int map[10][7] = {
+        {1,1,1,0,1,1,1}, {0,0,1,0,0,1,0}, {1,0,1,1,1,0,1}, {1,0,1,1,0,1,1}, {0,1,1,1,0,1,0},
+        {1,1,0,1,0,1,1}, {1,1,0,1,1,1,1}, {1,0,1,0,0,1,0}, {1,1,1,1,1,1,1}, {1,1,1,1,0,1,1}
+    };
+
+    for (int i = 0; i < 7; ++i) {
+        if (!map[digit][i]) continue;
+        const Seg& s = segs[i];
+        push_rect(v, (float)(x + s.x1), (float)(y + s.y1), (float)(s.x2 - s.x1) + t, (float)(s.y2 - s.y1) + t, c);
+    }
+}
+
+static SDL_Color frame_color(float ms, float budgetMs) {
+    if (ms <= budgetMs + 1.0f) return HUD_GOOD;
+    if (ms <= 2.0f * budgetMs) return HUD_WARN;
+    return HUD_BAD;
+}
+
+// Bytes as K or M, short enough for a HUD column.
+static void format_bytes(char* buf, size_t size, int64_t bytes) {
+    if (bytes < 1024 * 1024) snprintf(buf, size, "%lldK", (long long)((bytes + 1023) / 1024));
+    else snprintf(buf, size, "%.1fM", bytes / (1024.0 * 1024.0));
+}
+
+// A memory row: label, live, peak and allocations per frame in fixed columns.
+static void push_memory_row(std::vector<SDL_Vertex>& v, int x, int y, const char* label, int64_t live, int64_t peak, float allocs, SDL_Color c) {
+    char buf[32];
+    push_text(v, x, y, label, c);
+    format_bytes(buf, sizeof(buf), live);
+    push_text(v, x + 96, y, buf, HUD_TEXT);
+    if (peak >= 0) {
+        format_bytes(buf, sizeof(buf), peak);
+        push_text(v, x + 160, y, buf, HUD_TEXT);
+    }
+    if (allocs >= 0.0f) {
+        snprintf(buf, sizeof(buf), "%.1f", allocs);
+        push_text(v, x + 224, y, buf, allocs >= 0.5f ? HUD_WARN : HUD_TEXT);
+    }
+}
+
+// Label, a bar filled to fraction and the value printed after it.
+static void push_bar_row(std::vector<SDL_Vertex>& v, int x, int y, const char* label, float fraction, SDL_Color c, const char* value) {
+    const int BAR_X = 80, BAR_W = 150;
+    if (fraction < 0.0f) fraction = 0.0f;
+    if (fraction > 1.0f) fraction = 1.0f;
+    push_text(v, x, y, label, HUD_TEXT);
+    push_rect(v, (float)(x + BAR_X), (float)y, (float)BAR_W, 10.0f, { 40, 45, 55, 255 });
+    push_rect(v, (float)(x + BAR_X), (float)y, BAR_W * fraction, 10.0f, c);
+    push_text(v, x + BAR_X + BAR_W + 8, y, value, HUD_TEXT);
+}
+
+int render_perf_hud(SDL_Renderer* renderer, const PerfHud& hud) {
+    static std::vector<SDL_Vertex> verts;
+    verts.clear();
+
+    const int x0 = 16, y0 = 16, pad = 8;
+    const int panelW = HUD_HISTORY + 2 * pad + 40;
+    char buf[64];
+
+    // The panel goes first so everything else lands on top; its height is patched
+    // in once the rows are laid out.
+    push_rect(verts, (float)x0, (float)y0, (float)panelW, 0.0f, { 0, 0, 0, 170 });
+    int x = x0 + pad, y = y0 + pad;
+
+    int fps = (int)hud.fps;
+    if (fps < 0) fps = 0;
+    if (fps > 999) fps = 999;
+    float lastMs = hud.frameMs[(hud.historyHead + HUD_HISTORY - 1) % HUD_HISTORY];
+    SDL_Color fpsColor = frame_color(fps > 0 ? 1000.0f / fps : 1000.0f, hud.budgetMs);
+    char digits[4];
+    snprintf(digits, sizeof(digits), "%d", fps);
+    int dx = x;
+    for (const char* d = digits; *d; ++d, dx += 36) push_segment_digit(verts, dx, y, *d - '0', 2.0f, fpsColor);
+    push_text(verts, x + 120, y + 2, "FPS", HUD_DIM);
+    snprintf(buf, sizeof(buf), "%.1f MS", lastMs);
+    push_text(verts, x + 120, y + 2 + LINE_HEIGHT, buf, HUD_TEXT);
+    y += 50;
+
+    // Frame-time graph, oldest on the left, 2.5 frame budgets tall, with the budget
+    // marked.
+    const float graphH = 60.0f, graphMaxMs = 2.5f * hud.budgetMs;
+    push_rect(verts, (float)x, (float)y, (float)HUD_HISTORY, graphH, { 25, 28, 35, 255 });
+    for (int i = 0; i < HUD_HISTORY; ++i) {
+        float ms = hud.frameMs[(hud.historyHead + i) % HUD_HISTORY];
+        float h = graphH * (ms < graphMaxMs ? ms / graphMaxMs : 1.0f);
+        push_rect(verts, (float)(x + i), y + graphH - h, 1.0f, h, frame_color(ms, hud.budgetMs));
+    }
+    float budgetY = y + graphH - graphH * hud.budgetMs / graphMaxMs;
+    push_rect(verts, (float)x, budgetY, (float)HUD_HISTORY, 1.0f, { 255, 255, 255, 120 });
+    snprintf(buf, sizeof(buf), "%.0f", hud.budgetMs);
+    push_text(verts, x + HUD_HISTORY + 4, (int)budgetY - 5, buf, HUD_DIM);
+    y += (int)graphH + pad;
+
+    push_text(verts, x, y, "STAGES  MS", HUD_DIM);
+    y += LINE_HEIGHT;
+    for (int s = 0; s < HUD_STAGE_COUNT; ++s) {
+        snprintf(buf, sizeof(buf), "%.2f", hud.stageMs[s]);
+        push_bar_row(verts, x, y, HUD_STAGE_NAMES[s], hud.stageMs[s] / hud.budgetMs, STAGE_COLORS[s], buf);
+        y += LINE_HEIGHT;
+    }
+    y += pad;
+
+    push_text(verts, x, y, "THREADS  BUSY", HUD_DIM);
+    y += LINE_HEIGHT;
+    int threads = 1 + hud.lanes + hud.workers;
+    if (threads > HUD_MAX_THREADS) threads = HUD_MAX_THREADS;
+    for (int t = 0; t < threads; ++t) {
+        char label[16];
+        if (t == 0) snprintf(label, sizeof(label), "main");
+        else if (t <= hud.lanes) snprintf(label, sizeof(label), "lane %d", t);
+        else snprintf(label, sizeof(label), "pool %d", t - hud.lanes - 1);
+        snprintf(buf, sizeof(buf), "%d%%", (int)(hud.busy[t] * 100.0f + 0.5f));
+        push_bar_row(verts, x, y, label, hud.busy[t], hud.busy[t] > 0.9f ? HUD_BAD : HUD_GOOD, buf);
+        y += LINE_HEIGHT;
+    }
+    y += pad;
+
+    struct Count { const char* label; int value; };
+    const Count counts[] = {
+        { "particles", hud.particles }, { "active cells", hud.activeCells }, { "brushes", hud.brushParticles },
+        { "fragments", hud.fragments }, { "draw calls", hud.drawCalls }, { "vertices", hud.vertices },
+    };
+    for (int i = 0; i < 6; ++i) {
+        int cx = x + (i % 2) * (panelW / 2);
+        push_text(verts, cx, y, counts[i].label, HUD_DIM);
+        snprintf(buf, sizeof(buf), "%d", counts[i].value);
+        push_text(verts, cx, y + LINE_HEIGHT, buf, HUD_TEXT);
+        if (i % 2 == 1) y += 2 * LINE_HEIGHT + 4;
+    }
+    y += pad - 4;
+
+    push_text(verts, x, y, "MEMORY", HUD_DIM);
+    push_text(verts, x + 96, y, "LIVE", HUD_DIM);
+    push_text(verts, x + 160, y, "PEAK", HUD_DIM);
+    push_text(verts, x + 224, y, "ALLOC/F", HUD_DIM);
+    y += LINE_HEIGHT;
+    for (int t = 0; t < MEM_TAG_COUNT; ++t) {
+        if (hud.memPeak[t] == 0) continue;
+        push_memory_row(verts, x, y, MEM_TAG_NAMES[t], hud.memLive[t], hud.memPeak[t], hud.memAllocs[t], HUD_TEXT);
+        y += LINE_HEIGHT;
+    }
+    push_memory_row(verts, x, y, "total", hud.memTotalLive, hud.memTotalPeak, hud.memTotalAllocs, HUD_DIM);
+    y += LINE_HEIGHT;
+    if (hud.residentBytes > 0) {
+        push_memory_row(verts, x, y, "resident", hud.residentBytes, -1, -1.0f, HUD_DIM);
+        y += LINE_HEIGHT;
+    }
+
+    float panelBottom = (float)(y + pad - 4);
+    verts[2].position.y = verts[4].position.y = verts[5].position.y = panelBottom;
+
+    SDL_SetRenderTarget(renderer, NULL);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_RenderGeometry(renderer, NULL, verts.data(), (int)verts.size(), NULL, 0);
+    return (int)verts.size();
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <SDL.h>
+#include "AllocCounter.h"
+#include <vector>
+
+// Frame stages broken out on the HUD, in bar order.
+enum HudStage { HUD_STAGE_PHYSICS, HUD_STAGE_BRUSH, HUD_STAGE_FRAGMENTS, HUD_STAGE_RENDER, HUD_STAGE_PRESENT, HUD_STAGE_COUNT };
+
+const char* const HUD_STAGE_NAMES[HUD_STAGE_COUNT] = { "physics", "brush", "fragments", "render", "present" };
+
+const int HUD_HISTORY = 240;        // frames in the rolling graph
+const int HUD_MAX_THREADS = 32;
+
+// What the F3 overlay shows. The main loop fills it in after each frame, so the
+// render stage always draws the numbers of the frame before.
+struct PerfHud {
+    float frameMs[HUD_HISTORY] = {};
+    int historyHead = 0;
+    float fps = 0.0f;
+    float budgetMs = 16.0f;             // target frame time; bars are scaled to it
+
+    // Smoothed milliseconds per stage.
+    float stageMs[HUD_STAGE_COUNT] = {};
+
+    // Busy fraction of each thread over the frame: the main thread, then the frame
+    // graph lanes, then the force pool workers.
+    int lanes = 0, workers = 0;
+    float busy[HUD_MAX_THREADS] = {};
+
+    int particles = 0;
+    int activeCells = 0;
+    int brushParticles = 0;
+    int fragments = 0;
+    int drawCalls = 0;
+    int vertices = 0;
+
+    // Live and peak bytes per memory tag, smoothed allocations per frame, and the
+    // resident set of the whole process.
+    int64_t memLive[MEM_TAG_COUNT] = {};
+    int64_t memPeak[MEM_TAG_COUNT] = {};
+    float memAllocs[MEM_TAG_COUNT] = {};
+    int64_t memTotalLive = 0, memTotalPeak = 0;
+    float memTotalAllocs = 0.0f;
+    int64_t residentBytes = 0;
+    uint64_t memAllocsSeen[MEM_TAG_COUNT + 1] = {};
+    int memFrames = 0;
+
+    void push_frame(float ms) {
+        frameMs[historyHead] = ms;
+        historyHead = (historyHead + 1) % HUD_HISTORY;
+    }
+
+    void set_stage(HudStage stage, float ms) {
+        stageMs[stage] += (ms - stageMs[stage]) * 0.1f;
+    }
+
+    void set_busy(int thread, float fraction) {
+        if (thread < 0 || thread >= HUD_MAX_THREADS) return;
+        if (fraction > 1.0f) fraction = 1.0f;
+        busy[thread] += (fraction - busy[thread]) * 0.1f;
+    }
+
+    // Reads the allocator's counters once a frame.
+    void sample_memory() {
+        for (int t = 0; t <= MEM_TAG_COUNT; ++t) {
+            MemTagStats s = t < MEM_TAG_COUNT ? mem_tag_stats((MemTag)t) : mem_total_stats();
+            float allocs = (float)(s.allocs - memAllocsSeen[t]);
+            memAllocsSeen[t] = s.allocs;
+            // The first sample would count everything since startup.
+            if (memFrames == 0) allocs = 0.0f;
+            float& smoothed = t < MEM_TAG_COUNT ? memAllocs[t] : memTotalAllocs;
+            smoothed += (allocs - smoothed) * 0.1f;
+            if (t < MEM_TAG_COUNT) {
+                memLive[t] = s.liveBytes;
+                memPeak[t] = s.peakBytes;
+            }
+            else {
+                memTotalLive = s.liveBytes;
+                memTotalPeak = s.peakBytes;
+            }
+        }
+        // Reading the resident set is a file read on Linux; twice a second is plenty.
+        if (memFrames++ % 45 == 0) residentBytes = process_resident_bytes();
+    }
+};
+
+// Draws the whole overlay with one SDL_RenderGeometry call and returns the number
+// of vertices it took.
+int render_perf_hud(SDL_Renderer* renderer, const PerfHud& hud);
@@ -1,16 +1,20 @@
-﻿#include "GameConfig.h"
-#include "PhysicsSystem.h"
-#include "SpatialGrid.h"
-#include "AudioSystem.h"
-#include "GameLogic.h"  
-
-void calculate_forces_for_keys(const std::vector<int>& cell_indices, const SpatialGrid& grid, std::vector<Vector2D>& local_forces) {
-    const int cols = grid.cols;
-    const int rows = grid.rows;
+﻿#include "PhysicsSystem.h"
+#include "GameLogic.h"
+
+void calculate_forces_for_keys(const World& world, const std::vector<int>& cell_indices, std::vector<Vector2D>& local_forces) {
+    const SpatialGrid& grid = world.grid;
+    const std::vector<Particle>& particles = world.particles;
+    const DensityGrid& density = world.density;
     const float R_INTERACT_SQ = INTERACTION_RADIUS * INTERACTION_RADIUS;
     const float R_PLAYER_SQ = PLAYER_WATER_INTERACTION_RADIUS * PLAYER_WATER_INTERACTION_RADIUS;
     const float COEFF_NORM = REPULSION_FORCE * 0.01f;
     const float COEFF_PLAYER = COEFF_NORM * PLAYER_WATER_REPULSION_MULTIPLIER;
+    const float SAMPLE_RADIUS = 50.0f;
+
+    // Each interaction scans only as many cells as its own radius needs.
+    const int REACH_SAME = grid.stencil_reach(INTERACTION_RADIUS);
+    const int REACH_PLAYER = grid.stencil_reach(PLAYER_WATER_INTERACTION_RADIUS);
+    const int REACH_SAMPLE = grid.stencil_reach(SAMPLE_RADIUS);
 
     for (int idx : cell_indices) {
 
@@ -20,20 +24,17 @@ void calculate_forces_for_keys(const std::vector<int>& cell_indices, const Spati
 
         if (count1 == 0) continue;
 
-        int cy = idx / cols;
-        int cx = idx % cols;
+        int cx, cy;
+        grid.cell_coords(idx, cx, cy);
 
         for (int i = start1; i < end1; ++i) {
-            Particle& p1 = particles[i];
-
-            for (int ny = cy - 1; ny <= cy + 1; ++ny) {
-                if (ny < 0 || ny >= rows) continue;
-                int y_offset = ny * cols;
+            const Particle& p1 = particles[i];
 
-                for (int nx = cx - 1; nx <= cx + 1; ++nx) {
-                    if (nx < 0 || nx >= cols) continue;
-
-                    int neighbor_cell_idx = nx + y_offset;
+            // Same-species pairs: symmetric stencil, each pair taken once from its lower index.
+            for (int ny = cy - REACH_SAME; ny <= cy + REACH_SAME; ++ny) {
+                for (int nx = cx - REACH_SAME; nx <= cx + REACH_SAME; ++nx) {
+                    int neighbor_cell_idx = grid.find_cell(nx, ny);
+                    if (neighbor_cell_idx < 0) continue;
 
                     int start2 = grid.cellStart[neighbor_cell_idx];
                     int count2 = grid.cellCount[neighbor_cell_idx];
@@ -45,22 +46,19 @@ void calculate_forces_for_keys(const std::vector<int>& cell_indices, const Spati
   
                         if (i >= j) continue;
 
-                        Particle& p2 = particles[j];
+                        const Particle& p2 = particles[j];
+                        if (p1.isPlayer != p2.isPlayer) continue;
 
                         float dx = p2.x - p1.x;
                         float dy = p2.y - p1.y;
                         float dist2 = dx * dx + dy * dy;
 
-                        bool diffType = (p1.isPlayer != p2.isPlayer);
-                        float rSq = diffType ? R_PLAYER_SQ : R_INTERACT_SQ;
-
-                        if (dist2 < rSq && dist2 > 0.001f) {
+                        if (dist2 < R_INTERACT_SQ && dist2 > 0.001f) {
 
                             float dist = std::sqrt(dist2);
                             float invDist = 1.0f / dist;
 
-                            float radius = diffType ? PLAYER_WATER_INTERACTION_RADIUS : INTERACTION_RADIUS;
-                            float f = (radius - dist) * (diffType ? COEFF_PLAYER : COEFF_NORM);
+                            float f = (INTERACTION_RADIUS - dist) * COEFF_NORM;
 
                             float scalar = f * invDist;
                             float pushX = dx * scalar;
@@ -75,35 +73,74 @@ void calculate_forces_for_keys(const std::vector<int>& cell_indices, const Spati
                 }
             }
 
+            // Player-water pairs reach twice as far; they are found only from the player side.
+            if (p1.isPlayer) {
+                for (int ny = cy - REACH_PLAYER; ny <= cy + REACH_PLAYER; ++ny) {
+                    for (int nx = cx - REACH_PLAYER; nx <= cx + REACH_PLAYER; ++nx) {
+                        int neighbor_cell_idx = grid.find_cell(nx, ny);
+                        if (neighbor_cell_idx < 0) continue;
+                        int start2 = grid.cellStart[neighbor_cell_idx];
+                        int end2 = start2 + grid.cellCount[neighbor_cell_idx];
+
+                        for (int j = start2; j < end2; ++j) {
+                            const Particle& p2 = particles[j];
+                            if (p2.isPlayer) continue;
+
+                            float dx = p2.x - p1.x;
+                            float dy = p2.y - p1.y;
+                            float dist2 = dx * dx + dy * dy;
+
+                            if (dist2 < R_PLAYER_SQ && dist2 > 0.001f) {
+                                float dist = std::sqrt(dist2);
+                                float f = (PLAYER_WATER_INTERACTION_RADIUS - dist) * COEFF_PLAYER;
+
+                                float scalar = f / dist;
+                                float pushX = dx * scalar;
+                                float pushY = dy * scalar;
+
+                                local_forces[i].fx -= pushX;
+                                local_forces[i].fy -= pushY;
+                                local_forces[j].fx += pushX;
+                                local_forces[j].fy += pushY;
+                            }
+                        }
+                    }
+                }
+            }
+
             if (!p1.isPlayer) {
                 int bx = (int)(p1.x / DENSITY_BUFFER_SCALE);
                 int by = (int)(p1.y / DENSITY_BUFFER_SCALE);
 
-                if (bx > 0 && bx < density_buffer_width - 1 && by > 0 && by < density_buffer_height - 1) {
-                    float dens = density_buffer[by * density_buffer_width + bx];
+                if (bx > 0 && bx < density.width - 1 && by > 0 && by < density.height - 1) {
+                    float dens = density.at(bx, by);
 
                     if (dens > 12.0f) {
                         const int K_SAMPLES = 24;
                         float sx = 0.0f, sy = 0.0f;
                         int sc = 0;
 
-                        for (int ny = cy - 1; ny <= cy + 1 && sc < K_SAMPLES; ++ny) {
-                            if (ny < 0 || ny >= rows) continue;
-                            for (int nx = cx - 1; nx <= cx + 1 && sc < K_SAMPLES; ++nx) {
-                                if (nx < 0 || nx >= cols) continue;
-                                int nidx = nx + ny * cols;
-
-                                int n_start = grid.cellStart[nidx];
-                                int n_end = n_start + grid.cellCount[nidx];
-
-                                for (int k = n_start; k < n_end && sc < K_SAMPLES; ++k) {
-                                    if (k != i && !particles[k].isPlayer) {
-                                        float dx = particles[k].x - p1.x;
-                                        float dy = particles[k].y - p1.y;
-                                        if (dx * dx + dy * dy < 2500.0f) {
-                                            sx += particles[k].x;
-                                            sy += particles[k].y;
-                                            sc++;
+                        // Walk the stencil ring by ring so the sample cap keeps the nearest neighbours.
+                        for (int ring = 0; ring <= REACH_SAMPLE && sc < K_SAMPLES; ++ring) {
+                            for (int ny = cy - ring; ny <= cy + ring && sc < K_SAMPLES; ++ny) {
+                                bool edgeRow = (ny == cy - ring || ny == cy + ring);
+                                int step = edgeRow ? 1 : 2 * ring;
+                                for (int nx = cx - ring; nx <= cx + ring && sc < K_SAMPLES; nx += step) {
+                                    int nidx = grid.find_cell(nx, ny);
+                                    if (nidx < 0) continue;
+
+                                    int n_start = grid.cellStart[nidx];
+                                    int n_end = n_start + grid.cellCount[nidx];
+
+                                    for (int k = n_start; k < n_end && sc < K_SAMPLES; ++k) {
+                                        if (k != i && !particles[k].isPlayer) {
+                                            float dx = particles[k].x - p1.x;
+                                            float dy = particles[k].y - p1.y;
+                                            if (dx * dx + dy * dy < SAMPLE_RADIUS * SAMPLE_RADIUS) {
+                                                sx += particles[k].x;
+                                                sy += particles[k].y;
+                                                sc++;
+                                            }
                                         }
                                     }
                                 }
@@ -118,8 +155,8 @@ void calculate_forces_for_keys(const std::vector<int>& cell_indices, const Spati
                         }
                     }
                     else {
-                        float gx = density_buffer[by * density_buffer_width + bx + 1] - density_buffer[by * density_buffer_width + bx - 1];
-                        float gy = density_buffer[(by + 1) * density_buffer_width + bx] - density_buffer[(by - 1) * density_buffer_width + bx];
+                        float gx = density.at(bx + 1, by) - density.at(bx - 1, by);
+                        float gy = density.at(bx, by + 1) - density.at(bx, by - 1);
                         local_forces[i].fx -= gx * 0.0005f;
                         local_forces[i].fy -= gy * 0.0005f;
                     }
@@ -129,7 +166,32 @@ void calculate_forces_for_keys(const std::vector<int>& cell_indices, const Spati
     }
 }
 
-void calculate_player_cohesion_forces(std::vector<Vector2D>& forces) {
+void update_sleeping_cells(World& world) {
+    SpatialGrid& grid = world.grid;
+    const int playerReach = (int)std::ceil(PLAYER_WATER_INTERACTION_RADIUS * grid.invCellSize);
+    const int heatReach = (int)std::ceil(30.0f * grid.invCellSize);
+
+    for (const auto& p : world.particles) {
+        if (p.isPlayer) grid.disturb(p.x, p.y, playerReach);
+    }
+
+    for (const auto& rf : world.rainbowFragments) {
+        if (rf.type == 1 || rf.type == 2) grid.disturb(rf.x, rf.y, heatReach);
+    }
+
+    for (const auto& bp : world.brushParticles) {
+        if (bp.type == BRUSH_BLUE && !bp.absorbed) {
+            int reach = (int)std::ceil(bp.baseSize * 0.55f * 0.6f * grid.invCellSize);
+            grid.disturb(bp.x, bp.y, reach);
+        }
+    }
+
+    grid.update_sleep(world.particles);
+}
+
+void calculate_player_cohesion_forces(World& world) {
+    std::vector<Particle>& particles = world.particles;
+    std::vector<Vector2D>& forces = world.forces;
     float centerX = 0.0f;
     float centerY = 0.0f;
     int count = 0;
@@ -155,15 +217,18 @@ void calculate_player_cohesion_forces(std::vector<Vector2D>& forces) {
     }
 }
 
-void calculate_mouse_interaction_forces(int mx, int my, bool leftDown, std::vector<Vector2D>& forces, bool playerSunMode) {
-    if (!leftDown) {
+void calculate_mouse_interaction_forces(World& world, const SimInput& in) {
+    if (!in.mouseDown) {
         return;
     }
+    std::vector<Particle>& particles = world.particles;
+    std::vector<Vector2D>& forces = world.forces;
+    const int mx = in.mouseX, my = in.mouseY;
     for (size_t i = 0; i < particles.size(); ++i) {
         if (particles[i].isPlayer) {
             float dx = mx - particles[i].x;
             float dy = my - particles[i].y;
-            if (playerSunMode) {
+            if (world.playerSunMode) {
                 forces[i].fx += dx * 0.015f * MOUSE_FORCE;
                 forces[i].fy += dy * 0.015f * MOUSE_FORCE;
             }
@@ -175,10 +240,13 @@ void calculate_mouse_interaction_forces(int mx, int my, bool leftDown, std::vect
     }
 }
 
-void apply_forces_to_particles(std::vector<Vector2D>& forces) {
+void apply_forces_to_particles(World& world) {
+    std::vector<Particle>& particles = world.particles;
+    const std::vector<Vector2D>& forces = world.forces;
+    const int WORLD_WIDTH = world.width, WORLD_HEIGHT = world.height;
     for (size_t i = 0; i < particles.size(); ++i) {
 
-        if (particles[i].x < -5000.0f) continue;
+        if (particles[i].asleep) continue;
 
         if (!particles[i].isPlayer) {
             if (particles[i].temperature > 0.0f) {
@@ -193,8 +261,8 @@ void apply_forces_to_particles(std::vector<Vector2D>& forces) {
                 particles[i].vy *= 0.90f;
 
                 float jitterStrength = (temp - 0.8f) * 0.5f;
-                particles[i].vx += ((rand() % 100) / 50.0f - 1.0f) * jitterStrength;
-                particles[i].vy += ((rand() % 100) / 50.0f - 1.0f) * jitterStrength;
+                particles[i].vx += ((world.random() % 100) / 50.0f - 1.0f) * jitterStrength;
+                particles[i].vy += ((world.random() % 100) / 50.0f - 1.0f) * jitterStrength;
             }
             else {
                 particles[i].vy += GRAVITY;
@@ -216,69 +284,43 @@ void apply_forces_to_particles(std::vector<Vector2D>& forces) {
         particles[i].x += particles[i].vx;
         particles[i].y += particles[i].vy;
 
-        float jitter = (rand() & 15) * 0.01f;
+        float jitter = (world.random() & 15) * 0.01f;
         if (particles[i].x < RADIUS) {
             particles[i].x = RADIUS + jitter;
             particles[i].vx *= -0.5f;
         }
-        if (particles[i].x > SCREEN_WIDTH - RADIUS) {
-            particles[i].x = SCREEN_WIDTH - RADIUS - jitter;
+        if (particles[i].x > WORLD_WIDTH - RADIUS) {
+            particles[i].x = WORLD_WIDTH - RADIUS - jitter;
             particles[i].vx *= -0.5f;
         }
         if (particles[i].y < RADIUS) {
             particles[i].y = RADIUS + jitter;
             particles[i].vy *= -0.5f;
         }
-        if (particles[i].y > SCREEN_HEIGHT - RADIUS) {
-            particles[i].y = SCREEN_HEIGHT - RADIUS - jitter;
+        if (particles[i].y > WORLD_HEIGHT - RADIUS) {
+            particles[i].y = WORLD_HEIGHT - RADIUS - jitter;
             particles[i].vy *= -0.5f;
         }
     }
 }
 
-static const float BRUSH_GRID_CELL_SIZE = 100.0f;
-static std::vector<std::vector<BrushParticle*>> fastBrushGrid;
-
-void update_rainbow_fragments() {
-    size_t count = rainbowFragments.size();
-    for (size_t i = 0; i < count; ) {
-        RainbowFragment& rf = rainbowFragments[i];
+void update_rainbow_fragments(World& world) {
+    MemScope mem(MEM_SIMULATION);
+    world.rainbowFragments.advance();
 
-        rf.t += 0.016f;
+    for (RainbowFragment& rf : world.rainbowFragments) {
+        rf.t += FRAGMENT_DT;
         rf.vx *= 0.98f;
         rf.vy *= 0.98f;
         rf.x += rf.vx;
         rf.y += rf.vy;
-
-        bool isDead = (rf.t > rf.life || rf.size < 1.5f);
-
-        if (isDead) {
-            rainbowFragments[i] = rainbowFragments.back();
-            rainbowFragments.pop_back();
-            count--;
-        }
-        else {
-            i++;
-        }
     }
 }
 
-void update_brush_particles(bool brushMode, bool& playerSunMode, float& playerSunTimer) {
-
-    int gridCols = (SCREEN_WIDTH / (int)BRUSH_GRID_CELL_SIZE) + 1;
-    int gridRows = (SCREEN_HEIGHT / (int)BRUSH_GRID_CELL_SIZE) + 1;
-    if (fastBrushGrid.size() != gridCols * gridRows) fastBrushGrid.resize(gridCols * gridRows);
-    for (auto& cell : fastBrushGrid) cell.clear();
-
-    for (size_t k = 0; k < brushParticles.size(); ++k) {
-        if (brushParticles[k].type == BRUSH_BLUE && !brushParticles[k].absorbed) {
-            int cx = (int)(brushParticles[k].x / BRUSH_GRID_CELL_SIZE);
-            int cy = (int)(brushParticles[k].y / BRUSH_GRID_CELL_SIZE);
-            if (cx >= 0 && cx < gridCols && cy >= 0 && cy < gridRows) {
-                fastBrushGrid[cx + cy * gridCols].push_back(&brushParticles[k]);
-            }
-        }
-    }
+void update_brush_particles(World& world, const SimInput& in) {
+    MemScope mem(MEM_SIMULATION);
+    std::vector<BrushParticle>& brushParticles = world.brushParticles;
+    const int WORLD_HEIGHT = world.height;
 
     size_t count = brushParticles.size();
     size_t i = 0;
@@ -293,19 +335,17 @@ void update_brush_particles(bool brushMode, bool& playerSunMode, float& playerSu
                 brushParticles[i].y += brushParticles[i].vy;
 
                 bool hitWater = false;
-                if (brushParticles[i].y > SCREEN_HEIGHT * 0.1f) {
+                if (brushParticles[i].y > in.viewY + in.viewH * 0.1f) {
                     int bx = (int)(brushParticles[i].x / DENSITY_BUFFER_SCALE);
                     int by = (int)((brushParticles[i].y + 20) / DENSITY_BUFFER_SCALE);
-                    if (bx >= 0 && bx < density_buffer_width && by >= 0 && by < density_buffer_height) {
-                        if (density_buffer[by * density_buffer_width + bx] > 0.5f) hitWater = true;
-                    }
+                    if (world.density.at(bx, by) > 0.5f) hitWater = true;
                 }
-                if (brushParticles[i].y > SCREEN_HEIGHT - 10) hitWater = true;
+                if (brushParticles[i].y > WORLD_HEIGHT - 10) hitWater = true;
 
                 if (hitWater) {
                     brushParticles[i].absorbed = true;
                     brushParticles[i].dissolveFrame = 1;
-                    if (rand() % 20 == 0) request_play(explosionSound);
+                    if (world.random() % 20 == 0) world.emit(SIM_SOUND_EXPLOSION);
                     if (brushParticles.size() < MAX_BRUSH_PARTICLES) {
                         BrushParticle boom;
                         float tx = brushParticles[i].x; float ty = brushParticles[i].y;
@@ -314,33 +354,33 @@ void update_brush_particles(bool brushMode, bool& playerSunMode, float& playerSu
                         boom.dissolveFrame = 4; boom.absorbed = false;
                         brushParticles.push_back(boom);
                     }
-                    if (rand() % 3 == 0) spawnExplosionFragments(brushParticles[i].x, brushParticles[i].y);
-                    if (rand() % 5 == 0) spawnRainbowFragments(brushParticles[i].x, brushParticles[i].y, 0, 0.8f);
+                    if (world.random() % 3 == 0) spawnExplosionFragments(world, brushParticles[i].x, brushParticles[i].y);
+                    if (world.random() % 5 == 0) spawnRainbowFragments(world, brushParticles[i].x, brushParticles[i].y, 0, 0.8f);
                 }
             }
         }
         else if (type == BRUSH_EXPLOSIVE) {
             if (!brushParticles[i].absorbed) {
-                brushParticles[i].x += ((rand() % 10) - 5) * 0.2f;
-                brushParticles[i].y += ((rand() % 10) - 5) * 0.2f;
-                if (rand() % 4 == 0) {
+                brushParticles[i].x += ((world.random() % 10) - 5) * 0.2f;
+                brushParticles[i].y += ((world.random() % 10) - 5) * 0.2f;
+                if (world.random() % 4 == 0) {
                     RainbowFragment spark;
-                    spark.x = brushParticles[i].x + ((rand() % 10) - 5);
-                    spark.y = brushParticles[i].y + ((rand() % 10) - 5);
-                    spark.vx = ((rand() % 10) - 5) * 0.3f;
-                    spark.vy = -1.0f - (rand() % 10) * 0.2f;
+                    spark.x = brushParticles[i].x + ((world.random() % 10) - 5);
+                    spark.y = brushParticles[i].y + ((world.random() % 10) - 5);
+                    spark.vx = ((world.random() % 10) - 5) * 0.3f;
+                    spark.vy = -1.0f - (world.random() % 10) * 0.2f;
                     spark.life = 0.5f; spark.size = 4.0f; spark.t = 0; spark.type = 0; spark.alpha0 = 0.8f;
-                    if (rainbowFragments.size() < MAX_RAINBOW_FRAGMENTS) rainbowFragments.push_back(spark);
+                    if (world.rainbowFragments.size() < MAX_RAINBOW_FRAGMENTS) push_rainbow_fragment(world, spark);
                 }
-                if (!brushMode && brushParticles[i].t > 2.0f) {
-                    for (auto& p : particles) {
+                if (!in.brushMode && brushParticles[i].t > 2.0f) {
+                    for (auto& p : world.particles) {
                         if (p.isPlayer) {
                             float dx = p.x - brushParticles[i].x; float dy = p.y - brushParticles[i].y;
                             if (dx * dx + dy * dy < (brushParticles[i].baseSize * 0.8f) * (brushParticles[i].baseSize * 0.8f)) {
                                 brushParticles[i].absorbed = true; brushParticles[i].dissolveFrame = 1;
-                                request_play(explosionSound);
-                                playerSunMode = true; playerSunTimer = 10.0f;
-                                spawnExplosionFragments(brushParticles[i].x, brushParticles[i].y);
+                                world.emit(SIM_SOUND_EXPLOSION);
+                                world.playerSunMode = true; world.playerSunTimer = 10.0f;
+                                spawnExplosionFragments(world, brushParticles[i].x, brushParticles[i].y);
                                 break;
                             }
                         }
@@ -366,9 +406,9 @@ void update_brush_particles(bool brushMode, bool& playerSunMode, float& playerSu
         if (brushParticles[i].dissolveFrame > 0) {
             brushParticles[i].dissolveFrame++;
             if (type == BRUSH_RAINBOW && brushParticles[i].dissolveFrame == 1) {
-                spawnRainbowFragments(brushParticles[i].x, brushParticles[i].y, brushParticles[i].t, 44); request_play(rainbowSound);
+                spawnRainbowFragments(world, brushParticles[i].x, brushParticles[i].y, brushParticles[i].t, 44); world.emit(SIM_SOUND_RAINBOW);
             }
-            if (type == BRUSH_BLUE && brushParticles[i].dissolveFrame == 1) request_play(blueSound);
+            if (type == BRUSH_BLUE && brushParticles[i].dissolveFrame == 1) world.emit(SIM_SOUND_BLUE);
         }
         else {
             if (type == BRUSH_BLUE) {
@@ -389,23 +429,13 @@ void update_brush_particles(bool brushMode, bool& playerSunMode, float& playerSu
     if (brushParticles.size() > MAX_BRUSH_PARTICLES) brushParticles.resize(MAX_BRUSH_PARTICLES);
 }
 
-void resolve_brush_collisions(bool brushMode, float avgPlayerVx, float avgPlayerVy, bool& playerRainbow, float& playerRainbowTimer, float& playerJumpTimer) {
-    int brushGridCols = (SCREEN_WIDTH / (int)BRUSH_GRID_CELL_SIZE) + 1;
-    int brushGridRows = (SCREEN_HEIGHT / (int)BRUSH_GRID_CELL_SIZE) + 1;
-
-    if (fastBrushGrid.size() != brushGridCols * brushGridRows) fastBrushGrid.resize(brushGridCols * brushGridRows);
-    for (auto& cell : fastBrushGrid) cell.clear();
+void resolve_brush_collisions(World& world) {
+    std::vector<BrushParticle>& brushParticles = world.brushParticles;
+    BrushGrid& brushGrid = world.brushGrid;
+    const float avgPlayerVx = world.avgVx, avgPlayerVy = world.avgVy;
 
-    for (size_t i = 0; i < brushParticles.size(); ++i) {
-        BrushParticle& bp = brushParticles[i];
-        if (!bp.absorbed) {
-            int cx = (int)(bp.x / BRUSH_GRID_CELL_SIZE);
-            int cy = (int)(bp.y / BRUSH_GRID_CELL_SIZE);
-            if (cx >= 0 && cx < brushGridCols && cy >= 0 && cy < brushGridRows) {
-                fastBrushGrid[cx + cy * brushGridCols].push_back(&bp);
-            }
-        }
-    }
+    brushGrid.rebuild(brushParticles);
+    if (brushGrid.items.empty()) return;
 
     const float BRUSH_SURFACE_FACTOR = 0.55f;
     const float SURFACE_RADIUS_FACTOR = 0.6f;
@@ -416,15 +446,17 @@ void resolve_brush_collisions(bool brushMode, float avgPlayerVx, float avgPlayer
     bool playerMoving = (playerSpeed > 1e-3f);
     if (playerMoving) { playerDirX = avgPlayerVx / playerSpeed; playerDirY = avgPlayerVy / playerSpeed; }
 
-    for (auto& p : particles) {
-        int cx = (int)(p.x / BRUSH_GRID_CELL_SIZE);
-        int cy = (int)(p.y / BRUSH_GRID_CELL_SIZE);
+    for (auto& p : world.particles) {
+        int cx = BrushGrid::cell_of(p.x);
+        int cy = BrushGrid::cell_of(p.y);
 
         for (int ny = cy - 1; ny <= cy + 1; ++ny) {
             for (int nx = cx - 1; nx <= cx + 1; ++nx) {
-                if (nx >= 0 && nx < brushGridCols && ny >= 0 && ny < brushGridRows) {
-                    for (BrushParticle* bp_ptr : fastBrushGrid[nx + ny * brushGridCols]) {
-                        BrushParticle& bp = *bp_ptr;
+                int cell = brushGrid.find_cell(nx, ny);
+                if (cell >= 0) {
+                    int end = brushGrid.cellStart[cell] + brushGrid.cellCount[cell];
+                    for (int k = brushGrid.cellStart[cell]; k < end; ++k) {
+                        BrushParticle& bp = brushParticles[brushGrid.items[k]];
 
                         if (bp.absorbed) continue;
 
@@ -463,8 +495,7 @@ void resolve_brush_collisions(bool brushMode, float avgPlayerVx, float avgPlayer
                                     bp.vy += (pushY + flowY) * influence * 0.6f;
                                     bp.impact += influence * 1.5f;
                                     if (bp.impact > 10.0f) {
-                                        static Uint32 lastTrig = 0;
-                                        if (SDL_GetTicks() - lastTrig > 80) { request_play(blueSound); lastTrig = SDL_GetTicks(); }
+                                        if (world.timeMs - world.lastBlueImpactMs > 80.0) { world.emit(SIM_SOUND_BLUE); world.lastBlueImpactMs = world.timeMs; }
                                     }
                                 }
                             }
@@ -476,12 +507,12 @@ void resolve_brush_collisions(bool brushMode, float avgPlayerVx, float avgPlayer
                                     bp.absorbed = true; 
                                     bp.dissolveFrame = 1; 
 
-                                    playerRainbow = true;
-                                    playerRainbowTimer = 5.0f;
-                                    playerJumpTimer = 0.5f;
+                                    world.playerRainbow = true;
+                                    world.playerRainbowTimer = 5.0f;
+                                    world.playerJumpTimer = 0.5f;
 
-                                    spawnRainbowFragments(bp.x, bp.y, bp.t, 0.4f);
-                                    request_play(rainbowSound);
+                                    spawnRainbowFragments(world, bp.x, bp.y, bp.t, 0.4f);
+                                    world.emit(SIM_SOUND_RAINBOW);
                                 }
                             }
                         }
@@ -492,29 +523,27 @@ void resolve_brush_collisions(bool brushMode, float avgPlayerVx, float avgPlayer
     }
 }
 
-void apply_heat_from_fragments(const SpatialGrid& grid) {
+void apply_heat_from_fragments(World& world) {
+    const SpatialGrid& grid = world.grid;
+    std::vector<Particle>& particles = world.particles;
+    const int WORLD_WIDTH = world.width, WORLD_HEIGHT = world.height;
     int skipCounter = 0;
+    const int reach = grid.stencil_reach(30.0f);
 
-    for (const auto& rf : rainbowFragments) {
+    for (const auto& rf : world.rainbowFragments) {
         if (rf.type == 0 || rf.type == 3 || rf.type == 4) continue;
         skipCounter++;
         if (skipCounter % 2 != 0) continue;
 
-        if (rf.x < 0 || rf.x >= SCREEN_WIDTH || rf.y < 0 || rf.y >= SCREEN_HEIGHT) continue;
+        if (rf.x < 0 || rf.x >= WORLD_WIDTH || rf.y < 0 || rf.y >= WORLD_HEIGHT) continue;
 
-        int cx = (int)(rf.x * grid.invCellSize);
-        int cy = (int)(rf.y * grid.invCellSize);
-
-        if (cx < 0 || cx >= grid.cols || cy < 0 || cy >= grid.rows) continue;
-
-        for (int ny = cy - 1; ny <= cy + 1; ++ny) {
-            if (ny < 0 || ny >= grid.rows) continue;
-            int y_offset = ny * grid.cols;
-
-            for (int nx = cx - 1; nx <= cx + 1; ++nx) {
-                if (nx < 0 || nx >= grid.cols) continue;
+        int cx = grid.cell_x(rf.x);
+        int cy = grid.cell_y(rf.y);
 
-                int cell_idx = nx + y_offset;
+        for (int ny = cy - reach; ny <= cy + reach; ++ny) {
+            for (int nx = cx - reach; nx <= cx + reach; ++nx) {
+                int cell_idx = grid.find_cell(nx, ny);
+                if (cell_idx < 0) continue;
 
                 int start = grid.cellStart[cell_idx];
                 int count = grid.cellCount[cell_idx];
@@ -0,0 +1,139 @@
+#include "Profiler.h"
+#include "AllocCounter.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> profilerRecording{ false };
+
+struct ThreadRing {
+    ProfileEvent events[PROFILER_RING_SIZE];
+    std::atomic<uint64_t> head{ 0 };
+    const char* threadName = nullptr;
+    int tid = 0;
+};
+
+// Rings are created on a thread's first recorded zone, or ahead of time by
+// profiler_make_ring(), and live until exit, so a thread that has finished still
+// shows up in the next export.
+static std::mutex ringsMutex;
+static std::vector<std::unique_ptr<ThreadRing>> rings;
+static thread_local ThreadRing* localRing = nullptr;
+static thread_local bool localRingFixed = false;
+static thread_local const char* localName = nullptr;
+
+static const std::chrono::steady_clock::time_point profilerEpoch = std::chrono::steady_clock::now();
+// When the current capture started. Zones that began earlier belong to an older
+// capture, or were opened before it and ended inside it.
+static std::atomic<int64_t> captureStartNs{ 0 };
+
+int64_t profiler_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profilerEpoch).count();
+}
+
+static ThreadRing* register_ring(const char* threadName) {
+    MemScope mem(MEM_PROFILER);
+    std::unique_ptr<ThreadRing> ring(new ThreadRing());
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    ring->tid = (int)rings.size() + 1;
+    ring->threadName = threadName;
+    rings.push_back(std::move(ring));
+    return rings.back().get();
+}
+
+static ThreadRing* thread_ring() {
+    if (!localRing && !localRingFixed) localRing = register_ring(localName);
+    return localRing;
+}
+
+ThreadRing* profiler_make_ring(const char* threadName) {
+    return register_ring(threadName);
+}
+
+ProfilerThreadState profiler_enter_ring(ThreadRing* ring) {
+    ProfilerThreadState outer = { localRing, localRingFixed };
+    localRing = ring;
+    localRingFixed = true;
+    return outer;
+}
+
+void profiler_leave_ring(ProfilerThreadState outer) {
+    localRing = outer.ring;
+    localRingFixed = outer.fixed;
+}
+
+void profiler_name_thread(const char* name) {
+    if (localName == name || localRingFixed) return;
+    localName = name;
+    if (localRing) {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        localRing->threadName = name;
+    }
+}
+
+void profiler_record(const char* name, int64_t startNs, int64_t endNs) {
+    ThreadRing* ring = thread_ring();
+    if (!ring) return;
+    uint64_t h = ring->head.load(std::memory_order_relaxed);
+    ring->events[h & (PROFILER_RING_SIZE - 1)] = { name, startNs, endNs };
+    ring->head.store(h + 1, std::memory_order_release);
+}
+
+void profiler_start() {
+    captureStartNs.store(profiler_now_ns(), std::memory_order_relaxed);
+    profilerRecording.store(true, std::memory_order_relaxed);
+}
+
+void profiler_stop() {
+    profilerRecording.store(false, std::memory_order_relaxed);
+}
+
+static void write_json_string(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') fputc('\\', out);
+        fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+int profiler_export_chrome_trace(const char* path) {
+    profiler_stop();
+    FILE* out = fopen(path, "w");
+    if (!out) return -1;
+
+    // A zone that was open when recording stopped may still land in the slot after
+    // head; on a full ring that is the oldest one, so a margin of old zones is left
+    // out rather than read while it is being overwritten.
+    const uint64_t WRAP_MARGIN = 256;
+
+    const int64_t captureStart = captureStartNs.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+    int written = 0;
+    for (const auto& ring : rings) {
+        fprintf(out, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", ring->tid);
+        if (ring->threadName) write_json_string(out, ring->threadName);
+        else fprintf(out, "\"thread %d\"", ring->tid);
+        fprintf(out, "}}");
+        first = false;
+
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t begin = 0;
+        if (head > PROFILER_RING_SIZE) begin = head - PROFILER_RING_SIZE + WRAP_MARGIN;
+        for (uint64_t i = begin; i < head; ++i) {
+            const ProfileEvent& e = ring->events[i & (PROFILER_RING_SIZE - 1)];
+            if (e.startNs < captureStart) continue;
+            fprintf(out, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"name\":", ring->tid);
+            write_json_string(out, e.name);
+            fprintf(out, ",\"ts\":%.3f,\"dur\":%.3f}", e.startNs * 1e-3, (e.endNs - e.startNs) * 1e-3);
+            written++;
+        }
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    return written;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+// Scoped-zone profiler. Every thread that records owns a fixed ring of zones that
+// only it writes, so recording takes no lock: two clock reads and a store. The
+// rings are exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+//
+// Build with PROFILER_ENABLED=0 to compile every zone out. Compiled in, a zone
+// costs one relaxed load until recording is switched on.
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+// Zones kept per thread; older ones are overwritten.
+const int PROFILER_RING_SIZE = 1 << 15;
+
+struct ProfileEvent {
+    const char* name;   // must outlive the export: a literal or a static table
+    int64_t startNs;
+    int64_t endNs;
+};
+
+extern std::atomic<bool> profilerRecording;
+
+int64_t profiler_now_ns();
+// Name shown for the calling thread in the trace. Cheap to call repeatedly.
+void profiler_name_thread(const char* name);
+void profiler_record(const char* name, int64_t startNs, int64_t endNs);
+
+// A thread's ring is normally made, under a lock, on its first recorded zone. A
+// thread that must never lock or allocate (the audio callback) is handed a ring
+// made ahead of time instead, through a ProfileRingScope.
+struct ThreadRing;
+ThreadRing* profiler_make_ring(const char* threadName);
+
+struct ProfilerThreadState {
+    ThreadRing* ring;
+    bool fixed;     // zones go to `ring` or nowhere; no ring is ever made
+};
+ProfilerThreadState profiler_enter_ring(ThreadRing* ring);
+void profiler_leave_ring(ProfilerThreadState outer);
+
+void profiler_start();
+void profiler_stop();
+inline bool profiler_recording() { return profilerRecording.load(std::memory_order_relaxed); }
+// Stops recording and writes the zones every thread recorded since the last
+// profiler_start() as Chrome trace JSON; the rings keep older captures, which are
+// left out. Returns the number of zones written, or -1 if the file could not be
+// opened.
+int profiler_export_chrome_trace(const char* path);
+
+// Records the calling thread's zones into `ring` for the scope, then gives the
+// thread its own ring back. Zones inside neither lock nor allocate; with a null
+// ring they are dropped.
+class ProfileRingScope {
+public:
+    explicit ProfileRingScope(ThreadRing* ring) : outer(profiler_enter_ring(ring)) {}
+    ~ProfileRingScope() { profiler_leave_ring(outer); }
+    ProfileRingScope(const ProfileRingScope&) = delete;
+    ProfileRingScope& operator=(const ProfileRingScope&) = delete;
+private:
+    ProfilerThreadState outer;
+};
+
+class ProfileZone {
+public:
+    explicit ProfileZone(const char* name) { begin(name); }
+    ~ProfileZone() { end(); }
+
+    // Ends the current zone and opens the next one, for a run of passes in one scope.
+    void next(const char* name) {
+        end();
+        begin(name);
+    }
+
+private:
+    void begin(const char* zoneName) {
+        name = zoneName;
+        start = profiler_recording() ? profiler_now_ns() : -1;
+    }
+    void end() {
+        if (start >= 0) profiler_record(name, start, profiler_now_ns());
+        start = -1;
+    }
+
+    const char* name;
+    int64_t start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if PROFILER_ENABLED
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_SPAN(var, name) ProfileZone var(name)
+#define PROFILE_NEXT(var, name) var.next(name)
+#define PROFILE_THREAD(name) profiler_name_thread(name)
+#define PROFILE_RING(ring) ProfileRingScope PROFILE_CONCAT(profileRing, __LINE__)(ring)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_SPAN(var, name) ((void)0)
+#define PROFILE_NEXT(var, name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#define PROFILE_RING(ring) ((void)0)
+#endif
@@ -1,8 +1,13 @@
 ﻿#include "Render.h"
-#include "GameLogic.h" 
+#include "GameLogic.h"
+#include "AssetPack.h"
+#include "MusicAnalysis.h"
+#include "Profiler.h"
+#include "AllocCounter.h"
 #include <cmath>
 #include <algorithm>
 #include<random>
+#include <thread>
 #undef min
 #undef max
 
@@ -21,8 +26,17 @@ struct Nebula {
     Uint8 r, g, b, a;
 };
 
+RenderStats renderStats;
+
+static inline void count_draw(int vertices) {
+    renderStats.drawCalls++;
+    renderStats.vertices += vertices;
+}
+
 static std::vector<Star> stars;
 static std::vector<Nebula> nebulas;
+// Music spectrum for the sky, read once per frame in draw_alien_sky_elements.
+static MusicFeatures skyMusic;
 
 float smoothstep(float edge0, float edge1, float x) {
     float t = (std::max)(0.0f, (std::min)(1.0f, (x - edge0) / (edge1 - edge0)));
@@ -74,60 +88,69 @@ void init_alien_sky(int w, int h) {
     }
 }
 
-SDL_Texture* create_brush_texture(SDL_Renderer* renderer, int size) {
-    SDL_Texture* tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, size, size);
-    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_ADD);
-    SDL_SetRenderTarget(renderer, tex);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-    SDL_RenderClear(renderer);
+static inline Uint32 pack_rgba(Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+    return ((Uint32)r << 24) | ((Uint32)g << 16) | ((Uint32)b << 8) | (Uint32)a;
+}
+
+// Procedural textures are drawn on the CPU, rows split across threads, and handed
+// to SDL in one SDL_UpdateTexture instead of one draw call per texel.
+template <typename RowFn>
+static std::vector<Uint32> rasterize(int size, RowFn row) {
+    std::vector<Uint32> pixels((size_t)size * size, 0);
+
+    unsigned int n_threads = std::thread::hardware_concurrency();
+    if (n_threads == 0) n_threads = 4;
+    int bands = std::max(1, std::min((int)n_threads, size / 16));
+    std::vector<std::thread> workers;
+    for (int b = 1; b < bands; ++b) {
+        workers.emplace_back([&, b] {
+            for (int y = size * b / bands; y < size * (b + 1) / bands; ++y) row(y, &pixels[(size_t)y * size]);
+            });
+    }
+    for (int y = 0; y < size / bands; ++y) row(y, &pixels[(size_t)y * size]);
+    for (auto& w : workers) w.join();
+    return pixels;
+}
+
+SDL_Texture* upload_texture(SDL_Renderer* renderer, int size, SDL_BlendMode mode, const Uint32* pixels) {
+    SDL_Texture* tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC, size, size);
+    SDL_SetTextureBlendMode(tex, mode);
+    SDL_UpdateTexture(tex, NULL, pixels, size * (int)sizeof(Uint32));
+    return tex;
+}
+
+static std::vector<Uint32> brush_pixels(int size) {
     float cx = size / 2.0f;
-    for (int y = 0; y < size; ++y) {
+    return rasterize(size, [=](int y, Uint32* row) {
         for (int x = 0; x < size; ++x) {
             float dx = x - cx, dy = y - cx;
             float dist = sqrtf(dx * dx + dy * dy) / (size / 2.0f);
             float alpha = 0.0f;
             if (dist < 1.0f) alpha = powf(1.0f - dist, 2.5f) * 180;
             if (dist < 0.4f) alpha += powf(1.0f - dist / 0.4f, 2.0f) * 80;
-            SDL_SetRenderDrawColor(renderer, 120, 200, 255, (Uint8)alpha);
-            SDL_RenderDrawPoint(renderer, x, y);
+            row[x] = pack_rgba(120, 200, 255, (Uint8)alpha);
         }
-    }
-    SDL_SetRenderTarget(renderer, NULL);
-    return tex;
+        });
 }
 
-SDL_Texture* create_dot_texture(SDL_Renderer* renderer, int size) {
-    SDL_Texture* tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, size, size);
-    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_ADD);
-    SDL_SetRenderTarget(renderer, tex);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-    SDL_RenderClear(renderer);
+static std::vector<Uint32> dot_pixels(int size) {
     float cx = size / 2.0f;
-    for (int y = 0; y < size; ++y) {
+    return rasterize(size, [=](int y, Uint32* row) {
         for (int x = 0; x < size; ++x) {
             float dx = x - cx, dy = y - cx;
             float dist = sqrtf(dx * dx + dy * dy) / (size / 2.0f);
             if (dist < 1.0f) {
                 float alpha = powf(1.0f - dist, 2.5f) * 255;
-                SDL_SetRenderDrawColor(renderer, 255, 255, 255, (Uint8)alpha);
-                SDL_RenderDrawPoint(renderer, x, y);
+                row[x] = pack_rgba(255, 255, 255, (Uint8)alpha);
             }
         }
-    }
-    SDL_SetRenderTarget(renderer, NULL);
-    return tex;
+        });
 }
 
-SDL_Texture* create_metaball_particle_texture(SDL_Renderer* renderer, int size) {
-    SDL_Texture* tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, size, size);
-    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_ADD);
-    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "best");
-    SDL_SetRenderTarget(renderer, tex);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-    SDL_RenderClear(renderer);
+static std::vector<Uint32> metaball_particle_pixels(int size) {
     float c = size * 0.5f;
     float draw_r = c * 0.9f;
-    for (int y = 0; y < size; ++y) {
+    return rasterize(size, [=](int y, Uint32* row) {
         for (int x = 0; x < size; ++x) {
             float dx = x - c + 0.5f, dy = y - c + 0.5f;
             float distSq = dx * dx + dy * dy;
@@ -136,84 +159,59 @@ SDL_Texture* create_metaball_particle_texture(SDL_Renderer* renderer, int size)
                 float t = dist / draw_r;
                 float alpha = expf(-t * t * 5.0f) * 255.0f;
                 if (alpha > 255.0f) alpha = 255.0f;
-                if (alpha > 1.0f) {
-                    SDL_SetRenderDrawColor(renderer, 255, 255, 255, (Uint8)alpha);
-                    SDL_RenderDrawPoint(renderer, x, y);
-                }
+                if (alpha > 1.0f) row[x] = pack_rgba(255, 255, 255, (Uint8)alpha);
             }
         }
-    }
-    SDL_SetRenderTarget(renderer, NULL);
-    return tex;
+        });
 }
 
-SDL_Texture* create_particle_texture(SDL_Renderer* renderer, int texture_size, SDL_Color color, bool is_glow) {
-    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, texture_size, texture_size);
-    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
-    SDL_SetRenderTarget(renderer, texture);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-    SDL_RenderClear(renderer);
+static std::vector<Uint32> particle_pixels(int texture_size, SDL_Color color, bool is_glow) {
     float center = texture_size / 2.0f;
-    for (int y = 0; y < texture_size; ++y) {
+    return rasterize(texture_size, [=](int y, Uint32* row) {
         for (int x = 0; x < texture_size; ++x) {
             float dist = sqrtf(powf(x - center, 2) + powf(y - center, 2));
             if (dist <= center) {
                 float alpha_ratio = 1.0f - (dist / center);
                 Uint8 a = is_glow ? (Uint8)(color.a * alpha_ratio * alpha_ratio) : (Uint8)(color.a * alpha_ratio);
-                SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, a);
-                SDL_RenderDrawPoint(renderer, x, y);
+                row[x] = pack_rgba(color.r, color.g, color.b, a);
             }
         }
-    }
-    SDL_SetRenderTarget(renderer, NULL);
-    return texture;
+        });
 }
 
-SDL_Texture* create_rainbow_brush_texture(SDL_Renderer* renderer, int size) {
-    SDL_Texture* tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, size, size);
-    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_ADD);
-    SDL_Texture* base_brush = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, size, size);
-    SDL_SetTextureBlendMode(base_brush, SDL_BLENDMODE_BLEND);
-    SDL_SetRenderTarget(renderer, base_brush);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-    SDL_RenderClear(renderer);
+// A tinted soft disc with a white half-size core alpha-blended over it.
+static std::vector<Uint32> rainbow_brush_pixels(int size) {
     float center = size / 2.0f;
-    for (int y = 0; y < size; ++y) {
+    auto base_alpha = [=](float x, float y) -> int {
+        float dist_ratio = sqrtf(powf(x - center, 2) + powf(y - center, 2)) / center;
+        if (dist_ratio > 1.0f) return 0;
+        return (Uint8)(powf(1.0f - dist_ratio, 2.5f) * 255.0f);
+    };
+    const int TINT_ALPHA = (int)(255 * 0.7f), CORE_ALPHA = (int)(255 * 0.35f);
+    const int q = size / 4;
+
+    return rasterize(size, [=](int y, Uint32* row) {
         for (int x = 0; x < size; ++x) {
-            float dist_ratio = sqrtf(powf(x - center, 2) + powf(y - center, 2)) / center;
-            if (dist_ratio <= 1.0f) {
-                float alpha = powf(1.0f - dist_ratio, 2.5f) * 255.0f;
-                SDL_SetRenderDrawColor(renderer, 255, 255, 255, (Uint8)alpha);
-                SDL_RenderDrawPoint(renderer, x, y);
+            int a1 = base_alpha((float)x, (float)y) * TINT_ALPHA / 255;
+            int r = 120 * a1 / 255, g = 200 * a1 / 255, b = 255 * a1 / 255, a = a1;
+
+            if (x >= q && x < q + size / 2 && y >= q && y < q + size / 2) {
+                int a2 = base_alpha(2.0f * (x - q) + 0.5f, 2.0f * (y - q) + 0.5f) * CORE_ALPHA / 255;
+                r = a2 + r * (255 - a2) / 255;
+                g = a2 + g * (255 - a2) / 255;
+                b = a2 + b * (255 - a2) / 255;
+                a = a2 + a * (255 - a2) / 255;
             }
+            row[x] = pack_rgba((Uint8)r, (Uint8)g, (Uint8)b, (Uint8)a);
         }
-    }
-    SDL_SetRenderTarget(renderer, tex);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-    SDL_RenderClear(renderer);
-    SDL_SetTextureColorMod(base_brush, 120, 200, 255);
-    SDL_SetTextureAlphaMod(base_brush, (Uint8)(255 * 0.7f));
-    SDL_RenderCopy(renderer, base_brush, NULL, NULL);
-    SDL_SetTextureColorMod(base_brush, 255, 255, 255);
-    SDL_SetTextureAlphaMod(base_brush, (Uint8)(255 * 0.35f));
-    SDL_Rect core_rect = { size / 4, size / 4, size / 2, size / 2 };
-    SDL_RenderCopy(renderer, base_brush, NULL, &core_rect);
-    SDL_DestroyTexture(base_brush);
-    SDL_SetRenderTarget(renderer, NULL);
-    return tex;
+        });
 }
 
-SDL_Texture* create_plasma_texture(SDL_Renderer* renderer, int size) {
-    SDL_Texture* tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, size, size);
-    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_ADD);
-    SDL_SetRenderTarget(renderer, tex);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-    SDL_RenderClear(renderer);
-
+static std::vector<Uint32> plasma_pixels(int size) {
     float cx = size / 2.0f;
     float maxR = size / 2.0f;
 
-    for (int y = 0; y < size; ++y) {
+    return rasterize(size, [=](int y, Uint32* row) {
         for (int x = 0; x < size; ++x) {
             float dx = x - cx;
             float dy = y - cx;
@@ -229,34 +227,110 @@ SDL_Texture* create_plasma_texture(SDL_Renderer* renderer, int size) {
             float brightness = glow1 + glow2 + core;
             if (brightness > 1.0f) brightness = 1.0f;
 
-            Uint8 val = (Uint8)(brightness * 255);
             Uint8 alpha = (Uint8)(powf(1.0f - t, 0.5f) * 255 * brightness);
-            SDL_SetRenderDrawColor(renderer, 255, 255, 255, alpha);
-            SDL_RenderDrawPoint(renderer, x, y);
+            row[x] = pack_rgba(255, 255, 255, alpha);
         }
-    }
+        });
+}
 
-    SDL_SetRenderTarget(renderer, NULL);
-    return tex;
+SDL_Texture* create_brush_texture(SDL_Renderer* renderer, int size) {
+    return upload_texture(renderer, size, SDL_BLENDMODE_ADD, brush_pixels(size).data());
+}
+
+SDL_Texture* create_dot_texture(SDL_Renderer* renderer, int size) {
+    return upload_texture(renderer, size, SDL_BLENDMODE_ADD, dot_pixels(size).data());
+}
+
+SDL_Texture* create_metaball_particle_texture(SDL_Renderer* renderer, int size) {
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "best");
+    return upload_texture(renderer, size, SDL_BLENDMODE_ADD, metaball_particle_pixels(size).data());
+}
+
+SDL_Texture* create_particle_texture(SDL_Renderer* renderer, int texture_size, SDL_Color color, bool is_glow) {
+    return upload_texture(renderer, texture_size, SDL_BLENDMODE_BLEND, particle_pixels(texture_size, color, is_glow).data());
+}
+
+SDL_Texture* create_rainbow_brush_texture(SDL_Renderer* renderer, int size) {
+    return upload_texture(renderer, size, SDL_BLENDMODE_ADD, rainbow_brush_pixels(size).data());
+}
+
+SDL_Texture* create_plasma_texture(SDL_Renderer* renderer, int size) {
+    return upload_texture(renderer, size, SDL_BLENDMODE_ADD, plasma_pixels(size).data());
+}
+
+struct SpriteRecipe {
+    int size;
+    SDL_BlendMode blend;
+};
+
+static const SpriteRecipe SPRITES[SPRITE_COUNT] = {
+    { 16, SDL_BLENDMODE_BLEND },   // SPRITE_NORMAL_PARTICLE
+    { 16, SDL_BLENDMODE_BLEND },   // SPRITE_PLAYER_PARTICLE
+    { 32, SDL_BLENDMODE_BLEND },   // SPRITE_PLAYER_GLOW
+    { 128, SDL_BLENDMODE_ADD },    // SPRITE_BRUSH
+    { 128, SDL_BLENDMODE_ADD },    // SPRITE_RAINBOW_BRUSH
+    { 16, SDL_BLENDMODE_ADD },     // SPRITE_DOT
+    { 128, SDL_BLENDMODE_ADD },    // SPRITE_METABALL
+    { 64, SDL_BLENDMODE_ADD },     // SPRITE_PLASMA
+};
+
+int sprite_size(SpriteId id) {
+    return SPRITES[id].size;
+}
+
+std::vector<Uint32> generate_sprite_pixels(SpriteId id) {
+    int size = SPRITES[id].size;
+    switch (id) {
+    case SPRITE_NORMAL_PARTICLE: return particle_pixels(size, { 100, 150, 200, 120 }, false);
+    case SPRITE_PLAYER_PARTICLE: return particle_pixels(size, { 220, 240, 255, 255 }, false);
+    case SPRITE_PLAYER_GLOW: return particle_pixels(size, { 80, 120, 200, 255 }, true);
+    case SPRITE_BRUSH: return brush_pixels(size);
+    case SPRITE_RAINBOW_BRUSH: return rainbow_brush_pixels(size);
+    case SPRITE_DOT: return dot_pixels(size);
+    case SPRITE_METABALL: return metaball_particle_pixels(size);
+    case SPRITE_PLASMA: return plasma_pixels(size);
+    default: return std::vector<Uint32>((size_t)size * size, 0);
+    }
 }
 
 void recreate_all_textures(SDL_Renderer* renderer, GameTextures& tex, int width, int height) {
+    MemScope mem(MEM_RENDER);
     destroy_all_textures(tex);
-    tex.normalParticle = create_particle_texture(renderer, 16, { 100, 150, 200, 120 }, false);
-    tex.playerParticle = create_particle_texture(renderer, 16, { 220, 240, 255, 255 }, false);
-    tex.playerGlow = create_particle_texture(renderer, 32, { 80, 120, 200, 255 }, true);
-    tex.brush = create_brush_texture(renderer, 128);
-    tex.rainbowBrush = create_rainbow_brush_texture(renderer, 128);
-    tex.dot = create_dot_texture(renderer, 16);
-    tex.metaballParticle = create_metaball_particle_texture(renderer, 128);
-    tex.plasmaTexture = create_plasma_texture(renderer, 64);
 
+    SDL_Texture** slots[SPRITE_COUNT] = {
+        &tex.normalParticle, &tex.playerParticle, &tex.playerGlow, &tex.brush,
+        &tex.rainbowBrush, &tex.dot, &tex.metaballParticle, &tex.plasmaTexture
+    };
+
+    for (int i = 0; i < SPRITE_COUNT; ++i) {
+        SpriteId id = (SpriteId)i;
+        if (id == SPRITE_METABALL) SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "best");
+        // Baked pixels are uploaded straight out of the mapped asset pack.
+        const Uint32* baked = asset_pack_sprite(id);
+        if (baked) {
+            *slots[i] = upload_texture(renderer, SPRITES[i].size, SPRITES[i].blend, baked);
+        }
+        else {
+            *slots[i] = upload_texture(renderer, SPRITES[i].size, SPRITES[i].blend, generate_sprite_pixels(id).data());
+        }
+        tex.spriteBytes += (int64_t)SPRITES[i].size * SPRITES[i].size * sizeof(Uint32);
+    }
+    mem_note(MEM_TEXTURES, tex.spriteBytes);
+
+    recreate_size_dependent_textures(renderer, tex, width, height);
+
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1");
+}
+
+// Only the fluid render target follows the window; the sprites are fixed-size.
+void recreate_size_dependent_textures(SDL_Renderer* renderer, GameTextures& tex, int width, int height) {
+    if (tex.metaballTarget) SDL_DestroyTexture(tex.metaballTarget);
     int fluidW = (int)(width * FLUID_RENDER_SCALE);
     int fluidH = (int)(height * FLUID_RENDER_SCALE);
     tex.metaballTarget = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, fluidW, fluidH);
+    mem_note(MEM_TEXTURES, (int64_t)fluidW * fluidH * sizeof(Uint32) - tex.targetBytes);
+    tex.targetBytes = (int64_t)fluidW * fluidH * sizeof(Uint32);
     SDL_SetTextureBlendMode(tex.metaballTarget, SDL_BLENDMODE_BLEND);
-
-    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1");
 }
 
 void destroy_all_textures(GameTextures& tex) {
@@ -269,12 +343,44 @@ void destroy_all_textures(GameTextures& tex) {
     if (tex.dot) SDL_DestroyTexture(tex.dot);
     if (tex.metaballParticle) SDL_DestroyTexture(tex.metaballParticle);
     if (tex.metaballTarget) SDL_DestroyTexture(tex.metaballTarget);
+    mem_note(MEM_TEXTURES, -(tex.spriteBytes + tex.targetBytes));
     tex = GameTextures();
 }
 
+void HSVtoRGB(float h, float s, float v, Uint8& r, Uint8& g, Uint8& b) {
+    int i = int(h * 6);
+    float f = h * 6 - i;
+    float p = v * (1 - s);
+    float q = v * (1 - f * s);
+    float t = v * (1 - (1 - f) * s);
+    switch (i % 6) {
+    case 0: r = v * 255; g = t * 255; b = p * 255; break;
+    case 1: r = q * 255; g = v * 255; b = p * 255; break;
+    case 2: r = p * 255; g = v * 255; b = t * 255; break;
+    case 3: r = p * 255; g = q * 255; b = v * 255; break;
+    case 4: r = t * 255; g = p * 255; b = v * 255; break;
+    case 5: r = v * 255; g = p * 255; b = q * 255; break;
+    }
+}
+
+void generateRainbowLUT() {
+    for (int i = 0; i < RAINBOW_LUT_SIZE; ++i) {
+        float h = (float)i / RAINBOW_LUT_SIZE;
+        float s = 0.7f + 0.3f * sin(h * 2.0f * 3.14159f * 2.0f);
+        float v = 0.8f + 0.2f * cos(h * 2.0f * 3.14159f * 3.0f);
+
+        Uint8 r, g, b;
+        HSVtoRGB(h, s, v, r, g, b);
+        rainbowColorLUT[i] = { r, g, b, 255 };
+    }
+}
+
 void drawBoilingSunSurface(SDL_Renderer* renderer, SDL_Texture* texture, float cx, float cy, float radius, SDL_Color color, float time) {
-    std::vector<SDL_Vertex> verts;
-    std::vector<int> indices;
+    // Kept between calls; the sun is drawn every frame.
+    static std::vector<SDL_Vertex> verts;
+    static std::vector<int> indices;
+    verts.clear();
+    indices.clear();
 
     const int SEGMENTS = 64;
     const float ANGLE_STEP = (2.0f * 3.14159f) / SEGMENTS;
@@ -302,6 +408,7 @@ void drawBoilingSunSurface(SDL_Renderer* renderer, SDL_Texture* texture, float c
 
     SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_ADD);
     SDL_RenderGeometry(renderer, texture, verts.data(), (int)verts.size(), indices.data(), (int)indices.size());
+    count_draw((int)verts.size());
 }
 
 void draw_alien_atmosphere(SDL_Renderer* renderer, int w, int h) {
@@ -314,6 +421,9 @@ void draw_alien_atmosphere(SDL_Renderer* renderer, int w, int h) {
         bottomColor.r = (Uint8)(40 + energy * 0.3);
         bottomColor.b = (Uint8)(50 + energy * 0.2);
     }
+    // Bass warms the horizon, the high mids cool it.
+    bottomColor.r = (Uint8)std::min(255.0f, bottomColor.r + skyMusic.band[MUSIC_BASS] * 40.0f);
+    bottomColor.b = (Uint8)std::min(255.0f, bottomColor.b + skyMusic.band[MUSIC_HIGH_MID] * 40.0f);
 
     SDL_Vertex verts[4];
     verts[0] = { {0, 0}, topColor, {0, 0} };
@@ -325,6 +435,7 @@ void draw_alien_atmosphere(SDL_Renderer* renderer, int w, int h) {
 
     SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
     SDL_RenderGeometry(renderer, NULL, verts, 4, indices, 6);
+    count_draw(4);
 }
 
 void draw_giant_planet(SDL_Renderer* renderer, const GameTextures& tex, int w, int h, float time) {
@@ -341,12 +452,14 @@ void draw_giant_planet(SDL_Renderer* renderer, const GameTextures& tex, int w, i
     SDL_SetTextureAlphaMod(tex.playerGlow, 100);
     SDL_Rect r1 = { (int)(px - radius), (int)(py - radius), (int)(radius * 2), (int)(radius * 2) };
     SDL_RenderCopy(renderer, tex.playerGlow, NULL, &r1);
+    count_draw(4);
 
-    float outerR = radius * (1.2f + energy * 0.2f);
+    float outerR = radius * (1.2f + energy * 0.2f + skyMusic.band[MUSIC_BASS] * 0.15f + skyMusic.onset * 0.1f);
     SDL_SetTextureColorMod(tex.playerGlow, 40, 20, 60);
-    SDL_SetTextureAlphaMod(tex.playerGlow, (Uint8)(60 + energy * 100));
+    SDL_SetTextureAlphaMod(tex.playerGlow, (Uint8)std::min(255.0f, 60 + energy * 100 + skyMusic.onset * 60));
     SDL_Rect r2 = { (int)(px - outerR), (int)(py - outerR), (int)(outerR * 2), (int)(outerR * 2) };
     SDL_RenderCopy(renderer, tex.playerGlow, NULL, &r2);
+    count_draw(4);
 }
 
 void draw_nebula(SDL_Renderer* renderer, const GameTextures& tex, float time) {
@@ -357,7 +470,7 @@ void draw_nebula(SDL_Renderer* renderer, const GameTextures& tex, float time) {
         n.angle += n.rotSpeed;
 
         float pulse = 1.0f + 0.1f * sinf(time + n.x);
-        float musicScale = 1.0f + energy * 0.3f;
+        float musicScale = 1.0f + energy * 0.3f + skyMusic.band[MUSIC_LOW_MID] * 0.2f;
         float finalSize = 32.0f * n.scale * pulse * musicScale;
 
         SDL_SetTextureColorMod(tex.playerGlow, n.r, n.g, n.b);
@@ -371,11 +484,13 @@ void draw_nebula(SDL_Renderer* renderer, const GameTextures& tex, float time) {
         };
 
         SDL_RenderCopyEx(renderer, tex.playerGlow, NULL, &dst, n.angle, NULL, SDL_FLIP_NONE);
+        count_draw(4);
     }
 }
 
 void draw_alien_sky_elements(SDL_Renderer* renderer, const GameTextures& tex, int w, int h, float time) {
     init_alien_sky(w, h);
+    skyMusic = music_features();
 
     draw_alien_atmosphere(renderer, w, h);
 
@@ -393,7 +508,7 @@ void draw_alien_sky_elements(SDL_Renderer* renderer, const GameTextures& tex, in
 
         float twinkle = 0.95f + 0.05f * sinf(time * 2.0f + s.phase);
 
-        float brightness = twinkle * (0.7f + smoothEnergy * 0.6f);
+        float brightness = twinkle * (0.7f + smoothEnergy * 0.6f + skyMusic.band[MUSIC_TREBLE] * 0.2f + skyMusic.onset * 0.3f);
         if (brightness > 1.0f) brightness = 1.0f;
 
         Uint8 alpha = (Uint8)(brightness * 255);
@@ -412,6 +527,7 @@ void draw_alien_sky_elements(SDL_Renderer* renderer, const GameTextures& tex, in
             (int)renderSize
         };
         SDL_RenderCopy(renderer, tex.dot, NULL, &dst);
+        count_draw(4);
     }
 
     SDL_SetTextureColorMod(tex.dot, 255, 255, 255);
@@ -420,24 +536,12 @@ void draw_alien_sky_elements(SDL_Renderer* renderer, const GameTextures& tex, in
     SDL_SetTextureAlphaMod(tex.playerGlow, 255);
 }
 
-void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMode, int brushEffectMode, bool playerSunMode, bool playerRainbow, float playerJumpTimer, bool showFPS, float fpsValue) {
-
-    float time = SDL_GetTicks() * 0.001f;
-
-    SDL_SetRenderTarget(renderer, tex.metaballTarget);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-    SDL_RenderClear(renderer);
-
-    static std::vector<SDL_Vertex> metaballBatch;
-    if (metaballBatch.capacity() < 6 * particles.size()) {
-        metaballBatch.reserve(6 * particles.size());
-    }
+// Quads for the water metaballs (at FLUID_RENDER_SCALE) and the boiling plasma,
+// in screen space; off-screen particles are culled.
+void build_water_batches(const std::vector<Particle>& particles, float camX, float camY, float time,
+    std::vector<SDL_Vertex>& metaballBatch, std::vector<SDL_Vertex>& plasmaBatch) {
+    MemScope mem(MEM_RENDER);
     metaballBatch.clear();
-
-    static std::vector<SDL_Vertex> plasmaBatch;
-    if (plasmaBatch.capacity() < 6 * particles.size()) {
-        plasmaBatch.reserve(6 * particles.size());
-    }
     plasmaBatch.clear();
 
     float waterBaseSize = RADIUS * METABALL_VISUAL_RADIUS_MULTIPLIER * FLUID_RENDER_SCALE;
@@ -449,9 +553,14 @@ void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMod
         initLUT = true;
     }
 
+    const float cullMargin = RADIUS * 5.0f;
+
     for (const auto& p : particles) {
         if (p.isPlayer) continue;
 
+        float sx = p.x - camX, sy = p.y - camY;
+        if (sx < -cullMargin || sx > SCREEN_WIDTH + cullMargin || sy < -cullMargin || sy > SCREEN_HEIGHT + cullMargin) continue;
+
         float temp = p.temperature;
 
         if (temp > 0.8f) {
@@ -481,16 +590,16 @@ void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMod
 
             SDL_Color col = { r, g, b, a };
 
-            plasmaBatch.push_back({ {p.x - h, p.y - h}, col, {0,0} });
-            plasmaBatch.push_back({ {p.x + h, p.y - h}, col, {1,0} });
-            plasmaBatch.push_back({ {p.x + h, p.y + h}, col, {1,1} });
-            plasmaBatch.push_back({ {p.x - h, p.y - h}, col, {0,0} });
-            plasmaBatch.push_back({ {p.x + h, p.y + h}, col, {1,1} });
-            plasmaBatch.push_back({ {p.x - h, p.y + h}, col, {0,1} });
+            plasmaBatch.push_back({ {sx - h, sy - h}, col, {0,0} });
+            plasmaBatch.push_back({ {sx + h, sy - h}, col, {1,0} });
+            plasmaBatch.push_back({ {sx + h, sy + h}, col, {1,1} });
+            plasmaBatch.push_back({ {sx - h, sy - h}, col, {0,0} });
+            plasmaBatch.push_back({ {sx + h, sy + h}, col, {1,1} });
+            plasmaBatch.push_back({ {sx - h, sy + h}, col, {0,1} });
         }
         else {
-            float drawX = p.x * FLUID_RENDER_SCALE;
-            float drawY = p.y * FLUID_RENDER_SCALE;
+            float drawX = sx * FLUID_RENDER_SCALE;
+            float drawY = sy * FLUID_RENDER_SCALE;
             float halfBaseSize = waterBaseSize * 0.5f;
 
             float x0 = drawX - halfBaseSize; float y0 = drawY - halfBaseSize;
@@ -506,6 +615,37 @@ void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMod
             metaballBatch.push_back({ {x0, y1}, waterColor, {0, 1} });
         }
     }
+}
+
+void render_frame(SDL_Renderer* renderer, World& world, const GameTextures& tex, bool brushMode, int brushEffectMode, bool showHud, const PerfHud& hud) {
+    MemScope mem(MEM_RENDER);
+    renderStats = RenderStats();
+    const std::vector<Particle>& particles = world.particles;
+    const bool playerSunMode = world.playerSunMode;
+    const bool playerRainbow = world.playerRainbow;
+    const float playerJumpTimer = world.playerJumpTimer;
+
+    float time = SDL_GetTicks() * 0.001f;
+
+    PROFILE_SPAN(pass, "render: water");
+    SDL_SetRenderTarget(renderer, tex.metaballTarget);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+
+    static std::vector<SDL_Vertex> metaballBatch;
+    if (metaballBatch.capacity() < 6 * particles.size()) {
+        metaballBatch.reserve(6 * particles.size());
+    }
+
+    static std::vector<SDL_Vertex> plasmaBatch;
+    if (plasmaBatch.capacity() < 6 * particles.size()) {
+        plasmaBatch.reserve(6 * particles.size());
+    }
+
+    // Simulation runs in world space; everything below draws relative to the camera.
+    const float camX = cameraX, camY = cameraY;
+
+    build_water_batches(particles, camX, camY, time, metaballBatch, plasmaBatch);
 
     if (!metaballBatch.empty()) {
         static SDL_BlendMode particle_accumulate_mode = SDL_ComposeCustomBlendMode(
@@ -515,8 +655,10 @@ void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMod
         SDL_SetTextureBlendMode(tex.metaballParticle, particle_accumulate_mode);
         SDL_SetTextureColorMod(tex.metaballParticle, 255, 255, 255);
         SDL_RenderGeometry(renderer, tex.metaballParticle, metaballBatch.data(), (int)metaballBatch.size(), NULL, 0);
+        count_draw((int)metaballBatch.size());
     }
 
+    PROFILE_NEXT(pass, "render: sky and water");
     SDL_SetRenderTarget(renderer, NULL);
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
@@ -524,6 +666,7 @@ void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMod
     SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 15);
     SDL_RenderFillRect(renderer, NULL);
+    count_draw(4);
 
     draw_alien_sky_elements(renderer, tex, SCREEN_WIDTH, SCREEN_HEIGHT, time);
 
@@ -531,16 +674,19 @@ void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMod
     SDL_SetTextureColorMod(tex.metaballTarget, 40, 80, 180);
     SDL_SetTextureAlphaMod(tex.metaballTarget, 210);
     SDL_RenderCopy(renderer, tex.metaballTarget, NULL, NULL);
+    count_draw(4);
 
     SDL_SetTextureBlendMode(tex.metaballTarget, SDL_BLENDMODE_ADD);
     SDL_SetTextureColorMod(tex.metaballTarget, 0, 100, 255);
     SDL_SetTextureAlphaMod(tex.metaballTarget, 80);
     SDL_Rect glowRect = { -10, -10, SCREEN_WIDTH + 20, SCREEN_HEIGHT + 20 };
     SDL_RenderCopy(renderer, tex.metaballTarget, NULL, &glowRect);
+    count_draw(4);
 
     SDL_SetTextureColorMod(tex.metaballTarget, 255, 255, 255);
     SDL_SetTextureAlphaMod(tex.metaballTarget, 100);
     SDL_RenderCopy(renderer, tex.metaballTarget, NULL, NULL);
+    count_draw(4);
     SDL_SetTextureAlphaMod(tex.metaballTarget, 255);
 
     if (!plasmaBatch.empty()) {
@@ -548,17 +694,19 @@ void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMod
         SDL_SetTextureColorMod(tex.plasmaTexture, 255, 255, 255);
         SDL_SetTextureAlphaMod(tex.plasmaTexture, 255);
         SDL_RenderGeometry(renderer, tex.plasmaTexture, plasmaBatch.data(), (int)plasmaBatch.size(), NULL, 0);
+        count_draw((int)plasmaBatch.size());
     }
 
+    PROFILE_NEXT(pass, "render: fragments");
     static std::vector<SDL_Vertex> rainbowBatch(MAX_RAINBOW_FRAGMENTS * 6);
     SDL_Vertex* vPtr = rainbowBatch.data();
     int vertCount = 0;
 
-    for (const auto& rf : rainbowFragments) {
-        if (rf.x < -50 || rf.x > SCREEN_WIDTH + 50 || rf.y < -50 || rf.y > SCREEN_HEIGHT + 50) continue;
+    for (const auto& rf : world.rainbowFragments) {
+        float fx = rf.x - camX, fy = rf.y - camY;
+        if (fx < -50 || fx > SCREEN_WIDTH + 50 || fy < -50 || fy > SCREEN_HEIGHT + 50) continue;
 
-        float life_progress = rf.t / rf.life;
-        if (life_progress >= 1.0f) continue;
+        float life_progress = rf.t * rf.invLife;
 
         Uint8 r, g, b, a;
         float current_size;
@@ -598,8 +746,8 @@ void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMod
         }
 
         float half = current_size * 0.5f;
-        float x1 = rf.x - half; float y1 = rf.y - half;
-        float x2 = rf.x + half; float y2 = rf.y + half;
+        float x1 = fx - half; float y1 = fy - half;
+        float x2 = fx + half; float y2 = fy + half;
 
         SDL_Color col = { r, g, b, a };
 
@@ -615,14 +763,16 @@ void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMod
     if (vertCount > 0) {
         SDL_SetTextureBlendMode(tex.dot, SDL_BLENDMODE_ADD);
         SDL_RenderGeometry(renderer, tex.dot, rainbowBatch.data(), vertCount, nullptr, 0);
+        count_draw(vertCount);
     }
 
+    PROFILE_NEXT(pass, "render: brushes");
     static std::vector<SDL_Vertex> blueBrushBatch;
     static std::vector<SDL_Vertex> rainbowBrushBatch;
     blueBrushBatch.clear();
     rainbowBrushBatch.clear();
 
-    for (const auto& bp : brushParticles) {
+    for (const auto& bp : world.brushParticles) {
         float size = bp.baseSize * (0.85f + 0.25f * sinf(bp.t * 1.2f + bp.phase));
         float alphaVal = (180 + 60 * sinf(bp.t * 1.7f + bp.phase)) * (1.0f + bp.impact * 0.18f);
 
@@ -640,7 +790,8 @@ void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMod
 
         bool useRainbowBatch = false;
 
-        float drawY = bp.y;
+        float drawX = bp.x - camX;
+        float drawY = bp.y - camY;
 
         if (bp.type == BRUSH_BLUE) {
             r = 255; g = 255; b = 255;
@@ -689,8 +840,8 @@ void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMod
         }
 
         float halfSize = size * 0.5f;
-        float x0 = bp.x - halfSize; float y0 = drawY - halfSize;
-        float x1 = bp.x + halfSize; float y1 = drawY + halfSize;
+        float x0 = drawX - halfSize; float y0 = drawY - halfSize;
+        float x1 = drawX + halfSize; float y1 = drawY + halfSize;
 
         SDL_Vertex vTL = { {x0, y0}, {r, g, b, alpha}, {0, 0} };
         SDL_Vertex vTR = { {x1, y0}, {r, g, b, alpha}, {1, 0} };
@@ -712,24 +863,28 @@ void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMod
         SDL_SetTextureColorMod(tex.brush, 255, 255, 255);
         SDL_SetTextureAlphaMod(tex.brush, 255);
         SDL_RenderGeometry(renderer, tex.brush, blueBrushBatch.data(), (int)blueBrushBatch.size(), NULL, 0);
+        count_draw((int)blueBrushBatch.size());
     }
     if (!rainbowBrushBatch.empty()) {
         SDL_SetTextureBlendMode(tex.rainbowBrush, SDL_BLENDMODE_ADD);
         SDL_SetTextureColorMod(tex.rainbowBrush, 255, 255, 255);
         SDL_SetTextureAlphaMod(tex.rainbowBrush, 255);
         SDL_RenderGeometry(renderer, tex.rainbowBrush, rainbowBrushBatch.data(), (int)rainbowBrushBatch.size(), NULL, 0);
+        count_draw((int)rainbowBrushBatch.size());
     }
 
     if (brushMode) {
         SDL_SetRenderDrawColor(renderer, 200, 255, 255, 180);
         SDL_Rect hint = { SCREEN_WIDTH - 220, 20, 200, 36 };
         SDL_RenderFillRect(renderer, &hint);
+        count_draw(4);
     }
 
+    PROFILE_NEXT(pass, "render: players");
     static std::vector<const Particle*> drawOrder;
-    drawOrder.resize(particles.size());
+    drawOrder.clear();
     for (size_t i = 0; i < particles.size(); ++i) {
-        drawOrder[i] = &particles[i];
+        if (particles[i].isPlayer) drawOrder.push_back(&particles[i]);
     }
 
     std::sort(drawOrder.begin(), drawOrder.end(), [](const Particle* a, const Particle* b) {
@@ -768,22 +923,22 @@ void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMod
                     for (int k = 0; k < particle_count; ++k) {
                         RainbowFragment spark;
                         float perpX = -dirY; float perpY = dirX;
-                        float rnd1 = (rand() % 100) / 100.0f; float rnd2 = (rand() % 100) / 100.0f;
+                        float rnd1 = (world.random() % 100) / 100.0f; float rnd2 = (world.random() % 100) / 100.0f;
                         float gaussian = (rnd1 + rnd2 - 1.0f);
                         float thickness = current_render_radius * 1.2f;
                         float offsetX = perpX * gaussian * thickness;
                         float offsetY = perpY * gaussian * thickness;
-                        float lag = ((rand() % 100) / 100.0f) * current_render_radius * 0.8f;
+                        float lag = ((world.random() % 100) / 100.0f) * current_render_radius * 0.8f;
                         spark.x = p.x + offsetX - dirX * lag;
                         spark.y = p.y + offsetY - dirY * lag;
-                        if (speedVal < 0.1f) { float a = (rand() % 628) / 100.0f; spark.vx = cosf(a) * 1.0f; spark.vy = sinf(a) * 1.0f; }
+                        if (speedVal < 0.1f) { float a = (world.random() % 628) / 100.0f; spark.vx = cosf(a) * 1.0f; spark.vy = sinf(a) * 1.0f; }
                         else { spark.vx = p.vx * 0.8f - dirX * 1.5f; spark.vy = p.vy * 0.8f - dirY * 1.5f; }
                         spark.life = 1.5f;
                         spark.size = current_render_radius * 2.5f;
                         spark.t = 0;
                         spark.type = 3;
                         spark.alpha0 = 0.6f;
-                        rainbowFragments.push_back(spark);
+                        push_rainbow_fragment(world, spark);
                     }
                 }
             }
@@ -794,8 +949,8 @@ void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMod
         }
 
         float current_render_radius = brushMode ? 6.0f : RADIUS;
-        float px = p.x;
-        float py = p.y;
+        float px = p.x - camX;
+        float py = p.y - camY;
 
         if (!brushMode && playerRainbow && playerJumpTimer > 0) {
             float jump = sinf(SDL_GetTicks() / 30.0f + p.id) * 8.0f * (playerJumpTimer / 0.5f);
@@ -819,57 +974,28 @@ void render_frame(SDL_Renderer* renderer, const GameTextures& tex, bool brushMod
         float glow_radius = current_render_radius * 1.6f * scale;
         SDL_Rect glow_dest = { (int)(px - glow_radius), (int)(py - glow_radius), (int)(glow_radius * 2), (int)(glow_radius * 2) };
         SDL_RenderCopy(renderer, tex.playerGlow, NULL, &glow_dest);
+        count_draw(4);
 
         float core_radius = current_render_radius * scale;
         SDL_Rect core_dest = { (int)(px - core_radius), (int)(py - core_radius), (int)(core_radius * 2), (int)(core_radius * 2) };
         SDL_RenderCopy(renderer, tex.playerParticle, NULL, &core_dest);
+        count_draw(4);
     }
 
-    if (showFPS) {
-        render_fps_number(renderer, fpsValue);
+    if (showHud) {
+        PROFILE_NEXT(pass, "render: hud");
+        count_draw(render_perf_hud(renderer, hud));
     }
 }
 
-static void draw_segment_digit(SDL_Renderer* renderer, int x, int y, int digit, float scale) {
-    int w = (int)(10 * scale);
-    int h = (int)(10 * scale);
-    int h2 = h * 2;
+void update_camera(const World& world, float focusX, float focusY) {
+    if (worldFollowsScreen) { cameraX = 0.0f; cameraY = 0.0f; return; }
 
-    struct Seg { int x1, y1, x2, y2; };
-    Seg segs[7] = {
-        {0,0, w,0}, {0,0, 0,h}, {w,0, w,h}, {0,h, w,h}, {0,h, 0,h2}, {w,h, w,h2}, {0,h2, w,h2}
-    };
-    static const int map[10][7] = {
-        {1,1,1,0,1,1,1}, {0,0,1,0,0,1,0}, {1,0,1,1,1,0,1}, {1,0,1,1,0,1,1}, {0,1,1,1,0,1,0},
-        {1,1,0,1,0,1,1}, {1,1,0,1,1,1,1}, {1,0,1,0,0,1,0}, {1,1,1,1,1,1,1}, {1,1,1,1,0,1,1}
-    };
+    cameraX += (focusX - SCREEN_WIDTH * 0.5f - cameraX) * 0.08f;
+    cameraY += (focusY - SCREEN_HEIGHT * 0.5f - cameraY) * 0.08f;
 
-    for (int i = 0; i < 7; ++i) {
-        if (map[digit][i]) SDL_RenderDrawLine(renderer, x + segs[i].x1, y + segs[i].y1, x + segs[i].x2, y + segs[i].y2);
-    }
+    float maxX = (float)(world.width - SCREEN_WIDTH);
+    float maxY = (float)(world.height - SCREEN_HEIGHT);
+    cameraX = std::max(0.0f, std::min(maxX, cameraX));
+    cameraY = std::max(0.0f, std::min(maxY, cameraY));
 }
-
-void render_fps_number(SDL_Renderer* renderer, float fps) {
-    SDL_SetRenderTarget(renderer, NULL);
-
-    SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255);
-
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
-
-    int val = (int)fps;
-    if (val < 0) val = 0;
-    if (val > 999) val = 999;
-
-    std::vector<int> digits;
-    if (val == 0) digits.push_back(0);
-    while (val > 0) { digits.push_back(val % 10); val /= 10; }
-
-    int x = 20;
-    int y = 20;
-    float scale = 3.0f;
-
-    for (int i = (int)digits.size() - 1; i >= 0; --i) {
-        draw_segment_digit(renderer, x, y, digits[i], scale);
-        x += (int)(18 * scale);
-    }
-}
\ No newline at end of file
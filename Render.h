@@ -1,7 +1,9 @@
 #pragma once
 #include <SDL.h>
 #include <vector>
-#include "GameConfig.h" 
+#include "GameConfig.h"
+#include "World.h"
+#include "PerfHud.h"
 
 struct GameTextures {
     SDL_Texture* normalParticle = nullptr;
@@ -13,25 +15,64 @@ struct GameTextures {
     SDL_Texture* metaballParticle = nullptr;
     SDL_Texture* metaballTarget = nullptr;
     SDL_Texture* plasmaTexture = nullptr;
+
+    // Estimated GPU memory, 4 bytes a texel, accounted to MEM_TEXTURES.
+    int64_t spriteBytes = 0;
+    int64_t targetBytes = 0;
+};
+
+// Fixed-size procedural sprites, in GameTextures order. Their pixels can come from
+// the baked asset pack instead of being generated at startup.
+enum SpriteId {
+    SPRITE_NORMAL_PARTICLE,
+    SPRITE_PLAYER_PARTICLE,
+    SPRITE_PLAYER_GLOW,
+    SPRITE_BRUSH,
+    SPRITE_RAINBOW_BRUSH,
+    SPRITE_DOT,
+    SPRITE_METABALL,
+    SPRITE_PLASMA,
+    SPRITE_COUNT
 };
 
+int sprite_size(SpriteId id);
+std::vector<Uint32> generate_sprite_pixels(SpriteId id);
+SDL_Texture* upload_texture(SDL_Renderer* renderer, int size, SDL_BlendMode mode, const Uint32* pixels);
+
 SDL_Texture* create_brush_texture(SDL_Renderer* renderer, int size);
 SDL_Texture* create_dot_texture(SDL_Renderer* renderer, int size);
 SDL_Texture* create_metaball_particle_texture(SDL_Renderer* renderer, int size);
 SDL_Texture* create_particle_texture(SDL_Renderer* renderer, int texture_size, SDL_Color color, bool is_glow);
 SDL_Texture* create_rainbow_brush_texture(SDL_Renderer* renderer, int size);
 
+void HSVtoRGB(float h, float s, float v, Uint8& r, Uint8& g, Uint8& b);
+void generateRainbowLUT();
+
 void drawBoilingSunSurface(SDL_Renderer* renderer, SDL_Texture* texture, float cx, float cy, float radius, SDL_Color color, float time);
 
 void recreate_all_textures(SDL_Renderer* renderer, GameTextures& tex, int width, int height);
+void recreate_size_dependent_textures(SDL_Renderer* renderer, GameTextures& tex, int width, int height);
 
 void destroy_all_textures(GameTextures& tex);
 
 void reset_alien_sky();
 
-void render_frame(SDL_Renderer* renderer, const GameTextures& tex,
+// The per-particle part of a frame: metaball and plasma quads for the water.
+void build_water_batches(const std::vector<Particle>& particles, float camX, float camY, float time,
+    std::vector<SDL_Vertex>& metaballBatch, std::vector<SDL_Vertex>& plasmaBatch);
+
+// Draw calls and vertices submitted by the last render_frame, for the HUD.
+struct RenderStats {
+    int drawCalls = 0;
+    int vertices = 0;
+};
+
+extern RenderStats renderStats;
+
+// Sun-mode trails are drawn as fragments, so the frame also feeds the world.
+void render_frame(SDL_Renderer* renderer, World& world, const GameTextures& tex,
     bool brushMode, int brushEffectMode,
-    bool playerSunMode, bool playerRainbow, float playerJumpTimer,
-    bool showFPS, float fpsValue);
+    bool showHud, const PerfHud& hud);
 
-void render_fps_number(SDL_Renderer* renderer, float fps);
+// Eases the camera towards the focus point, clamped to the world.
+void update_camera(const World& world, float focusX, float focusY);
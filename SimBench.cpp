@@ -0,0 +1,13 @@
+#include "Benchmark.h"
+#include <cstring>
+
+// The SimBench console target: the simulation benchmarks built against SimCore
+// alone, with no window, audio or SDL. Takes the game's flags; --bench-sim is the
+// default mode.
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--bench-kernels") == 0) return run_kernel_benchmark(argc, argv);
+        if (strcmp(argv[i], "--bench-regress") == 0) return run_regression(argc, argv);
+    }
+    return run_sim_benchmark(argc, argv);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include "TimingWheel.h"
+
+// Simulation constants and plain data types. Nothing here depends on SDL or
+// miniaudio, so the simulation core builds on a host without either.
+const float PHI = 1.61803398875f;
+const float RADIUS = 20.0f;
+const float DAMPING = 0.983f;
+const float GRAVITY = 0.05f;
+const float BOILING_POINT = 0.8f;
+const float INTERACTION_RADIUS = 20.0f;
+const float PLAYER_WATER_INTERACTION_RADIUS = 40.0f;
+const float REPULSION_FORCE = 0.5f;
+const float MOUSE_FORCE = 0.2f;
+const float COHESION_FORCE = 0.02f;
+const float PLAYER_WATER_REPULSION_MULTIPLIER = 8.0f;
+const float MAX_DISTURB = 200.0f;
+const float MAX_STEP = MAX_DISTURB;
+const size_t MAX_BRUSH_PARTICLES = 10000;
+const size_t BRUSH_CULL_BATCH = 200;
+const int DENSITY_BUFFER_SCALE = 8;
+const int MAX_RAINBOW_FRAGMENTS = 20000;
+const float FRAGMENT_DT = 0.016f;
+// Nominal length of one simulation step; timers and the world clock assume it.
+const double SIM_FRAME_MS = 16.0;
+const int FRAGMENT_WHEEL_SLOTS = 256;
+const float SLEEP_SPEED = 0.15f;
+const int SLEEP_FRAMES = 45;
+
+enum BrushType { BRUSH_BLUE = 1, BRUSH_RAINBOW = 2, BRUSH_EXPLOSIVE = 3, BRUSH_DROP = 4};
+
+struct BrushParticle {
+    float x, y, baseX, baseY, baseSize, t, phase, impact = 0.0f, vx = 0.0f, vy = 0.0f;
+    int highImpactFrames = 0, dissolveFrame = 0;
+    BrushType type = BRUSH_BLUE;
+    bool absorbed = false;
+    bool hasWater = false;
+};
+
+struct RainbowFragment {
+    float x, y, vx, vy, t, life, size, angle, spiralSpeed, h, alpha0;
+    float invLife = 0.0f;
+    int type;
+};
+
+using FragmentWheel = TimingWheel<RainbowFragment, FRAGMENT_WHEEL_SLOTS>;
+
+struct Particle {
+    float x, y, vx, vy;
+    bool isPlayer;
+    bool asleep = false;
+    float temperature = 0.0f;
+    int id;
+
+    Particle(float px = 0, float py = 0, bool player = false)
+        : x(px), y(py), vx(0), vy(0), isPlayer(player), temperature(0.0f), id(0) {}
+};
+
+struct Vector2D {
+    float fx = 0.0f;
+    float fy = 0.0f;
+};
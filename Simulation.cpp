@@ -1,61 +1,244 @@
 #include "Simulation.h"
 #include "PhysicsSystem.h"
 #include "GameLogic.h"
+#include "SlabDomain.h"
+#include "Profiler.h"
+#include "AllocCounter.h"
+#include "PerfCounters.h"
+#include <chrono>
 
-void update_physics_simulation(bool brushMode, int mx, int my, bool mouseDown, bool playerSunMode, bool playerRainbow, float& centerX, float& centerY, float& avgVx, float& avgVy,float& playerRainbowTimer,float& playerJumpTimer, SpatialGrid& grid, ThreadPool& pool) {
+// Adds the wall time, allocations and hardware counts of its scope to one stage of
+// world.stageNs, world.stageAllocs and world.stageHw, if the world asks for it, and
+// records the stage as a profiler zone.
+class StageTimer {
+public:
+    StageTimer(World& world, SimStage stage) : world(world), stage(stage)
+#if PROFILER_ENABLED
+        , zone(SIM_STAGE_NAMES[stage])
+#endif
+    {
+        if (!world.timeStages) return;
+        counting = hw_counters_enabled() && hw_counters_read(hwStart);
+        allocsAtStart = alloc_count();
+        start = std::chrono::steady_clock::now();
+    }
+    ~StageTimer() {
+        if (!world.timeStages) return;
+        world.stageNs[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        world.stageAllocs[stage] += alloc_count() - allocsAtStart;
+        HwReading hwEnd;
+        if (counting && hw_counters_read(hwEnd)) world.stageHw[stage].add_span(hwStart, hwEnd);
+    }
+private:
+    World& world;
+    SimStage stage;
+    std::chrono::steady_clock::time_point start;
+    uint64_t allocsAtStart = 0;
+    HwReading hwStart;
+    bool counting = false;
+#if PROFILER_ENABLED
+    ProfileZone zone;
+#endif
+};
+
+// Cells holding at least one player. With the water stepped by the slab processes
+// only the player side of the force pass is left to run here.
+static std::vector<int> player_cell_keys(const World& world) {
+    const SpatialGrid& grid = world.grid;
+    std::vector<int> keys;
+    for (const auto& p : world.particles) {
+        if (!p.isPlayer) continue;
+        int idx = grid.find_cell(grid.cell_x(p.x), grid.cell_y(p.y));
+        if (idx >= 0) keys.push_back(idx);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+void update_density_buffer(World& world) {
+    world.density.rebuild(world.particles);
+}
+
+void update_physics_simulation(World& world, const SimInput& in, ThreadPool& pool) {
+    MemScope mem(MEM_SIMULATION);
+    std::vector<Particle>& particles = world.particles;
+    const int mx = in.mouseX, my = in.mouseY;
+    world.timeMs += SIM_FRAME_MS;
 
     int pCount = 0;
-    for (auto& p : particles) if (p.isPlayer) { centerX += p.x; centerY += p.y; avgVx += p.vx; avgVy += p.vy; pCount++; }
-    if (pCount > 0) { centerX /= pCount; centerY /= pCount; avgVx /= pCount; avgVy /= pCount; }
+    for (auto& p : particles) if (p.isPlayer) { world.centerX += p.x; world.centerY += p.y; world.avgVx += p.vx; world.avgVy += p.vy; pCount++; }
+    if (pCount > 0) { world.centerX /= pCount; world.centerY /= pCount; world.avgVx /= pCount; world.avgVy /= pCount; }
 
-    if (brushMode) {
+    if (in.brushMode) {
+        int rank = 0;
         for (size_t i = 0; i < particles.size(); ++i) {
             if (particles[i].isPlayer) {
-                float angle = particles[i].id * 6.28f / PLAYER_PARTICLE_COUNT;
+                float angle = (rank++) * 6.28f / pCount;
                 particles[i].x = mx + cos(angle) * 35.0f;
                 particles[i].y = my + sin(angle) * 35.0f;
                 particles[i].vx = 0; particles[i].vy = 0;
             }
         }
-        centerX = (float)mx; centerY = (float)my;
+        world.centerX = (float)mx; world.centerY = (float)my;
+    }
+    else if (slab_domain_active()) {
+        {
+            StageTimer t(world, SIM_STAGE_EXCHANGE);
+            apply_particle_spawns(world);
+            slab_domain_step(world);
+        }
+        {
+            StageTimer t(world, SIM_STAGE_SORT);
+            world.forces.assign(particles.size(), Vector2D());
+            world.grid.update_and_sort(particles, world.particle_buffer);
+        }
+        {
+            StageTimer t(world, SIM_STAGE_DENSITY);
+            update_density_buffer(world);
+            for (auto& p : particles) p.asleep = !p.isPlayer;
+        }
+        {
+            StageTimer t(world, SIM_STAGE_FORCES);
+            std::vector<int> keys = player_cell_keys(world);
+            world.activeCells = (int)keys.size();
+            pool.dispatch_repulsion_calc(keys, world);
+            pool.wait();
+            if (world.timeStages && hw_counters_enabled()) pool.take_hw_counts(world.workerHw, world.stageHw[SIM_STAGE_FORCES]);
+        }
+        {
+            StageTimer t(world, SIM_STAGE_REDUCE);
+            pool.reduce_forces(world.forces);
+        }
+        {
+            StageTimer t(world, SIM_STAGE_INTEGRATE);
+            calculate_mouse_interaction_forces(world, in);
+            calculate_player_cohesion_forces(world);
+            apply_forces_to_particles(world);
+        }
+        StageTimer t(world, SIM_STAGE_BRUSH);
+        resolve_brush_collisions(world);
     }
     else {
-        std::fill(forces.begin(), forces.end(), Vector2D());
-        grid.update_and_sort(particles, particle_buffer);
-        std::fill(density_buffer.begin(), density_buffer.end(), 0.0f);
-        for (const auto& p : particles) {
-            int bx = (int)(p.x / DENSITY_BUFFER_SCALE), by = (int)(p.y / DENSITY_BUFFER_SCALE);
-            if (bx >= 0 && bx < density_buffer_width && by >= 0 && by < density_buffer_height) density_buffer[by * density_buffer_width + bx] += 1.0f;
+        {
+            StageTimer t(world, SIM_STAGE_SORT);
+            apply_particle_spawns(world);
+            std::fill(world.forces.begin(), world.forces.end(), Vector2D());
+            world.grid.update_and_sort(particles, world.particle_buffer);
+        }
+        {
+            StageTimer t(world, SIM_STAGE_DENSITY);
+            update_density_buffer(world);
+            update_sleeping_cells(world);
+        }
+        {
+            StageTimer t(world, SIM_STAGE_FORCES);
+            std::vector<int> keys = world.grid.get_active_keys();
+            world.activeCells = (int)keys.size();
+            pool.dispatch_repulsion_calc(keys, world);
+            pool.wait();
+            if (world.timeStages && hw_counters_enabled()) pool.take_hw_counts(world.workerHw, world.stageHw[SIM_STAGE_FORCES]);
+        }
+        {
+            StageTimer t(world, SIM_STAGE_REDUCE);
+            pool.reduce_forces(world.forces);
+        }
+        {
+            StageTimer t(world, SIM_STAGE_INTEGRATE);
+            apply_heat_from_fragments(world);
+            calculate_mouse_interaction_forces(world, in);
+            calculate_player_cohesion_forces(world);
+            apply_forces_to_particles(world);
         }
-        pool.dispatch_repulsion_calc(grid.get_active_keys(), grid);
-        pool.wait();
-        pool.reduce_forces(forces);
-        apply_heat_from_fragments(grid);
-        calculate_mouse_interaction_forces(mx, my, mouseDown, forces, playerSunMode);
-        calculate_player_cohesion_forces(forces);
-        apply_forces_to_particles(forces);
-        resolve_brush_collisions(brushMode, avgVx, avgVy, playerRainbow, playerRainbowTimer, playerJumpTimer);
+        StageTimer t(world, SIM_STAGE_BRUSH);
+        resolve_brush_collisions(world);
     }
 }
 
-void update_meteors(float& timer, float& interval, bool silent, int& TARGET_FPS) {
-    if (silent) return;
+void update_meteors(World& world, const SimInput& in) {
+    if (in.silent) return;
+    MemScope mem(MEM_SIMULATION);
 
-    timer += 1.0f / TARGET_FPS;
+    world.meteorTimer += (float)(SIM_FRAME_MS * 0.001);
 
-    if (timer > interval) {
+    if (world.meteorTimer > world.nextMeteorInterval) {
         int batchSize = 1;
-        int r = rand() % 100;
+        int r = world.random() % 100;
         if (r > 70) batchSize = 2;
         if (r > 90) batchSize = 3;
 
+        int spanX = std::max(1, (int)in.viewW - 200);
         for (int k = 0; k < batchSize; ++k) {
-            float dropX = 100.0f + (rand() % (SCREEN_WIDTH - 200));
-            float dropY = -50.0f - (rand() % 200);
-            spawnMeteorDrop(dropX, dropY);
+            float dropX = in.viewX + 100.0f + (world.random() % spanX);
+            float dropY = in.viewY - 50.0f - (world.random() % 200);
+            spawnMeteorDrop(world, dropX, dropY);
         }
 
-        timer = 0.0f;
-        interval = 0.5f + (rand() % 400) / 100.0f;
+        world.meteorTimer = 0.0f;
+        world.nextMeteorInterval = 0.5f + (world.random() % 400) / 100.0f;
     }
-}
\ No newline at end of file
+}
+
+void update_mode_timers(World& world) {
+    const float dt = (float)(SIM_FRAME_MS * 0.001);
+    if (world.playerRainbow) {
+        world.playerRainbowTimer -= dt; world.playerJumpTimer -= dt;
+        if (world.playerRainbowTimer < 0) world.playerRainbow = false;
+    }
+    if (world.playerSunMode) { world.playerSunTimer -= dt; if (world.playerSunTimer <= 0) world.playerSunMode = false; }
+}
+
+void populate_world(World& world, int totalParticles, int playerCount, bool spawnWater) {
+    MemScope mem(MEM_SIMULATION);
+    world.particles.reserve(totalParticles);
+    for (int i = 0; i < playerCount; ++i) {
+        float angle = (float)i / playerCount * 2.0f * 3.14159f;
+        float r = (world.random() % 40);
+        spawnParticle(world, world.width / 2 + cos(angle) * r, world.height / 2 + sin(angle) * r, true);
+    }
+    for (int i = 0; spawnWater && i < totalParticles - playerCount; ++i) {
+        spawnParticle(world, world.random() % world.width, world.random() % world.height, false);
+    }
+    apply_particle_spawns(world);
+    world.nextMeteorInterval = 2.0f + (world.random() % 300) / 100.0f;
+}
+
+void step_world(World& world, const SimInput& in, ThreadPool& pool) {
+    MemScope mem(MEM_SIMULATION);
+    update_physics_simulation(world, in, pool);
+    {
+        StageTimer t(world, SIM_STAGE_BRUSH);
+        update_meteors(world, in);
+        update_brush_painting(world, in);
+        update_brush_particles(world, in);
+    }
+    {
+        StageTimer t(world, SIM_STAGE_FRAGMENTS);
+        update_rainbow_fragments(world);
+    }
+    update_mode_timers(world);
+}
+
+static void hash_bytes(uint64_t& h, const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+}
+
+uint64_t world_checksum(const World& world) {
+    uint64_t h = 14695981039346656037ull;
+    for (const Particle& p : world.particles) {
+        const float state[5] = { p.x, p.y, p.vx, p.vy, p.temperature };
+        hash_bytes(h, state, sizeof(state));
+        hash_bytes(h, &p.id, sizeof(p.id));
+    }
+    for (const BrushParticle& b : world.brushParticles) {
+        const float state[2] = { b.x, b.y };
+        hash_bytes(h, state, sizeof(state));
+    }
+    size_t fragments = world.rainbowFragments.size();
+    hash_bytes(h, &fragments, sizeof(fragments));
+    return h;
+}
@@ -1,8 +1,26 @@
 #pragma once
-#include "GameConfig.h"
-#include "SpatialGrid.h"
+#include "World.h"
 #include "ThreadPool.h"
 
-void update_physics_simulation(bool brushMode, int mx, int my, bool mouseDown, bool playerSunMode, bool playerRainbow, float& centerX, float& centerY, float& avgVx, float& avgVy, float& playerRainbowTimer, float& playerJumpTimer, SpatialGrid & grid, ThreadPool & pool);
+// Particle counts per DENSITY_BUFFER_SCALE cell, from the current positions.
+void update_density_buffer(World& world);
 
-void update_meteors(float& timer, float& interval, bool silent, int& TARGET_FPS);
\ No newline at end of file
+void update_physics_simulation(World& world, const SimInput& in, ThreadPool& pool);
+
+// Advances the meteor timer by one SIM_FRAME_MS step and drops meteors when it fires.
+void update_meteors(World& world, const SimInput& in);
+
+void update_mode_timers(World& world);
+
+// Queues the player swarm at the centre of the world and, unless the water lives
+// elsewhere (slab processes), scatters the rest as water; then applies the spawns.
+void populate_world(World& world, int totalParticles, int playerCount, bool spawnWater);
+
+// One whole frame of simulation with every stage run in frame-graph order on the
+// calling thread (the force pass still goes through the pool). For headless use;
+// the game runs the same stages through its FrameGraph.
+void step_world(World& world, const SimInput& in, ThreadPool& pool);
+
+// FNV-1a over the particles, brushes and fragment count: two runs that stepped
+// identically end with the same value. Used to check input replays.
+uint64_t world_checksum(const World& world);
@@ -0,0 +1,429 @@
+#include "SlabDomain.h"
+
+#ifndef _WIN32
+
+#include "SpatialGrid.h"
+#include "ThreadPool.h"
+#include "PhysicsSystem.h"
+#include "GameLogic.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <cerrno>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Widest stencil any pass reads: the centroid sampler's 50 px.
+static const float SLAB_HALO_RADIUS = 50.0f;
+
+struct SlabRecord {
+    Particle p;
+    int migrant;
+};
+
+// Single producer (the neighbour) / single consumer (this slab). Records follow
+// the header in the segment.
+struct SlabRing {
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+};
+
+struct SlabHeat {
+    float x, y, vx, vy;
+    int type;
+};
+
+struct SlabBrush {
+    float x, y, baseSize;
+};
+
+struct SlabHeader {
+    sem_t go[MAX_SLABS];
+    sem_t done;
+    int slabCount;
+    int waterCapacity;
+    int waterIdBase;        // first of the waterCapacity ids reserved in the coordinator's World
+    uint32_t ringCapacity;
+    int playerCapacity;
+    int haloColumns;
+    int colBegin[MAX_SLABS], colEnd[MAX_SLABS];
+    volatile int stop;
+    int playerCount, heatCount, brushCount;
+    int outCount[MAX_SLABS];
+    size_t playersOffset, heatOffset, brushOffset, outOffset, ringOffset, ringStride;
+};
+
+static SlabHeader* header = nullptr;
+static size_t segmentSize = 0;
+static char segmentName[64];
+static pid_t slabPids[MAX_SLABS];
+static bool domainActive = false;
+// Migrants this slab handed over last step. They stay on as ghosts for one step,
+// until their new owner starts sending them back as halo.
+static std::vector<Particle> departed;
+
+static size_t align_up(size_t v) { return (v + 63) & ~(size_t)63; }
+
+static char* segment_base() { return reinterpret_cast<char*>(header); }
+static Particle* shared_players() { return reinterpret_cast<Particle*>(segment_base() + header->playersOffset); }
+static SlabHeat* shared_heat() { return reinterpret_cast<SlabHeat*>(segment_base() + header->heatOffset); }
+static SlabBrush* shared_brushes() { return reinterpret_cast<SlabBrush*>(segment_base() + header->brushOffset); }
+
+static Particle* slab_output(int k) {
+    return reinterpret_cast<Particle*>(segment_base() + header->outOffset) + (size_t)k * header->waterCapacity;
+}
+
+// Ring 2k carries slab k -> k+1, ring 2k+1 carries slab k+1 -> k.
+static SlabRing* slab_ring(int idx) {
+    return reinterpret_cast<SlabRing*>(segment_base() + header->ringOffset + (size_t)idx * header->ringStride);
+}
+
+static SlabRecord* ring_records(SlabRing* r) {
+    return reinterpret_cast<SlabRecord*>(reinterpret_cast<char*>(r) + align_up(sizeof(SlabRing)));
+}
+
+static bool ring_push(SlabRing* r, const Particle& p, int migrant) {
+    uint32_t head = r->head.load(std::memory_order_relaxed);
+    uint32_t tail = r->tail.load(std::memory_order_acquire);
+    if (head - tail >= header->ringCapacity) return false;
+    SlabRecord& rec = ring_records(r)[head & (header->ringCapacity - 1)];
+    rec.p = p;
+    rec.migrant = migrant;
+    r->head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+static void ring_drain(SlabRing* r, std::vector<Particle>& out) {
+    uint32_t tail = r->tail.load(std::memory_order_relaxed);
+    uint32_t head = r->head.load(std::memory_order_acquire);
+    for (; tail != head; ++tail) {
+        const SlabRecord& rec = ring_records(r)[tail & (header->ringCapacity - 1)];
+        Particle p = rec.p;
+        // Ghosts carry a negative id so they can be told apart after the sort.
+        if (!rec.migrant) p.id = -1 - p.id;
+        out.push_back(p);
+    }
+    r->tail.store(tail, std::memory_order_release);
+}
+
+static int slab_of_column(int col) {
+    for (int k = 0; k < header->slabCount - 1; ++k) {
+        if (col < header->colEnd[k]) return k;
+    }
+    return header->slabCount - 1;
+}
+
+// Sends migrants and border halos to the neighbours, then publishes the slab's
+// water for the coordinator.
+static void slab_publish(std::vector<Particle>& particles, int k, float invCellSize) {
+    int c0 = header->colBegin[k], c1 = header->colEnd[k];
+    int halo = header->haloColumns;
+    bool hasLeft = k > 0, hasRight = k < header->slabCount - 1;
+    SlabRing* toLeft = hasLeft ? slab_ring(2 * (k - 1) + 1) : nullptr;
+    SlabRing* toRight = hasRight ? slab_ring(2 * k) : nullptr;
+
+    // Published before migration so a particle in transit is still drawn this frame.
+    header->outCount[k] = (int)particles.size();
+    std::copy(particles.begin(), particles.end(), slab_output(k));
+
+    departed.clear();
+    size_t kept = 0;
+    for (size_t i = 0; i < particles.size(); ++i) {
+        const Particle& p = particles[i];
+        int col = (int)std::floor(p.x * invCellSize);
+        int target = slab_of_column(col);
+
+        if ((target < k && ring_push(toLeft, p, 1)) || (target > k && ring_push(toRight, p, 1))) {
+            departed.push_back(p);
+            departed.back().id = -1 - p.id;
+            continue;
+        }
+
+        if (hasLeft && col < c0 + halo) ring_push(toLeft, p, 0);
+        if (hasRight && col >= c1 - halo) ring_push(toRight, p, 0);
+        particles[kept++] = p;
+    }
+    particles.resize(kept);
+}
+
+static void run_slab_worker(int k, int width, int height) {
+    World world(width, height, true);
+    world.rng.seed((unsigned int)time(0) + 7919u * (unsigned int)k);
+    SpatialGrid& grid = world.grid;
+    std::vector<Particle>& particles = world.particles;
+
+    unsigned int n_threads = std::thread::hardware_concurrency() / header->slabCount;
+    if (n_threads == 0) n_threads = 1;
+    ThreadPool pool(n_threads);
+
+    // Slab k seeds water [first, last) of the whole; the split covers every particle.
+    int waterFirst = (int)((int64_t)header->waterCapacity * k / header->slabCount);
+    int waterLast = (int)((int64_t)header->waterCapacity * (k + 1) / header->slabCount);
+    float x0 = header->colBegin[k] * grid.cellSize;
+    float x1 = std::min(header->colEnd[k] * grid.cellSize, (float)width);
+    particles.reserve(header->waterCapacity);
+    for (int i = waterFirst; i < waterLast; ++i) {
+        Particle p(x0 + (world.random() % 1000) * 0.001f * (x1 - x0), (float)(world.random() % height), false);
+        p.id = header->waterIdBase + i;
+        particles.push_back(p);
+    }
+    slab_publish(particles, k, grid.invCellSize);
+    sem_post(&header->done);
+
+    while (true) {
+        while (sem_wait(&header->go[k]) != 0 && errno == EINTR) {}
+        if (header->stop) break;
+
+        if (k > 0) ring_drain(slab_ring(2 * (k - 1)), particles);
+        if (k < header->slabCount - 1) ring_drain(slab_ring(2 * k + 1), particles);
+        particles.insert(particles.end(), departed.begin(), departed.end());
+        const Particle* players = shared_players();
+        for (int i = 0; i < header->playerCount; ++i) {
+            Particle p = players[i];
+            p.id = -1 - p.id;
+            particles.push_back(p);
+        }
+
+        world.rainbowFragments.clear();
+        const SlabHeat* heat = shared_heat();
+        for (int i = 0; i < header->heatCount; ++i) {
+            RainbowFragment rf = {};
+            rf.x = heat[i].x; rf.y = heat[i].y; rf.vx = heat[i].vx; rf.vy = heat[i].vy;
+            rf.type = heat[i].type;
+            world.rainbowFragments.insert(rf, 1);
+        }
+
+        world.brushParticles.clear();
+        const SlabBrush* brushes = shared_brushes();
+        for (int i = 0; i < header->brushCount; ++i) {
+            BrushParticle bp = {};
+            bp.x = brushes[i].x; bp.y = brushes[i].y; bp.baseSize = brushes[i].baseSize;
+            bp.type = BRUSH_BLUE;
+            world.brushParticles.push_back(bp);
+        }
+
+        world.forces.assign(particles.size(), Vector2D());
+        grid.update_and_sort(particles, world.particle_buffer);
+        world.density.rebuild(particles);
+        update_sleeping_cells(world);
+        pool.dispatch_repulsion_calc(grid.get_active_keys(), world);
+        pool.wait();
+        pool.reduce_forces(world.forces);
+        apply_heat_from_fragments(world);
+
+        // Ghosts only lend their positions; their owners integrate them.
+        for (auto& p : particles) if (p.id < 0) p.asleep = true;
+        apply_forces_to_particles(world);
+        particles.erase(std::remove_if(particles.begin(), particles.end(), [](const Particle& p) { return p.id < 0; }), particles.end());
+        resolve_brush_collisions(world);
+
+        slab_publish(particles, k, grid.invCellSize);
+        sem_post(&header->done);
+    }
+}
+
+// Returns false if a slab process died; the caller then takes the water back.
+static bool wait_for_slabs() {
+    for (int n = 0; n < header->slabCount; ++n) {
+        while (true) {
+            timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += 2;
+            if (sem_timedwait(&header->done, &deadline) == 0) break;
+            if (errno == EINTR) continue;
+            for (int k = 0; k < header->slabCount; ++k) {
+                if (waitpid(slabPids[k], nullptr, WNOHANG) == slabPids[k]) {
+                    fprintf(stderr, "Slab process %d exited; continuing in one process.\n", k);
+                    slabPids[k] = 0;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static void gather_water(std::vector<Particle>& particles) {
+    particles.erase(std::remove_if(particles.begin(), particles.end(), [](const Particle& p) { return !p.isPlayer; }), particles.end());
+    for (int k = 0; k < header->slabCount; ++k) {
+        const Particle* out = slab_output(k);
+        particles.insert(particles.end(), out, out + header->outCount[k]);
+    }
+}
+
+static void shutdown_slabs() {
+    header->stop = 1;
+    for (int k = 0; k < header->slabCount; ++k) {
+        if (slabPids[k] <= 0) continue;
+        sem_post(&header->go[k]);
+    }
+    for (int k = 0; k < header->slabCount; ++k) {
+        if (slabPids[k] <= 0) continue;
+        timespec pause = { 0, 10 * 1000 * 1000 };
+        int tries = 200;
+        while (waitpid(slabPids[k], nullptr, WNOHANG) == 0 && --tries > 0) nanosleep(&pause, nullptr);
+        if (tries == 0) { kill(slabPids[k], SIGKILL); waitpid(slabPids[k], nullptr, 0); }
+        slabPids[k] = 0;
+    }
+}
+
+static void release_segment() {
+    munmap(header, segmentSize);
+    shm_unlink(segmentName);
+    header = nullptr;
+    domainActive = false;
+}
+
+bool slab_domain_start(World& world, int slabCount, int waterCount, int playerCount) {
+    if (slabCount < 2 || waterCount < 1) return false;
+    if (slabCount > MAX_SLABS) slabCount = MAX_SLABS;
+
+    SpatialGrid layout((float)world.width, (float)world.height, INTERACTION_RADIUS, true);
+    int halo = layout.stencil_reach(SLAB_HALO_RADIUS);
+    // A slab narrower than its halo would need ghosts from beyond its neighbours.
+    if (slabCount > layout.cols / halo) slabCount = layout.cols / halo;
+    if (slabCount < 2) return false;
+
+    uint32_t ringCapacity = 1;
+    while (ringCapacity < (uint32_t)waterCount) ringCapacity <<= 1;
+    int playerCapacity = playerCount > 0 ? playerCount : 1;
+
+    size_t offset = align_up(sizeof(SlabHeader));
+    size_t playersOffset = offset; offset = align_up(offset + sizeof(Particle) * playerCapacity);
+    size_t heatOffset = offset; offset = align_up(offset + sizeof(SlabHeat) * MAX_RAINBOW_FRAGMENTS);
+    size_t brushOffset = offset; offset = align_up(offset + sizeof(SlabBrush) * MAX_BRUSH_PARTICLES);
+    size_t outOffset = offset; offset = align_up(offset + sizeof(Particle) * (size_t)waterCount * slabCount);
+    size_t ringStride = align_up(align_up(sizeof(SlabRing)) + sizeof(SlabRecord) * (size_t)ringCapacity);
+    size_t ringOffset = offset; offset += ringStride * 2 * (slabCount - 1);
+
+    snprintf(segmentName, sizeof(segmentName), "/particle_slabs_%d", (int)getpid());
+    int fd = shm_open(segmentName, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) { perror("shm_open"); return false; }
+    if (ftruncate(fd, (off_t)offset) != 0) { perror("ftruncate"); close(fd); shm_unlink(segmentName); return false; }
+    void* base = mmap(nullptr, offset, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) { perror("mmap"); shm_unlink(segmentName); return false; }
+
+    segmentSize = offset;
+    header = new (base) SlabHeader();
+    header->slabCount = slabCount;
+    header->waterCapacity = waterCount;
+    // Taken for real once the slabs are up; nothing spawns in between.
+    header->waterIdBase = world.nextParticleId;
+    header->ringCapacity = ringCapacity;
+    header->playerCapacity = playerCapacity;
+    header->haloColumns = halo;
+    header->stop = 0;
+    header->playersOffset = playersOffset;
+    header->heatOffset = heatOffset;
+    header->brushOffset = brushOffset;
+    header->outOffset = outOffset;
+    header->ringOffset = ringOffset;
+    header->ringStride = ringStride;
+    for (int k = 0; k < slabCount; ++k) {
+        header->colBegin[k] = layout.cols * k / slabCount;
+        header->colEnd[k] = layout.cols * (k + 1) / slabCount;
+        sem_init(&header->go[k], 1, 0);
+    }
+    sem_init(&header->done, 1, 0);
+    for (int r = 0; r < 2 * (slabCount - 1); ++r) {
+        SlabRing* ring = new (slab_ring(r)) SlabRing();
+        ring->head.store(0);
+        ring->tail.store(0);
+    }
+
+    for (int k = 0; k < slabCount; ++k) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            run_slab_worker(k, world.width, world.height);
+            _exit(0);
+        }
+        slabPids[k] = pid;
+        if (pid < 0) {
+            perror("fork");
+            shutdown_slabs();
+            release_segment();
+            return false;
+        }
+    }
+
+    if (!wait_for_slabs()) {
+        shutdown_slabs();
+        release_segment();
+        return false;
+    }
+    domainActive = true;
+    reserveParticleIds(world, waterCount);
+    gather_water(world.particles);
+    printf("Simulating water in %d slab processes (%d halo columns).\n", slabCount, halo);
+    return true;
+}
+
+bool slab_domain_active() {
+    return domainActive;
+}
+
+void slab_domain_step(World& world) {
+    if (!domainActive) return;
+
+    int playerCount = 0;
+    Particle* players = shared_players();
+    for (const auto& p : world.particles) {
+        if (p.isPlayer && playerCount < header->playerCapacity) players[playerCount++] = p;
+    }
+    header->playerCount = playerCount;
+
+    int heatCount = 0;
+    SlabHeat* heat = shared_heat();
+    for (const auto& rf : world.rainbowFragments) {
+        if ((rf.type == 1 || rf.type == 2) && heatCount < MAX_RAINBOW_FRAGMENTS) heat[heatCount++] = { rf.x, rf.y, rf.vx, rf.vy, rf.type };
+    }
+    header->heatCount = heatCount;
+
+    int brushCount = 0;
+    SlabBrush* brushes = shared_brushes();
+    for (const auto& bp : world.brushParticles) {
+        if (bp.type == BRUSH_BLUE && !bp.absorbed && brushCount < (int)MAX_BRUSH_PARTICLES) brushes[brushCount++] = { bp.x, bp.y, bp.baseSize };
+    }
+    header->brushCount = brushCount;
+
+    for (int k = 0; k < header->slabCount; ++k) sem_post(&header->go[k]);
+    if (wait_for_slabs()) gather_water(world.particles);
+    else slab_domain_stop(world);
+}
+
+// Takes the water back into this process, so the game can carry on without slabs.
+void slab_domain_stop(World& world) {
+    if (!domainActive) return;
+    std::vector<Particle>& particles = world.particles;
+    shutdown_slabs();
+    gather_water(particles);
+    release_segment();
+
+    // A slab that died mid-step leaves an older output behind, which can still list
+    // particles it had already handed to a neighbour.
+    std::vector<char> seen;
+    size_t kept = 0;
+    for (size_t i = 0; i < particles.size(); ++i) {
+        int id = particles[i].id;
+        if (id >= (int)seen.size()) seen.resize(id + 1, 0);
+        if (seen[id]) continue;
+        seen[id] = 1;
+        particles[kept++] = particles[i];
+    }
+    particles.resize(kept);
+}
+
+#else
+
+bool slab_domain_start(World&, int, int, int) { return false; }
+bool slab_domain_active() { return false; }
+void slab_domain_step(World&) {}
+void slab_domain_stop(World&) {}
+
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+#include "World.h"
+
+// Splits the water simulation into vertical slabs of SpatialGrid cell columns, each
+// stepped by its own local process. Neighbouring slabs trade their border columns
+// (halo ghosts) and the particles that cross over (migrants) through shared-memory
+// rings; this process keeps the players, brushes and fragments and gathers the
+// water back for rendering. POSIX only; on other platforms start() returns false.
+// Water must come from the slabs while they run: water added with spawnParticle()
+// is replaced by the next gather.
+const int MAX_SLABS = 16;
+
+// Forks the slab processes, each stepping its share of `world`'s water in a World
+// of its own. Call before SDL_Init and before any thread is started.
+bool slab_domain_start(World& world, int slabCount, int waterCount, int playerCount);
+bool slab_domain_active();
+// Publishes players, heat fragments and blue brushes, runs one step in every slab
+// and replaces the water in `world.particles` with the gathered result.
+void slab_domain_step(World& world);
+void slab_domain_stop(World& world);
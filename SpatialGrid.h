@@ -1,54 +1,172 @@
 #pragma once
-#include "GameConfig.h"
+#include "SimTypes.h"
+#include "AllocCounter.h"
+#include "CellTable.h"
 #include <vector>
 #include <cmath>
+#include <cstdint>
 #include <algorithm>
 
+// Two backends behind one query API. Dense keeps cols * rows cells over the whole
+// world; sparse hashes only the occupied cells, so memory and per-frame clearing
+// follow the particle count instead of the world area. Callers address cells
+// through find_cell/cell_coords and never compute indices themselves.
 class SpatialGrid {
 public:
     std::vector<int> cellStart;
     std::vector<int> cellCount;
 
+    // Per-cell sleep bookkeeping. A cell that stays calm for SLEEP_FRAMES frames
+    // with nothing disturbing its neighbourhood is skipped by the force pass.
+    std::vector<int> cellCalmFrames;
+    std::vector<char> cellDisturbed;
+    std::vector<char> cellAsleep;
+
     int cols, rows;
     float cellSize;
     float invCellSize;
+    bool sparse;
 
-    SpatialGrid(float width, float height, float size) {
+    SpatialGrid(float width, float height, float size, bool sparseCells = false) {
         cellSize = size;
         invCellSize = 1.0f / size;
+        sparse = sparseCells;
         resize(width, height);
     }
 
     int get_cols() const { return cols; }
     int get_rows() const { return rows; }
+    int cell_total() const { return (int)cellCount.size(); }
+
+    // How many cells either side of a particle's own cell a query of this radius
+    // has to visit. Lets wide interactions stay exact without growing cellSize.
+    int stencil_reach(float radius) const { return (int)std::ceil(radius * invCellSize); }
+
+    int cell_x(float x) const {
+        if (sparse) return (int)std::floor(x * invCellSize);
+        int cx = (int)(x * invCellSize);
+        if (cx < 0) cx = 0; else if (cx >= cols) cx = cols - 1;
+        return cx;
+    }
+
+    int cell_y(float y) const {
+        if (sparse) return (int)std::floor(y * invCellSize);
+        int cy = (int)(y * invCellSize);
+        if (cy < 0) cy = 0; else if (cy >= rows) cy = rows - 1;
+        return cy;
+    }
+
+    // Index into cellStart/cellCount, or -1 when the cell is outside the grid
+    // (dense) or holds no particles (sparse).
+    int find_cell(int cx, int cy) const {
+        if (!sparse) {
+            if (cx < 0 || cx >= cols || cy < 0 || cy >= rows) return -1;
+            return cx + cy * cols;
+        }
+        return table.find(cx, cy);
+    }
+
+    void cell_coords(int idx, int& cx, int& cy) const {
+        if (sparse) { cx = table.cell_x(idx); cy = table.cell_y(idx); }
+        else { cx = idx % cols; cy = idx / cols; }
+    }
 
     void resize(float width, float height) {
+        MemScope mem(MEM_SIMULATION);
         cols = static_cast<int>(std::ceil(width * invCellSize)) + 1;
         rows = static_cast<int>(std::ceil(height * invCellSize)) + 1;
 
-        int cellNum = cols * rows;
+        int cellNum = sparse ? 0 : cols * rows;
         cellStart.assign(cellNum, 0);
         cellCount.assign(cellNum, 0);
+        cellCalmFrames.assign(cellNum, 0);
+        cellDisturbed.assign(cellNum, 0);
+        cellAsleep.assign(cellNum, 0);
     }
 
     std::vector<int> get_active_keys() const {
         std::vector<int> active_keys;
-        active_keys.reserve(TOTAL_PARTICLES / 2);
+        active_keys.reserve(cellCount.size() / 4);
 
         for (size_t i = 0; i < cellCount.size(); ++i) {
-            if (cellCount[i] > 0) {
+            if (cellCount[i] > 0 && !is_dormant((int)i)) {
                 active_keys.push_back((int)i);
             }
         }
         return active_keys;
     }
 
+    // Asleep and every occupied neighbour asleep too. Sleeping cells that border an
+    // awake one stay in the force pass so the awake side still feels them.
+    bool is_dormant(int idx) const {
+        if (!cellAsleep[idx]) return false;
+        int cx, cy;
+        cell_coords(idx, cx, cy);
+        for (int ny = cy - 1; ny <= cy + 1; ++ny) {
+            for (int nx = cx - 1; nx <= cx + 1; ++nx) {
+                int n = find_cell(nx, ny);
+                if (n >= 0 && cellCount[n] > 0 && !cellAsleep[n]) return false;
+            }
+        }
+        return true;
+    }
+
+    void disturb(float x, float y, int reach) {
+        disturb_cell(cell_x(x), cell_y(y), reach);
+    }
+
+    void disturb_cell(int cx, int cy, int reach) {
+        for (int ny = cy - reach; ny <= cy + reach; ++ny) {
+            for (int nx = cx - reach; nx <= cx + reach; ++nx) {
+                int n = find_cell(nx, ny);
+                if (n >= 0) cellDisturbed[n] = 1;
+            }
+        }
+    }
+
+    // Call after update_and_sort and after the external disturb() marks for this frame.
+    void update_sleep(std::vector<Particle>& particles) {
+        const float SLEEP_SPEED_SQ = SLEEP_SPEED * SLEEP_SPEED;
+        int cellNum = cell_total();
+
+        for (int c = 0; c < cellNum; ++c) {
+            int end = cellStart[c] + cellCount[c];
+            for (int i = cellStart[c]; i < end; ++i) {
+                const Particle& p = particles[i];
+                if (p.temperature > 0.0f || p.vx * p.vx + p.vy * p.vy > SLEEP_SPEED_SQ) {
+                    int cx, cy;
+                    cell_coords(c, cx, cy);
+                    disturb_cell(cx, cy, 1);
+                    break;
+                }
+            }
+        }
+
+        for (int c = 0; c < cellNum; ++c) {
+            if (cellDisturbed[c] || cellCount[c] == 0) cellCalmFrames[c] = 0;
+            else if (cellCalmFrames[c] < SLEEP_FRAMES) cellCalmFrames[c]++;
+            cellAsleep[c] = (cellCalmFrames[c] >= SLEEP_FRAMES);
+            cellDisturbed[c] = 0;
+
+            int end = cellStart[c] + cellCount[c];
+            for (int i = cellStart[c]; i < end; ++i) particles[i].asleep = cellAsleep[c] != 0;
+        }
+    }
+
     void update_and_sort(std::vector<Particle>& particles, std::vector<Particle>& buffer) {
+        if (sparse) {
+            update_and_sort_sparse(particles, buffer);
+            return;
+        }
+
         int cellNum = cols * rows;
 
         if (cellCount.size() != cellNum) {
             cellCount.resize(cellNum);
             cellStart.resize(cellNum);
+            cellCalmFrames.assign(cellNum, 0);
+            cellDisturbed.assign(cellNum, 0);
+            cellAsleep.assign(cellNum, 0);
         }
 
         std::fill(cellCount.begin(), cellCount.end(), 0);
@@ -89,6 +207,57 @@ public:
             buffer[destIdx] = p;
         }
 
+        std::swap(particles, buffer);
+    }
+
+private:
+    // Occupied cell -> slot, rebuilt every frame. The previous frame's table is kept
+    // so sleep counters can follow their cell across the renumbering.
+    CellTable table, prevTable;
+    std::vector<int> particleSlot;
+    std::vector<int> prevCalmFrames;
+
+    void update_and_sort_sparse(std::vector<Particle>& particles, std::vector<Particle>& buffer) {
+        std::swap(table, prevTable);
+        prevCalmFrames.swap(cellCalmFrames);
+
+        table.clear(particles.size());
+        cellCount.clear();
+        particleSlot.resize(particles.size());
+
+        for (size_t i = 0; i < particles.size(); ++i) {
+            int cx = (int)std::floor(particles[i].x * invCellSize);
+            int cy = (int)std::floor(particles[i].y * invCellSize);
+            int slot = table.insert(cx, cy);
+            if (slot == (int)cellCount.size()) cellCount.push_back(0);
+            cellCount[slot]++;
+            particleSlot[i] = slot;
+        }
+
+        int cellNum = (int)cellCount.size();
+        cellStart.resize(cellNum);
+        cellDisturbed.assign(cellNum, 0);
+        cellAsleep.assign(cellNum, 0);
+        cellCalmFrames.resize(cellNum);
+
+        int offset = 0;
+        for (int c = 0; c < cellNum; ++c) {
+            cellStart[c] = offset;
+            offset += cellCount[c];
+
+            int prev = prevTable.find(table.cell_x(c), table.cell_y(c));
+            cellCalmFrames[c] = (prev >= 0 && prev < (int)prevCalmFrames.size()) ? prevCalmFrames[prev] : 0;
+        }
+
+        static std::vector<int> currentOffsets;
+        currentOffsets.assign(cellStart.begin(), cellStart.end());
+
+        if (buffer.size() != particles.size()) buffer.resize(particles.size());
+
+        for (size_t i = 0; i < particles.size(); ++i) {
+            buffer[currentOffsets[particleSlot[i]]++] = particles[i];
+        }
+
         std::swap(particles, buffer);
     }
 };
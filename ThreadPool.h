@@ -1,18 +1,24 @@
 #pragma once
-#include "GameConfig.h"
-#include "SpatialGrid.h"
+#include "World.h"
+#include "PhysicsSystem.h"
+#include "Profiler.h"
+#include "PerfCounters.h"
 #include <vector>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
 
 class ThreadPool {
 public:
     ThreadPool(size_t num_threads) : jobs_in_progress(0), stop_flag(false) {
         for (size_t i = 0; i < num_threads; ++i) {
             workers.emplace_back(&ThreadPool::worker_loop, this, i);
-            thread_local_forces.emplace_back(TOTAL_PARTICLES, Vector2D());
+            thread_local_forces.emplace_back();
         }
+        worker_ran.assign(num_threads, 0);
+        busy_ns.assign(num_threads, 0);
+        hw_counts.assign(num_threads, HwCounts());
     }
 
     ~ThreadPool() {
@@ -28,12 +34,19 @@ public:
         }
     }
 
-    void dispatch_repulsion_calc(const std::vector<int>& keys, const SpatialGrid& grid) {
+    void dispatch_repulsion_calc(const std::vector<int>& keys, const World& world) {
+        std::fill(worker_ran.begin(), worker_ran.end(), 0);
         if (keys.empty()) return;
 
+        MemScope mem(MEM_FORCES);
         {
             std::unique_lock<std::mutex> lock(queue_mutex);
-            this->grid_ptr = &grid;
+            this->world_ptr = &world;
+
+            // Force buffers follow the live particle count.
+            for (auto& local_f : thread_local_forces) {
+                if (local_f.size() != world.particles.size()) local_f.resize(world.particles.size());
+            }
 
             size_t num_workers = workers.size();
             size_t num_keys = keys.size();
@@ -50,6 +63,7 @@ public:
                 for (size_t k = 0; k < count; ++k) {
                     jobs[i].push_back(keys[current_key_idx++]);
                 }
+                worker_ran[i] = 1;
             }
 
             jobs_in_progress = active_workers;
@@ -66,8 +80,32 @@ public:
             });
     }
 
+    size_t size() const { return workers.size(); }
+
+    // Time each worker has spent on force jobs since the last call, then resets it.
+    void take_busy_ns(std::vector<int64_t>& out) {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        out = busy_ns;
+        std::fill(busy_ns.begin(), busy_ns.end(), 0);
+    }
+
+    // Hardware counts of each worker's force jobs since the last call, added to
+    // perWorker and to total, then reset. Each worker reads its own counters.
+    void take_hw_counts(std::vector<HwCounts>& perWorker, HwCounts& total) {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        if (perWorker.size() < hw_counts.size()) perWorker.resize(hw_counts.size());
+        for (size_t t = 0; t < hw_counts.size(); ++t) {
+            perWorker[t].add(hw_counts[t]);
+            total.add(hw_counts[t]);
+            hw_counts[t] = HwCounts();
+        }
+    }
+
     void reduce_forces(std::vector<Vector2D>& main_forces) {
-        for (const auto& local_f : thread_local_forces) {
+        for (size_t t = 0; t < thread_local_forces.size(); ++t) {
+            // Workers left idle this round still hold last round's forces.
+            if (!worker_ran[t]) continue;
+            const auto& local_f = thread_local_forces[t];
             for (size_t i = 0; i < main_forces.size(); ++i) {
                 main_forces[i].fx += local_f[i].fx;
                 main_forces[i].fy += local_f[i].fy;
@@ -77,6 +115,8 @@ public:
 
 private:
     void worker_loop(size_t thread_id) {
+        PROFILE_THREAD("pool worker");
+        MemScope mem(MEM_FORCES);
         size_t last_generation = 0;
 
         while (true) {
@@ -104,14 +144,23 @@ private:
                 }
             }
 
+            HwReading hw_start;
+            bool counting = hw_counters_enabled() && hw_counters_read(hw_start);
+            auto job_start = std::chrono::steady_clock::now();
+            PROFILE_ZONE("worker forces");
             std::fill(thread_local_forces[thread_id].begin(), thread_local_forces[thread_id].end(), Vector2D());
 
-            if (grid_ptr) {
-                calculate_forces_for_keys(task_keys, *grid_ptr, thread_local_forces[thread_id]);
+            if (world_ptr) {
+                calculate_forces_for_keys(*world_ptr, task_keys, thread_local_forces[thread_id]);
             }
 
+            int64_t job_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - job_start).count();
+            HwReading hw_end;
+            bool counted = counting && hw_counters_read(hw_end);
             {
                 std::unique_lock<std::mutex> lock(queue_mutex);
+                busy_ns[thread_id] += job_ns;
+                if (counted) hw_counts[thread_id].add_span(hw_start, hw_end);
                 if (jobs_in_progress > 0) {
                     jobs_in_progress--;
                 }
@@ -125,7 +174,10 @@ private:
     std::vector<std::thread> workers;
     std::vector<std::vector<int>> jobs;
     std::vector<std::vector<Vector2D>> thread_local_forces;
-    const SpatialGrid* grid_ptr = nullptr;
+    std::vector<char> worker_ran;
+    std::vector<int64_t> busy_ns;
+    std::vector<HwCounts> hw_counts;
+    const World* world_ptr = nullptr;
 
     std::mutex queue_mutex;
     std::condition_variable cv_job_ready;
@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <cstddef>
+
+// Items are filed into the bucket of the tick they expire on. advance() moves the
+// cursor one tick and drops that whole bucket, so nothing ever scans live items
+// to find the dead ones. SLOTS must be a power of two and longer than any lifetime.
+template <typename T, int SLOTS>
+class TimingWheel {
+    static_assert((SLOTS & (SLOTS - 1)) == 0, "SLOTS must be a power of two");
+
+public:
+    template <typename Item, typename Bucket>
+    class Iter {
+    public:
+        Iter(Bucket* b, Bucket* e) : bucket(b), bucketEnd(e), idx(0) { skip_empty(); }
+
+        Item& operator*() const { return (*bucket)[idx]; }
+        Item* operator->() const { return &(*bucket)[idx]; }
+        Iter& operator++() { ++idx; skip_empty(); return *this; }
+        bool operator!=(const Iter& o) const { return bucket != o.bucket || idx != o.idx; }
+
+    private:
+        void skip_empty() {
+            while (bucket != bucketEnd && idx >= bucket->size()) { ++bucket; idx = 0; }
+        }
+
+        Bucket* bucket;
+        Bucket* bucketEnd;
+        size_t idx;
+    };
+
+    using iterator = Iter<T, std::vector<T>>;
+    using const_iterator = Iter<const T, const std::vector<T>>;
+
+    iterator begin() { return iterator(buckets.data(), buckets.data() + SLOTS); }
+    iterator end() { return iterator(buckets.data() + SLOTS, buckets.data() + SLOTS); }
+    const_iterator begin() const { return const_iterator(buckets.data(), buckets.data() + SLOTS); }
+    const_iterator end() const { return const_iterator(buckets.data() + SLOTS, buckets.data() + SLOTS); }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // The item is dropped by the ticks-th advance() from now.
+    void insert(const T& item, int ticks) {
+        if (ticks < 1) ticks = 1;
+        if (ticks > SLOTS - 1) ticks = SLOTS - 1;
+        buckets[(cursor + ticks) & (SLOTS - 1)].push_back(item);
+        count++;
+    }
+
+    void advance() {
+        cursor = (cursor + 1) & (SLOTS - 1);
+        count -= buckets[cursor].size();
+        buckets[cursor].clear();
+    }
+
+    // Makes room by dropping the items closest to expiring.
+    void retire_soonest(size_t n) {
+        for (int k = 1; k < SLOTS && n > 0; ++k) {
+            std::vector<T>& b = buckets[(cursor + k) & (SLOTS - 1)];
+            size_t drop = (b.size() < n) ? b.size() : n;
+            b.resize(b.size() - drop);
+            count -= drop;
+            n -= drop;
+        }
+    }
+
+    void clear() {
+        for (auto& b : buckets) b.clear();
+        count = 0;
+    }
+
+private:
+    std::array<std::vector<T>, SLOTS> buckets;
+    int cursor = 0;
+    size_t count = 0;
+};
@@ -0,0 +1,148 @@
+#pragma once
+#include "SimTypes.h"
+#include "SpatialGrid.h"
+#include "DensityGrid.h"
+#include "BrushGrid.h"
+#include "AllocCounter.h"
+#include "PerfCounters.h"
+#include <vector>
+#include <cstdint>
+#include <random>
+
+// Sounds the simulation asks for. The core never plays anything itself; it hands
+// these to whatever SimEvents the frontend installed, which may be none at all.
+enum SimSound { SIM_SOUND_BLUE, SIM_SOUND_RAINBOW, SIM_SOUND_EXPLOSION };
+
+class SimEvents {
+public:
+    virtual ~SimEvents() = default;
+    virtual void on_sound(SimSound sound) = 0;
+};
+
+// Stages of one simulation step, as timed for the benchmark.
+enum SimStage {
+    SIM_STAGE_EXCHANGE,    // slab runs only: spawns, and trading water with the slab processes
+    SIM_STAGE_SORT,        // spawns, grid rebuild and particle sort
+    SIM_STAGE_DENSITY,     // density buffer and sleeping cells
+    SIM_STAGE_FORCES,      // pair forces on the pool
+    SIM_STAGE_REDUCE,      // merging the per-thread forces
+    SIM_STAGE_INTEGRATE,   // heat, mouse, cohesion and integration
+    SIM_STAGE_BRUSH,       // meteors, painting, brush particles and collisions
+    SIM_STAGE_FRAGMENTS,
+    SIM_STAGE_COUNT
+};
+
+const char* const SIM_STAGE_NAMES[SIM_STAGE_COUNT] = {
+    "exchange", "sort", "density", "forces", "reduce", "integrate", "brush", "fragments"
+};
+
+// What the frontend feeds the simulation each frame. Mouse coordinates are in
+// world space; the view rectangle is the part of the world on screen, which meteor
+// showers spawn above.
+struct SimInput {
+    int mouseX = 0, mouseY = 0;
+    bool mouseDown = false;
+    bool brushMode = false;
+    bool painting = false;
+    int brushEffectMode = 1;
+    bool silent = true;
+    float viewX = 0.0f, viewY = 0.0f;
+    float viewW = 1280.0f, viewH = 720.0f;
+};
+
+// Everything one simulation instance owns. The core (GameLogic, PhysicsSystem,
+// Simulation, SlabDomain) only touches the World it is handed, so several can run
+// in one process and none of them needs a window.
+struct World {
+    int width, height;
+    SpatialGrid grid;
+
+    std::vector<Particle> particles;
+    std::vector<Particle> particle_buffer;
+    std::vector<Vector2D> forces;
+    FragmentWheel rainbowFragments;
+    std::vector<BrushParticle> brushParticles;
+    DensityGrid density;
+
+    // Player swarm centre and mean velocity, refreshed by the physics step.
+    float centerX = 0.0f, centerY = 0.0f, avgVx = 0.0f, avgVy = 0.0f;
+    // Grid cells the last force pass ran over.
+    int activeCells = 0;
+
+    bool playerSunMode = false;
+    float playerSunTimer = 0.0f;
+    bool playerRainbow = false;
+    float playerRainbowTimer = 0.0f;
+    float playerJumpTimer = 0.0f;
+
+    float meteorTimer = 0.0f;
+    float nextMeteorInterval = 2.0f;
+
+    // Where the last brush stroke ended, for the spline to the next one.
+    float lastBrushX = 0.0f, lastBrushY = 0.0f;
+    float lastVelX = 0.0f, lastVelY = 0.0f;
+
+    // Simulation clock, advanced SIM_FRAME_MS per physics step.
+    double timeMs = 0.0;
+    double lastBlueImpactMs = -1e9;
+
+    // Spawns and despawns wait here for apply_particle_spawns(); ids are recycled
+    // through the free list to keep them dense. An id is live from its spawn until
+    // its despawn is applied; despawning an id that is not live does nothing. Water
+    // stepped in slab processes takes a block from reserveParticleIds() and is
+    // never live here.
+    std::vector<Particle> pendingSpawns;
+    std::vector<char> pendingDespawn;
+    std::vector<char> liveParticleIds;
+    std::vector<int> freeParticleIds;
+    int nextParticleId = 0;
+    bool hasPendingDespawn = false;
+
+    // Coarse grid of unabsorbed brushes, rebuilt by resolve_brush_collisions().
+    BrushGrid brushGrid;
+
+    SimEvents* events = nullptr;
+
+    // The simulation's random stream, seeded with the run's seed. Owning it makes a
+    // world reproducible whichever thread runs a stage and keeps worlds in one
+    // process independent; stages that draw from it write RES_RANDOM, so the frame
+    // graph keeps their order fixed.
+    std::minstd_rand rng;
+
+    // Non-negative, like rand(), for `% n`.
+    int random() { return (int)rng(); }
+    // Uniform in [0, 1].
+    float random_unit() { return (float)(rng() - std::minstd_rand::min()) / (float)(std::minstd_rand::max() - std::minstd_rand::min()); }
+
+    // Nanoseconds spent and operator new calls made per stage since the world was
+    // made, summed only while timeStages is set. Hardware counters are summed too
+    // when they are on; the force stage includes the pool workers, which are also
+    // kept apart in workerHw.
+    bool timeStages = false;
+    int64_t stageNs[SIM_STAGE_COUNT] = {};
+    uint64_t stageAllocs[SIM_STAGE_COUNT] = {};
+    HwCounts stageHw[SIM_STAGE_COUNT];
+    std::vector<HwCounts> workerHw;
+
+    World(int w, int h, bool sparseGrid = false)
+        : width(w), height(h), grid((float)w, (float)h, INTERACTION_RADIUS, sparseGrid),
+          density(sparseGrid), brushGrid(sparseGrid) {
+        resize(w, h);
+        lastBrushX = w * 0.5f;
+        lastBrushY = h * 0.5f;
+    }
+
+    // The grids keep their allocations when the new size fits.
+    void resize(int w, int h) {
+        MemScope mem(MEM_SIMULATION);
+        width = w;
+        height = h;
+        grid.resize((float)w, (float)h);
+        density.resize(w, h);
+        brushGrid.resize(w, h);
+    }
+
+    void emit(SimSound sound) {
+        if (events) events->on_sound(sound);
+    }
+};
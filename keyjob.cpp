@@ -1,5 +1,37 @@
 #include "keyjob.h"
 
+// A drag-resize sends a stream of RESIZED events; only the last size of the frame
+// is acted on, by apply_pending_resize().
+static int pendingWidth = 0, pendingHeight = 0;
+
+void apply_pending_resize(World& world, SDL_Renderer* renderer, GameTextures& textures) {
+    if (pendingWidth <= 0 || pendingHeight <= 0) return;
+    int newW = pendingWidth, newH = pendingHeight;
+    pendingWidth = pendingHeight = 0;
+    if (newW == SCREEN_WIDTH && newH == SCREEN_HEIGHT) return;
+
+    float oldW = (float)SCREEN_WIDTH;
+    float oldH = (float)SCREEN_HEIGHT;
+
+    SCREEN_WIDTH = newW;
+    SCREEN_HEIGHT = newH;
+
+    if (worldFollowsScreen) {
+        for (auto& p : world.particles) {
+            p.x = (p.x / oldW) * SCREEN_WIDTH;
+            p.y = (p.y / oldH) * SCREEN_HEIGHT;
+            p.vx = 0; p.vy = 0;
+        }
+        world.resize(SCREEN_WIDTH, SCREEN_HEIGHT);
+    }
+    else {
+        world.resize(std::max(world.width, SCREEN_WIDTH), std::max(world.height, SCREEN_HEIGHT));
+    }
+
+    recreate_size_dependent_textures(renderer, textures, SCREEN_WIDTH, SCREEN_HEIGHT);
+    reset_alien_sky();
+}
+
 void handle_input_events(
     SDL_Event& e,
     bool& running,
@@ -8,38 +40,17 @@ void handle_input_events(
     bool& painting,
     int& brushEffectMode,
     bool& showFPS,
-    bool& silent,
-    ThreadPool& pool,
-    SpatialGrid& grid,
-    SDL_Renderer* renderer,
-    GameTextures& textures
+    bool& dumpFrameGraph,
+    bool& toggleProfile,
+    bool& silent
 ) {
     if (e.type == SDL_QUIT) {
         running = false;
     }
 
     if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_RESIZED) {
-        pool.wait();
-
-        float oldW = (float)SCREEN_WIDTH;
-        float oldH = (float)SCREEN_HEIGHT;
-
-        SCREEN_WIDTH = e.window.data1;
-        SCREEN_HEIGHT = e.window.data2;
-
-        for (auto& p : particles) {
-            p.x = (p.x / oldW) * SCREEN_WIDTH;
-            p.y = (p.y / oldH) * SCREEN_HEIGHT;
-            p.vx = 0; p.vy = 0;
-        }
-
-        grid.resize((float)SCREEN_WIDTH, (float)SCREEN_HEIGHT);
-        density_buffer_width = SCREEN_WIDTH / DENSITY_BUFFER_SCALE;
-        density_buffer_height = SCREEN_HEIGHT / DENSITY_BUFFER_SCALE;
-        density_buffer.resize(density_buffer_width * density_buffer_height);
-
-        recreate_all_textures(renderer, textures, SCREEN_WIDTH, SCREEN_HEIGHT);
-        reset_alien_sky();
+        pendingWidth = e.window.data1;
+        pendingHeight = e.window.data2;
     }
 
     if (e.type == SDL_MOUSEBUTTONDOWN) {
@@ -73,6 +84,18 @@ void handle_input_events(
             }
         }
 
+        if (e.key.keysym.sym == SDLK_F5) {
+            if (e.key.repeat == 0) {
+                dumpFrameGraph = true;
+            }
+        }
+
+        if (e.key.keysym.sym == SDLK_F6) {
+            if (e.key.repeat == 0) {
+                toggleProfile = true;
+            }
+        }
+
         if (e.key.keysym.sym == SDLK_F4) {
             if (e.key.repeat == 0) {
                 silent = !silent;
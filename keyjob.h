@@ -1,9 +1,8 @@
 #pragma once
 #include <SDL.h>
 #include "GameConfig.h"
-#include "SpatialGrid.h"
-#include "ThreadPool.h"
-#include "Render.h" 
+#include "World.h"
+#include "Render.h"
 
 void handle_input_events(
     SDL_Event& e,
@@ -13,9 +12,9 @@ void handle_input_events(
     bool& painting,
     int& brushEffectMode,
     bool& showFPS,
-    bool& silent,
-    ThreadPool& pool,
-    SpatialGrid& grid,
-    SDL_Renderer* renderer,
-    GameTextures& textures
-);
\ No newline at end of file
+    bool& dumpFrameGraph,
+    bool& toggleProfile,
+    bool& silent
+);
+
+void apply_pending_resize(World& world, SDL_Renderer* renderer, GameTextures& textures);
\ No newline at end of file